@@ -0,0 +1,268 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <utility>
+#include <functional>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../base/nocopy.h"
+
+namespace cbricks{namespace datastruct{
+
+/**
+ * 基于开放寻址实现的只读哈希表——借鉴 swiss table 实现
+ * 适用场景：一次性构建、此后只读的数据快照，如 sync::Map 中的 readonly
+ * 功能点：
+ *  - 所有 kv 连续存放在槽位数组中，不存在每个 key 一次的节点分配
+ *  - 每个槽位对应一个控制字节，存放 key 哈希值的高 7 位（空槽位为 EMPTY）. 查找时以 16 个控制字节为一组，
+ *    通过 SSE2 指令一次比较整组，仅对控制字节匹配的槽位比较 key. 命中时通常只需访问一次控制字节、一次槽位
+ *  - 装载因子不超过 7/8，保证探测序列中总能遇到空槽位而终止
+ */
+template <class Key, class Value, class Hash = std::hash<Key>>
+class FlatMap : base::Noncopyable{
+public:
+    // 槽位 类型别名
+    typedef std::pair<Key, Value> slot;
+
+public:
+    // 构造函数. 构造空表
+    FlatMap();
+    /**
+     * @brief: 构造函数. 基于 [begin, end) 范围内的 kv 对构造，重复的 key 以最后一次出现的 value 为准
+     * @param: begin、end——kv 对迭代器. 传入 std::move_iterator 时 kv 对会被移动到表中
+     * @param: size——kv 对数量（可以是包含重复 key 的数量）
+     */
+    template <class Iter>
+    FlatMap(Iter begin, Iter end, const size_t size);
+    // 析构函数. 析构所有 kv 并释放内存
+    ~FlatMap();
+
+public:
+    /**
+     * @brief: 查找 key 对应的 value
+     * @return: value 的指针，不存在时返回 nullptr
+     */
+    const Value* find(const Key& key) const;
+
+    /**
+     * @brief: 遍历所有 kv 对
+     * @param: f——形如 bool(const Key&, const Value&) 的闭包函数. 返回 false 时终止遍历
+     */
+    template <class F>
+    void range(F f) const;
+    /**
+     * @brief: 遍历槽位下标位于 [begin, end) 范围内的 kv 对. 将 [0, capacity) 切分为若干不相交的区间，可由多个线程并行遍历
+     * @param: begin、end——槽位下标区间，end 不超过 capacity
+     * @param: f——形如 bool(const Key&, const Value&) 的闭包函数. 返回 false 时终止遍历
+     * @return: true——区间遍历完成 false——被 f 终止
+     */
+    template <class F>
+    bool range(const size_t begin, const size_t end, F f) const;
+
+    // kv 对数量
+    size_t size() const;
+    // 槽位数量
+    size_t capacity() const;
+    // 占用的内存字节数（不包含 kv 自身间接持有的内存）
+    size_t memoryUsage() const;
+
+private:
+    // 控制字节取值：空槽位. 已占用槽位的控制字节为哈希值的高 7 位，最高位恒为 0
+    static const int8_t EMPTY = -128;
+    // 每组控制字节的数量
+    static const size_t GROUP_SIZE = 16;
+
+private:
+    // 计算 key 的哈希值. std::hash 对整数类型通常是恒等映射，需要通过乘法散列打散高低位
+    uint64_t hashOf(const Key& key) const;
+    /**
+     * @brief: 在 pos 起始的一组控制字节中查找等于 c 的字节
+     * @return: 位图，第 i 位为 1 表示第 pos + i 个控制字节匹配
+     */
+    uint32_t match(const size_t pos, const int8_t c) const;
+    // 按照容量分配控制字节和槽位，控制字节初始化为 EMPTY
+    void init(const size_t capacity);
+    // 构建阶段插入 kv 对，key 已存在时覆盖 value
+    template <class K, class V>
+    void insert(K&& key, V&& value);
+
+private:
+    /**
+     * 控制字节数组. 长度为 capacity + GROUP_SIZE - 1，
+     * 末尾追加的字节是头部字节的镜像，使得以任意位置为起点都能读取完整的一组控制字节
+     */
+    int8_t* m_ctrl;
+    // 槽位数组. 仅控制字节不为 EMPTY 的槽位中存在已构造的 kv 对
+    slot* m_slots;
+    // 槽位掩码，即容量 - 1
+    size_t m_mask;
+    // kv 对数量
+    size_t m_size;
+    // 哈希函数
+    Hash m_hash;
+};
+
+template <class Key, class Value, class Hash>
+FlatMap<Key,Value,Hash>::FlatMap():m_size(0){
+    this->init(GROUP_SIZE);
+}
+
+/**
+ * 构造流程：
+ * 1）容量取满足装载因子不超过 7/8 的最小的 2 的整数次幂，且不小于一组控制字节的数量
+ * 2）逐一插入 kv 对
+ */
+template <class Key, class Value, class Hash>
+template <class Iter>
+FlatMap<Key,Value,Hash>::FlatMap(Iter begin, Iter end, const size_t size):m_size(0){
+    size_t capacity = GROUP_SIZE;
+    while (capacity * 7 / 8 < size){
+        capacity <<= 1;
+    }
+    this->init(capacity);
+
+    for (Iter it = begin; it != end; it++){
+        this->insert((*it).first, (*it).second);
+    }
+}
+
+template <class Key, class Value, class Hash>
+FlatMap<Key,Value,Hash>::~FlatMap(){
+    for (size_t i = 0; i <= this->m_mask; i++){
+        if (this->m_ctrl[i] != EMPTY){
+            this->m_slots[i].~slot();
+        }
+    }
+    ::operator delete(this->m_slots);
+    delete[] this->m_ctrl;
+}
+
+/**
+ * @brief: 查找 key 对应的 value
+ * 1）哈希值的高 7 位作为控制字节，其余位决定探测起点
+ * 2）每轮读取一组控制字节，逐一比较控制字节匹配的槽位中的 key
+ * 3）组内存在空槽位，说明 key 不存在；否则按照三角数步长跳到下一组继续探测
+ */
+template <class Key, class Value, class Hash>
+const Value* FlatMap<Key,Value,Hash>::find(const Key& key) const{
+    uint64_t h = this->hashOf(key);
+    int8_t h2 = h >> 57;
+    size_t pos = (h >> 7) & this->m_mask;
+    for (size_t step = GROUP_SIZE;; step += GROUP_SIZE){
+        for (uint32_t bits = this->match(pos, h2); bits; bits &= bits - 1){
+            size_t index = (pos + __builtin_ctz(bits)) & this->m_mask;
+            if (this->m_slots[index].first == key){
+                return &this->m_slots[index].second;
+            }
+        }
+        if (this->match(pos, EMPTY)){
+            return nullptr;
+        }
+        pos = (pos + step) & this->m_mask;
+    }
+}
+
+template <class Key, class Value, class Hash>
+template <class F>
+void FlatMap<Key,Value,Hash>::range(F f) const{
+    this->range(0, this->m_mask + 1, f);
+}
+
+template <class Key, class Value, class Hash>
+template <class F>
+bool FlatMap<Key,Value,Hash>::range(const size_t begin, const size_t end, F f) const{
+    for (size_t i = begin; i < end; i++){
+        if (this->m_ctrl[i] == EMPTY){
+            continue;
+        }
+        if (!f(this->m_slots[i].first, this->m_slots[i].second)){
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class Key, class Value, class Hash>
+size_t FlatMap<Key,Value,Hash>::size() const{
+    return this->m_size;
+}
+
+template <class Key, class Value, class Hash>
+size_t FlatMap<Key,Value,Hash>::capacity() const{
+    return this->m_mask + 1;
+}
+
+template <class Key, class Value, class Hash>
+size_t FlatMap<Key,Value,Hash>::memoryUsage() const{
+    return sizeof(*this) + (this->m_mask + GROUP_SIZE) * sizeof(int8_t) + (this->m_mask + 1) * sizeof(slot);
+}
+
+template <class Key, class Value, class Hash>
+uint64_t FlatMap<Key,Value,Hash>::hashOf(const Key& key) const{
+    return static_cast<uint64_t>(this->m_hash(key)) * 0x9E3779B97F4A7C15ULL;
+}
+
+template <class Key, class Value, class Hash>
+uint32_t FlatMap<Key,Value,Hash>::match(const size_t pos, const int8_t c) const{
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(this->m_ctrl + pos));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+    uint32_t bits = 0;
+    for (size_t i = 0; i < GROUP_SIZE; i++){
+        if (this->m_ctrl[pos + i] == c){
+            bits |= 1u << i;
+        }
+    }
+    return bits;
+#endif
+}
+
+template <class Key, class Value, class Hash>
+void FlatMap<Key,Value,Hash>::init(const size_t capacity){
+    this->m_mask = capacity - 1;
+    this->m_ctrl = new int8_t[capacity + GROUP_SIZE - 1];
+    memset(this->m_ctrl, EMPTY, capacity + GROUP_SIZE - 1);
+    this->m_slots = static_cast<slot*>(::operator new(capacity * sizeof(slot)));
+}
+
+/**
+ * @brief: 构建阶段插入 kv 对
+ * 沿探测序列查找 key，存在时覆盖 value；否则写入探测序列中的第一个空槽位. 构建阶段不存在删除，key 必然位于第一个空槽位之前
+ */
+template <class Key, class Value, class Hash>
+template <class K, class V>
+void FlatMap<Key,Value,Hash>::insert(K&& key, V&& value){
+    uint64_t h = this->hashOf(key);
+    int8_t h2 = h >> 57;
+    size_t pos = (h >> 7) & this->m_mask;
+    for (size_t step = GROUP_SIZE;; step += GROUP_SIZE){
+        for (uint32_t bits = this->match(pos, h2); bits; bits &= bits - 1){
+            size_t index = (pos + __builtin_ctz(bits)) & this->m_mask;
+            if (this->m_slots[index].first == key){
+                this->m_slots[index].second = std::forward<V>(value);
+                return;
+            }
+        }
+        uint32_t bits = this->match(pos, EMPTY);
+        if (bits){
+            size_t index = (pos + __builtin_ctz(bits)) & this->m_mask;
+            new (&this->m_slots[index]) slot(std::forward<K>(key), std::forward<V>(value));
+            this->m_ctrl[index] = h2;
+            // 头部的控制字节需要同步更新尾部的镜像
+            if (index < GROUP_SIZE - 1){
+                this->m_ctrl[index + this->m_mask + 1] = h2;
+            }
+            this->m_size++;
+            return;
+        }
+        pos = (pos + step) & this->m_mask;
+    }
+}
+
+}}
@@ -1,75 +1,117 @@
-#pragma once 
+#pragma once
 
-#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <new>
 #include <string>
-#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../base/nocopy.h"
 
 namespace cbricks{namespace datastruct{
 
 /**
- * 基于 c++ 实现压缩前缀树
+ * 基于 c++ 实现压缩前缀树. 底层采用自适应基数树（ART, adaptive radix tree）的节点布局
+ * 核心思路：
+ *  - 内部节点按照子节点数量自适应地采用 Node4/Node16/Node48/Node256 四种布局，子节点较少时不必为 256 个分支预留空间
+ *  - Node16 借助 SSE2 指令一次比较 16 个分支字节
+ *  - 路径压缩：只有一个子节点的路径合并到节点的 prefix 中，不超过 INLINE_PREFIX 字节时直接存放在节点内部
+ *  - 叶子节点只存放分支字节之后剩余的 key 后缀与 value，与 value 一同分配；完整的 key 不在树中存储，需要时由遍历路径拼接得到
+ *  - 子节点指针的最低位用于区分叶子节点与内部节点
+ * 以某个内部节点的路径为完整 key 的数据，存放在该节点的 value 叶子中
+ * 节点中的 value 先于子节点、子节点按照分支字节从小到大遍历，即可得到按字典序排列的 key
  */
 template <class T>
-class RadixTree{
+class RadixTree : base::Noncopyable{
 public:
     /**
-     * 构造函数——完成 root 节点初始化
+     * 构造函数——空树，不分配任何节点
      */
     RadixTree();
+    // 析构函数. 回收所有节点
+    ~RadixTree();
 
 private:
+    // 内部节点类型
+    enum Type : uint8_t{
+        NODE4,
+        NODE16,
+        NODE48,
+        NODE256
+    };
+
+    // 不超过该长度的 prefix 直接存放在节点内部
+    static const uint32_t INLINE_PREFIX = 8;
+
     /**
-     * 内部类 Node: 前缀树中的节点
+     * 叶子节点. 剩余的 key 后缀紧随结构体存放，与叶子一同分配
+     */
+    struct Leaf{
+        explicit Leaf(const T& v, const uint32_t len):value(v),len(len){}
+        unsigned char* suffix(){
+            return reinterpret_cast<unsigned char*>(this + 1);
+        }
+
+        T value;
+        // key 后缀的长度
+        uint32_t len;
+    };
+
+    /**
+     * 内部节点的公共头部
      */
     struct Node{
-        // 智能指针类型别名
-        typedef std::shared_ptr<Node> ptr;
-        // 节点类型
-        enum Type{
-            // 标识当前节点中不存储 value. 当前节点的拆分仅因包含了多个子节点的公共前缀
-            STATIC,
-            // 标识当前节点中存储了 value
-            PARAM
+        explicit Node(const Type t):type(t),count(0),prefixLen(0),value(nullptr){}
+        const unsigned char* prefix() const{
+            return this->prefixLen > INLINE_PREFIX ? this->heapPrefix : this->inlinePrefix;
+        }
+
+        Type type;
+        // 子节点数量
+        uint16_t count;
+        // 压缩路径的长度
+        uint32_t prefixLen;
+        // 压缩路径. 较短时存放在节点内部，否则存放在堆上
+        union{
+            unsigned char inlinePrefix[INLINE_PREFIX];
+            unsigned char* heapPrefix;
         };
+        // 以当前节点路径为完整 key 的数据
+        Leaf* value;
+    };
 
-        // 节点类型
-        Type nodeType;
-        // 相对路径
-        std::string path;
-        // 完整路径，为从根节点出发直至抵达当前节点后，途径所有节点的相对路径之和
-        std::string fullPath;
-        // 子节点的首字母集合，类似于索引
-        std::string indices;
-        // 子节点列表，各个子节点与 indices 中的顺序一一对应
-        std::vector<Node::ptr> children;
-        // 节点优先级. 子节点数越多，优先级越高
-        int priority;
-        // 节点存储的 value
-        T value;
+    // 至多 4 个子节点，分支字节有序存放
+    struct Node4 : Node{
+        Node4():Node(NODE4){}
+        unsigned char keys[4];
+        void* children[4];
+    };
+
+    // 至多 16 个子节点，分支字节有序存放，查找时通过 SSE2 并行比较
+    struct Node16 : Node{
+        Node16():Node(NODE16){}
+        unsigned char keys[16];
+        void* children[16];
+    };
 
-        // 构造函数
-        Node(Type typ);
-
-        /**
-         * @brief 向节点中插入 value 值，该方法会将节点类型更新为 PARAM
-         * @param：path——节点相对路径
-         * @param：fullPath——节点完整路径
-         * @param：value——存储值
-         */
-        void insert(const std::string& path, const std::string& fullPath, T value);
-        /** 
-         * 获取 path 和当前节点相对路径—— node.path 的公共前缀的长度
-        */
-        int longestCommonPrefix(const std::string& path) const;
-        /**
-         * 1）增加 children[pos] 子节点的 priority
-         * 2）调整 children 中子节点的顺序，保证按照 priority 从高到底进行排序
-         * 3）若 children 顺序发生了变化，则对 indices 执行相应的调整
-         * 4）返回 children[pos] 在调整顺序后新的 index
-         */
-        int incrementChildPrio(const int pos);
-        // 追加一个新的子节点
-        void addChild(Node::ptr child);
+    // 至多 48 个子节点. index 以分支字节为下标，存放子节点在 children 中的位置 + 1，0 表示不存在
+    struct Node48 : Node{
+        Node48():Node(NODE48){
+            memset(this->index, 0, sizeof(this->index));
+            memset(this->children, 0, sizeof(this->children));
+        }
+        unsigned char index[256];
+        void* children[48];
+    };
+
+    // 至多 256 个子节点，以分支字节为下标直接存放
+    struct Node256 : Node{
+        Node256():Node(NODE256){
+            memset(this->children, 0, sizeof(this->children));
+        }
+        void* children[256];
     };
 
 public:
@@ -88,132 +130,213 @@ public:
      */
     bool get(const std::string& key, T& receiver);
 
+    /**
+     * @brief：删除 key 对应的数据. 删除后子节点过少的节点收缩为更小的节点类型，只剩一条路径的节点与子节点合并
+     * @param：key——键
+     * @return：true——数据存在并被删除 false——数据不存在
+     */
+    bool erase(const std::string& key);
+
+    /**
+     * @brief：最长前缀匹配. 在所有作为 key 前缀的已存储 key 中，查找最长的一个，适用于 URL、IP 前缀路由
+     * @param：key——待匹配的键
+     * @param：matched——接收命中的前缀
+     * @param：receiver——接收 value 的容器
+     * @return：true——存在前缀匹配 false——不存在
+     */
+    bool longestPrefix(const std::string& key, std::string& matched, T& receiver);
+
+    /**
+     * @brief：按照字典序遍历所有以 prefix 为前缀的 kv 对. 遍历过程中逐条回调，不会预先收集结果
+     * @param：prefix——前缀，为空时遍历全部数据
+     * @param：f——形如 bool(const std::string&, const T&) 的闭包函数. 返回 false 时终止遍历
+     */
+    template <class F>
+    void scanPrefix(const std::string& prefix, F f);
+
+    // 数据条数
+    size_t size() const;
+    // 树中所有节点占用的字节数
+    size_t memoryUsage() const;
+
 private:
+    // 子节点指针是否指向叶子节点
+    static bool isLeaf(const void* ptr);
+    // 由子节点指针得到叶子节点
+    static Leaf* asLeaf(void* ptr);
+    // 为叶子节点打上标记，得到子节点指针
+    static void* tagLeaf(Leaf* leaf);
+    // 两段字节序列的公共前缀长度
+    static uint32_t commonPrefix(const unsigned char* a, const uint32_t alen, const unsigned char* b, const uint32_t blen);
+
+    // 构造叶子节点
+    Leaf* newLeaf(const unsigned char* suffix, const uint32_t len, const T& value);
+    // 以 leaf 后缀中 from 之后的部分构造新的叶子节点，并回收原叶子节点
+    Leaf* trimLeaf(Leaf* leaf, const uint32_t from);
+    // 回收叶子节点
+    void freeLeaf(Leaf* leaf);
+    // 构造内部节点
+    template <class N>
+    N* newNode();
+    // 回收内部节点. 不回收其子节点
+    void freeNode(Node* node);
+    // 递归回收子树
+    void freeTree(void* ptr);
+    // 设置节点的压缩路径. prefix 可以指向节点自身原有的压缩路径
+    void setPrefix(Node* node, const unsigned char* prefix, const uint32_t len);
+
+    // 查找分支字节 b 对应的子节点，返回其在节点中的存放位置，不存在时返回 nullptr
+    static void** findChild(Node* node, const unsigned char b);
     /**
-    * 获取 key 对应的 radix node
-    */
-    typename Node::ptr get(const std::string& key);
+     * @brief：向节点中添加一个子节点，节点已满时先升级为更大的节点类型
+     * @param：ref——存放 node 的位置，节点升级后更新为新节点
+     */
+    void addChild(void** ref, Node* node, const unsigned char b, void* child);
+    // 将节点升级为更大的节点类型，返回新节点. 原节点被回收
+    Node* grow(Node* node);
+    // 从节点中移除分支字节 b 对应的子节点
+    static void removeChild(Node* node, const unsigned char b);
+    // 子节点数量过少时，将节点降级为更小的节点类型，返回新节点. 原节点被回收
+    Node* shrink(Node* node);
+    // 将压缩路径与 value 叶子从 from 转移到 to
+    static void moveHeader(Node* from, Node* to);
+
+    // 递归删除以 ref 处的节点为根、剩余 key 为 k[depth, len) 的数据
+    bool eraseAt(void** ref, const unsigned char* k, const uint32_t len, uint32_t depth);
+    /**
+     * @brief：删除数据后整理 ref 处的节点
+     * 1）子节点过少时降级为更小的节点类型
+     * 2）只剩 value 时替换为叶子节点
+     * 3）没有 value 且只剩一个子节点时，与子节点合并
+     */
+    void compact(void** ref);
+    /**
+     * @brief：以 节点压缩路径 + 分支字节 + 叶子后缀 构造新的叶子节点，并回收原叶子节点
+     * @param：b——分支字节，小于 0 时表示没有分支字节
+     */
+    Leaf* joinLeaf(Node* node, const int b, Leaf* leaf);
+    /**
+     * @brief：按照字典序遍历子树
+     * @param：buf——由根节点抵达 ptr 的路径，遍历过程中在其后追加、回退，返回时恢复原状
+     * @return：true——遍历完成 false——被 f 终止
+     */
+    template <class F>
+    bool walk(void* ptr, std::string& buf, F& f);
 
 private:
-    // 前缀树的根节点
-    typename Node::ptr m_root;
+    // 根节点. 为空树时为 nullptr，只有一条数据时直接指向叶子节点
+    void* m_root;
+    // 数据条数
+    size_t m_size;
+    // 节点占用的字节数
+    size_t m_bytes;
 };
 
 // 构造函数
 template <class T>
-RadixTree<T>::RadixTree(){
-    // 初始化 root 节点
-    this->m_root = std::make_shared<Node>(Node::STATIC);
+RadixTree<T>::RadixTree():m_root(nullptr),m_size(0),m_bytes(0){}
+
+// 析构函数
+template <class T>
+RadixTree<T>::~RadixTree(){
+    this->freeTree(this->m_root);
 }
 
 /**
  * @brief：将 key-value 对写入 radix tree
- * @param：key——键
- * @param：value——值
+ * 从根节点出发，沿着 key 逐层下探：
+ * 1）抵达空位置：直接放入以剩余 key 为后缀的叶子节点
+ * 2）抵达叶子节点：后缀与剩余 key 相同时更新 value；否则以二者的公共前缀构造一个 Node4 替换叶子，两者分别作为其分支
+ * 3）抵达内部节点：压缩路径与 key 不完全匹配时，在分歧处拆分出一个 Node4；
+ *    完全匹配时，key 恰好终止于此则写入节点的 value 叶子，否则按照下一个字节查找子节点，不存在时添加新的叶子节点
  */
 template <class T>
 void RadixTree<T>::put(const std::string& key, T value){
-    // 倘若 key 对应节点已存在，则直接更新 value 即可
-    typename Node::ptr target = this->get(key);
-    if (target != nullptr && target->nodeType == Node::PARAM){
-        target->value = value;
-        return;
-    }
-
-    // 需要处理的路径
-    std::string path = key;
-    // 沿着根节点开始处理. move 为检索过程中途径的节点
-    typename Node::ptr move = this->m_root;
-    // 途径节点 priority 递增
-    move->priority++;
-    // 若是插入到 radix tree 中的首个 kv 对，直接写入 root 节点即可
-    if (move->path.empty() && move->children.empty()){
-        // 直接插入根节点即可
-        move->insert(path,path,value);
-        return;
-    }
+    const unsigned char* k = reinterpret_cast<const unsigned char*>(key.data());
+    const uint32_t len = key.size();
+    void** ref = &this->m_root;
+    uint32_t depth = 0;
 
     while (true){
-        // 找到当前节点和 key 的共同前缀的长度
-        int longestPrefix = move->longestCommonPrefix(path);
-
-        // 如果公共前缀长度小于当前节点下相对路径的长度，则需要对当前节点进行拆分
-        if (longestPrefix < move->path.size()){
-            /**
-             * 构造一个新的子节点，承袭当前节点的信息
-             * 1）nodeType：节点类型
-             * 2）fullPath：完整路径
-             * 3）value：存储值
-             * 4）children：子节点列表
-             * 5）indices：子节点首字母索引
-             * 6）priority：优先级（途径的 key 数量）
-             * 7）path：节点相对路径
-             */
-            typename Node::ptr child = std::make_shared<Node>(move->nodeType);
-            child->fullPath = move->fullPath;
-            child->value = move->value;
-            child->indices = move->indices;
-            child->children = move->children;
-            // 由于途经 move 时已经先递增了 priority，所以此处需要进行扣减，因为 child 不被当前 key 途经
-            child->priority = move->priority - 1;
-            // 更新为除去公共前缀的后续部分
-            child->path.assign(move->path.begin()+longestPrefix,move->path.end());
-
-            /**
-             * 对当前节点的信息进行更新
-             */
-            // 节点类型更新为 STATIC，刚进行过切分，不可能存在 value 挂载在当前节点下
-            move->nodeType = Node::STATIC;
-            // 完整路径与相对路径都需要截止到公共前缀的位置
-            move->fullPath.assign(move->fullPath.begin(),move->fullPath.end()-(move->path.size() - longestPrefix));
-            move->path.assign(move->path.begin(),move->path.begin()+longestPrefix);
-            // 子节点列表与首字母索引更新
-            move->children = {child};
-            move->indices = {child->path[0]};
-            // 存储值清除
-            move->value = 0;
-        }
-
-        // 如果公共前缀长度小于 path 的长度，则对 path 进行拆分
-        if (longestPrefix < path.size()){
-            // 将 path 剔除公共前缀部分
-            path.assign(path.begin()+longestPrefix,path.end());
-            // 根据剔除公共前缀的后继部分首字母，进行检索
-            char c = path[0];
-            // 检索当前节点的子节点列表是否有首字母和 c 一致的子节点
-            bool findChild = false;
-            for (int i = 0; i < move->indices.size(); i++){
-                // 找到首字母与 c 一致的子节点
-                if (move->indices[i] == c){
-                    // 接下来需要移动到 index i 对应的子节点，需要递增其 priority，并且调整其在 children 中的位置
-                    int pos = move->incrementChildPrio(i);
-                    // 移动到子节点的位置，开始下一轮检索
-                    move = move->children[pos];
-                    findChild = true;
-                    break;
-                }
-            }
+        void* cur = *ref;
+        // 1）空位置
+        if (cur == nullptr){
+            *ref = RadixTree::tagLeaf(this->newLeaf(k + depth, len - depth, value));
+            this->m_size++;
+            return;
+        }
 
-            if (findChild){
-                continue;
+        // 2）叶子节点
+        if (RadixTree::isLeaf(cur)){
+            Leaf* leaf = RadixTree::asLeaf(cur);
+            uint32_t p = RadixTree::commonPrefix(leaf->suffix(), leaf->len, k + depth, len - depth);
+            if (p == leaf->len && p == len - depth){
+                leaf->value = value;
+                return;
             }
 
-            // 已经不存在与 path 有公共前缀的子节点了，则将 path 构造成子节点插入到 children 中
-            // 1）构造子节点
-            typename Node::ptr child = std::make_shared<Node>(Node::PARAM);
-            child->insert(path,key,value);
+            Node4* node = this->newNode<Node4>();
+            this->setPrefix(node, k + depth, p);
+            void* nodeRef = node;
+            // 原有叶子：后缀恰好是公共前缀时挂到 value 上，否则作为分支
+            if (p == leaf->len){
+                node->value = this->trimLeaf(leaf, p);
+            } else{
+                unsigned char b = leaf->suffix()[p];
+                this->addChild(&nodeRef, node, b, RadixTree::tagLeaf(this->trimLeaf(leaf, p + 1)));
+            }
+            // 新数据
+            if (p == len - depth){
+                node->value = this->newLeaf(nullptr, 0, value);
+            } else{
+                this->addChild(&nodeRef, node, k[depth + p], RadixTree::tagLeaf(this->newLeaf(k + depth + p + 1, len - depth - p - 1, value)));
+            }
+            *ref = nodeRef;
+            this->m_size++;
+            return;
+        }
 
-            // 2）插入子节点列表
-            move->indices += c;
-            move->addChild(child);
+        // 3）内部节点
+        Node* node = static_cast<Node*>(cur);
+        uint32_t p = RadixTree::commonPrefix(node->prefix(), node->prefixLen, k + depth, len - depth);
+        if (p < node->prefixLen){
+            // 在分歧处拆分：新节点承接公共前缀，原节点保留分歧字节之后的部分
+            Node4* parent = this->newNode<Node4>();
+            this->setPrefix(parent, node->prefix(), p);
+            unsigned char b = node->prefix()[p];
+            this->setPrefix(node, node->prefix() + p + 1, node->prefixLen - p - 1);
+            void* parentRef = parent;
+            this->addChild(&parentRef, parent, b, node);
+            if (depth + p == len){
+                parent->value = this->newLeaf(nullptr, 0, value);
+            } else{
+                this->addChild(&parentRef, parent, k[depth + p], RadixTree::tagLeaf(this->newLeaf(k + depth + p + 1, len - depth - p - 1, value)));
+            }
+            *ref = parentRef;
+            this->m_size++;
+            return;
+        }
 
-            // 3）递增子节点的 priority
-            move->incrementChildPrio(move->indices.size()-1);
+        depth += node->prefixLen;
+        if (depth == len){
+            if (node->value){
+                node->value->value = value;
+            } else{
+                node->value = this->newLeaf(nullptr, 0, value);
+                this->m_size++;
+            }
             return;
         }
 
-        // 当前节点相对路径恰好和 path 相等，则直接插入当前节点
-        move->insert(path,key,value);
+        void** child = RadixTree::findChild(node, k[depth]);
+        if (child){
+            ref = child;
+            depth++;
+            continue;
+        }
+
+        this->addChild(ref, node, k[depth], RadixTree::tagLeaf(this->newLeaf(k + depth + 1, len - depth - 1, value)));
+        this->m_size++;
         return;
     }
 }
@@ -226,109 +349,709 @@ void RadixTree<T>::put(const std::string& key, T value){
  */
 template <class T>
 bool RadixTree<T>::get(const std::string& key, T& receiver){
-    typename Node::ptr target = this->get(key);
-    if (target == nullptr || target->nodeType != Node::PARAM){
-        return false;
+    const unsigned char* k = reinterpret_cast<const unsigned char*>(key.data());
+    const uint32_t len = key.size();
+    void* cur = this->m_root;
+    uint32_t depth = 0;
+
+    while (cur){
+        // 叶子节点：剩余 key 与后缀完全相同时命中
+        if (RadixTree::isLeaf(cur)){
+            Leaf* leaf = RadixTree::asLeaf(cur);
+            if (leaf->len != len - depth || memcmp(leaf->suffix(), k + depth, leaf->len) != 0){
+                return false;
+            }
+            receiver = leaf->value;
+            return true;
+        }
+
+        // 内部节点：压缩路径必须完全匹配
+        Node* node = static_cast<Node*>(cur);
+        if (node->prefixLen > len - depth || memcmp(node->prefix(), k + depth, node->prefixLen) != 0){
+            return false;
+        }
+        depth += node->prefixLen;
+        if (depth == len){
+            if (!node->value){
+                return false;
+            }
+            receiver = node->value->value;
+            return true;
+        }
+
+        void** child = RadixTree::findChild(node, k[depth]);
+        if (!child){
+            return false;
+        }
+        cur = *child;
+        depth++;
     }
+    return false;
+}
 
-    receiver = target->value;
+/**
+ * @brief：删除 key 对应的数据
+ * @param：key——键
+ * @return：true——数据存在并被删除 false——数据不存在
+ */
+template <class T>
+bool RadixTree<T>::erase(const std::string& key){
+    if (!this->eraseAt(&this->m_root, reinterpret_cast<const unsigned char*>(key.data()), key.size(), 0)){
+        return false;
+    }
+    this->m_size--;
     return true;
 }
 
 /**
- * 获取 key 对应的 radix node
+ * @brief：最长前缀匹配
+ * 沿着 key 下探，途经每个带有 value 的内部节点时记录一次命中，抵达叶子节点时，其后缀是剩余 key 的前缀则为最终结果
  */
 template <class T>
-typename RadixTree<T>::Node::ptr RadixTree<T>::get(const std::string& key){
-    std::string path = key;
-    typename Node::ptr move = this->m_root;
-    while (true){
-        // 找到 path 和当前节点相对路径的公共前缀长度
-        int longestPrefix = move->longestCommonPrefix(path);
-        // 如果公共前缀小于当前节点相对路径的长度，则说明目标节点不存在
-        if (longestPrefix < move->path.size()){
-            return nullptr;
+bool RadixTree<T>::longestPrefix(const std::string& key, std::string& matched, T& receiver){
+    const unsigned char* k = reinterpret_cast<const unsigned char*>(key.data());
+    const uint32_t len = key.size();
+    void* cur = this->m_root;
+    uint32_t depth = 0;
+    Leaf* best = nullptr;
+    uint32_t bestLen = 0;
+
+    while (cur){
+        if (RadixTree::isLeaf(cur)){
+            Leaf* leaf = RadixTree::asLeaf(cur);
+            if (leaf->len <= len - depth && memcmp(leaf->suffix(), k + depth, leaf->len) == 0){
+                best = leaf;
+                bestLen = depth + leaf->len;
+            }
+            break;
         }
 
-        // 当前节点的相对路径和 path 完全相等，返回当前节点
-        if (longestPrefix == path.size()){
-            return move;
+        Node* node = static_cast<Node*>(cur);
+        if (node->prefixLen > len - depth || memcmp(node->prefix(), k + depth, node->prefixLen) != 0){
+            break;
+        }
+        depth += node->prefixLen;
+        if (node->value){
+            best = node->value;
+            bestLen = depth;
+        }
+        if (depth == len){
+            break;
         }
 
-        // 剔除公共前缀部分，剩余部分继续检索处理
-        path.assign(path.begin()+longestPrefix,path.end());
-        char c = path[0];
-        bool findChild = false;
-        for (int i = 0; i < move->indices.size(); i++){
-            if (move->indices[i] == c){
-                move = move->children[i];
-                findChild = true;
-                break;
+        void** child = RadixTree::findChild(node, k[depth]);
+        if (!child){
+            break;
+        }
+        cur = *child;
+        depth++;
+    }
+
+    if (!best){
+        return false;
+    }
+    matched.assign(key, 0, bestLen);
+    receiver = best->value;
+    return true;
+}
+
+/**
+ * @brief：按照字典序遍历所有以 prefix 为前缀的 kv 对
+ * 1）沿着 prefix 下探，直到 prefix 耗尽于某个节点的压缩路径之内或恰好抵达某个节点
+ * 2）以该节点为根的子树中的所有 key 均以 prefix 为前缀，对其执行有序遍历
+ */
+template <class T>
+template <class F>
+void RadixTree<T>::scanPrefix(const std::string& prefix, F f){
+    const unsigned char* k = reinterpret_cast<const unsigned char*>(prefix.data());
+    const uint32_t len = prefix.size();
+    void* cur = this->m_root;
+    uint32_t depth = 0;
+
+    while (cur){
+        const uint32_t rest = len - depth;
+        if (RadixTree::isLeaf(cur)){
+            Leaf* leaf = RadixTree::asLeaf(cur);
+            if (leaf->len >= rest && memcmp(leaf->suffix(), k + depth, rest) == 0){
+                std::string buf(prefix, 0, depth);
+                this->walk(cur, buf, f);
             }
+            return;
         }
 
-        if (!findChild){
+        Node* node = static_cast<Node*>(cur);
+        if (memcmp(node->prefix(), k + depth, rest < node->prefixLen ? rest : node->prefixLen) != 0){
+            return;
+        }
+        if (rest <= node->prefixLen){
+            std::string buf(prefix, 0, depth);
+            this->walk(cur, buf, f);
+            return;
+        }
+
+        depth += node->prefixLen;
+        void** child = RadixTree::findChild(node, k[depth]);
+        if (!child){
+            return;
+        }
+        cur = *child;
+        depth++;
+    }
+}
+
+template <class T>
+size_t RadixTree<T>::size() const{
+    return this->m_size;
+}
+
+template <class T>
+size_t RadixTree<T>::memoryUsage() const{
+    return this->m_bytes;
+}
+
+template <class T>
+bool RadixTree<T>::isLeaf(const void* ptr){
+    return reinterpret_cast<uintptr_t>(ptr) & 1;
+}
+
+template <class T>
+typename RadixTree<T>::Leaf* RadixTree<T>::asLeaf(void* ptr){
+    return reinterpret_cast<Leaf*>(reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t)1);
+}
+
+template <class T>
+void* RadixTree<T>::tagLeaf(Leaf* leaf){
+    return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(leaf) | 1);
+}
+
+template <class T>
+uint32_t RadixTree<T>::commonPrefix(const unsigned char* a, const uint32_t alen, const unsigned char* b, const uint32_t blen){
+    uint32_t end = alen < blen ? alen : blen;
+    uint32_t i = 0;
+    while (i < end && a[i] == b[i]){
+        i++;
+    }
+    return i;
+}
+
+template <class T>
+typename RadixTree<T>::Leaf* RadixTree<T>::newLeaf(const unsigned char* suffix, const uint32_t len, const T& value){
+    void* mem = ::operator new(sizeof(Leaf) + len);
+    Leaf* leaf = new (mem) Leaf(value, len);
+    if (len){
+        memcpy(leaf->suffix(), suffix, len);
+    }
+    this->m_bytes += sizeof(Leaf) + len;
+    return leaf;
+}
+
+template <class T>
+typename RadixTree<T>::Leaf* RadixTree<T>::trimLeaf(Leaf* leaf, const uint32_t from){
+    Leaf* trimmed = this->newLeaf(leaf->suffix() + from, leaf->len - from, leaf->value);
+    this->freeLeaf(leaf);
+    return trimmed;
+}
+
+template <class T>
+void RadixTree<T>::freeLeaf(Leaf* leaf){
+    this->m_bytes -= sizeof(Leaf) + leaf->len;
+    leaf->~Leaf();
+    ::operator delete(leaf);
+}
+
+template <class T>
+template <class N>
+N* RadixTree<T>::newNode(){
+    this->m_bytes += sizeof(N);
+    return new N;
+}
+
+template <class T>
+void RadixTree<T>::freeNode(Node* node){
+    if (node->prefixLen > INLINE_PREFIX){
+        this->m_bytes -= node->prefixLen;
+        delete[] node->heapPrefix;
+    }
+    switch (node->type){
+        case NODE4:
+            this->m_bytes -= sizeof(Node4);
+            delete static_cast<Node4*>(node);
+            break;
+        case NODE16:
+            this->m_bytes -= sizeof(Node16);
+            delete static_cast<Node16*>(node);
+            break;
+        case NODE48:
+            this->m_bytes -= sizeof(Node48);
+            delete static_cast<Node48*>(node);
+            break;
+        case NODE256:
+            this->m_bytes -= sizeof(Node256);
+            delete static_cast<Node256*>(node);
+            break;
+    }
+}
+
+template <class T>
+void RadixTree<T>::freeTree(void* ptr){
+    if (ptr == nullptr){
+        return;
+    }
+    if (RadixTree::isLeaf(ptr)){
+        this->freeLeaf(RadixTree::asLeaf(ptr));
+        return;
+    }
+
+    Node* node = static_cast<Node*>(ptr);
+    switch (node->type){
+        case NODE4:
+            for (int i = 0; i < node->count; i++){
+                this->freeTree(static_cast<Node4*>(node)->children[i]);
+            }
+            break;
+        case NODE16:
+            for (int i = 0; i < node->count; i++){
+                this->freeTree(static_cast<Node16*>(node)->children[i]);
+            }
+            break;
+        case NODE48:
+            for (int i = 0; i < 48; i++){
+                this->freeTree(static_cast<Node48*>(node)->children[i]);
+            }
+            break;
+        case NODE256:
+            for (int i = 0; i < 256; i++){
+                this->freeTree(static_cast<Node256*>(node)->children[i]);
+            }
+            break;
+    }
+    if (node->value){
+        this->freeLeaf(node->value);
+    }
+    this->freeNode(node);
+}
+
+/**
+ * @brief：设置节点的压缩路径
+ * prefix 可能指向节点自身原有的压缩路径（拆分节点时截取后半段），因此先完成拷贝，再回收原有的堆上空间
+ */
+template <class T>
+void RadixTree<T>::setPrefix(Node* node, const unsigned char* prefix, const uint32_t len){
+    unsigned char* oldHeap = node->prefixLen > INLINE_PREFIX ? node->heapPrefix : nullptr;
+    if (len > INLINE_PREFIX){
+        unsigned char* heap = new unsigned char[len];
+        memcpy(heap, prefix, len);
+        node->heapPrefix = heap;
+        this->m_bytes += len;
+    } else{
+        unsigned char buf[INLINE_PREFIX];
+        memcpy(buf, prefix, len);
+        memcpy(node->inlinePrefix, buf, len);
+    }
+    if (oldHeap){
+        this->m_bytes -= node->prefixLen;
+        delete[] oldHeap;
+    }
+    node->prefixLen = len;
+}
+
+template <class T>
+void** RadixTree<T>::findChild(Node* node, const unsigned char b){
+    switch (node->type){
+        case NODE4:{
+            Node4* n = static_cast<Node4*>(node);
+            for (int i = 0; i < n->count; i++){
+                if (n->keys[i] == b){
+                    return &n->children[i];
+                }
+            }
             return nullptr;
         }
-    }   
+        case NODE16:{
+            Node16* n = static_cast<Node16*>(node);
+#ifdef __SSE2__
+            // 一次比较全部 16 个分支字节，只保留有效的前 count 位
+            __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)b), _mm_loadu_si128(reinterpret_cast<const __m128i*>(n->keys)));
+            int mask = _mm_movemask_epi8(cmp) & ((1 << n->count) - 1);
+            if (mask){
+                return &n->children[__builtin_ctz(mask)];
+            }
+#else
+            for (int i = 0; i < n->count; i++){
+                if (n->keys[i] == b){
+                    return &n->children[i];
+                }
+            }
+#endif
+            return nullptr;
+        }
+        case NODE48:{
+            Node48* n = static_cast<Node48*>(node);
+            return n->index[b] ? &n->children[n->index[b] - 1] : nullptr;
+        }
+        case NODE256:{
+            Node256* n = static_cast<Node256*>(node);
+            return n->children[b] ? &n->children[b] : nullptr;
+        }
+    }
+    return nullptr;
 }
 
-// 构造函数
+/**
+ * @brief：向节点中添加一个子节点
+ * Node4/Node16 中的分支字节保持有序，以便按照字典序遍历
+ */
 template <class T>
-RadixTree<T>::Node::Node(Type typ):nodeType(typ),path(""),fullPath(""),value(0){}
+void RadixTree<T>::addChild(void** ref, Node* node, const unsigned char b, void* child){
+    if ((node->type == NODE4 && node->count == 4) || (node->type == NODE16 && node->count == 16) || (node->type == NODE48 && node->count == 48)){
+        node = this->grow(node);
+        *ref = node;
+    }
+
+    switch (node->type){
+        case NODE4:
+        case NODE16:{
+            unsigned char* keys = node->type == NODE4 ? static_cast<Node4*>(node)->keys : static_cast<Node16*>(node)->keys;
+            void** children = node->type == NODE4 ? static_cast<Node4*>(node)->children : static_cast<Node16*>(node)->children;
+            int pos = 0;
+            while (pos < node->count && keys[pos] < b){
+                pos++;
+            }
+            memmove(keys + pos + 1, keys + pos, node->count - pos);
+            memmove(children + pos + 1, children + pos, (node->count - pos) * sizeof(void*));
+            keys[pos] = b;
+            children[pos] = child;
+            break;
+        }
+        case NODE48:{
+            Node48* n = static_cast<Node48*>(node);
+            int pos = 0;
+            while (n->children[pos]){
+                pos++;
+            }
+            n->children[pos] = child;
+            n->index[b] = pos + 1;
+            break;
+        }
+        case NODE256:
+            static_cast<Node256*>(node)->children[b] = child;
+            break;
+    }
+    node->count++;
+}
 
 /**
- * @brief 向节点中插入 value 值，该方法会将节点类型更新为 PARAM
- * @param：path——节点相对路径
- * @param：fullPath——节点完整路径
- * @param：value——存储值
+ * @brief：将节点升级为更大的节点类型
+ * 压缩路径（包括堆上空间的所有权）与 value 叶子原样转移到新节点
  */
 template <class T>
-void RadixTree<T>::Node::insert(const std::string& path, const std::string& fullPath, T value){
-    this->path = path;
-    this->fullPath = fullPath;
-    this->value = value;
-    this->nodeType = Node::PARAM;
+typename RadixTree<T>::Node* RadixTree<T>::grow(Node* node){
+    Node* bigger = nullptr;
+    switch (node->type){
+        case NODE4:{
+            Node4* n = static_cast<Node4*>(node);
+            Node16* m = this->newNode<Node16>();
+            memcpy(m->keys, n->keys, n->count);
+            memcpy(m->children, n->children, n->count * sizeof(void*));
+            bigger = m;
+            break;
+        }
+        case NODE16:{
+            Node16* n = static_cast<Node16*>(node);
+            Node48* m = this->newNode<Node48>();
+            for (int i = 0; i < n->count; i++){
+                m->children[i] = n->children[i];
+                m->index[n->keys[i]] = i + 1;
+            }
+            bigger = m;
+            break;
+        }
+        case NODE48:{
+            Node48* n = static_cast<Node48*>(node);
+            Node256* m = this->newNode<Node256>();
+            for (int b = 0; b < 256; b++){
+                if (n->index[b]){
+                    m->children[b] = n->children[n->index[b] - 1];
+                }
+            }
+            bigger = m;
+            break;
+        }
+        default:
+            return node;
+    }
+
+    bigger->count = node->count;
+    RadixTree::moveHeader(node, bigger);
+    this->freeNode(node);
+    return bigger;
 }
 
-/** 
- * 获取 path 和当前节点相对路径—— node.path 的公共前缀的长度
-*/
 template <class T>
-int RadixTree<T>::Node::longestCommonPrefix(const std::string& path) const{
-    int i = 0;
-    int end = std::min(this->path.size(), path.size());
-    while (i < end && path[i] == this->path[i]){
-        i++;
+void RadixTree<T>::removeChild(Node* node, const unsigned char b){
+    switch (node->type){
+        case NODE4:
+        case NODE16:{
+            unsigned char* keys = node->type == NODE4 ? static_cast<Node4*>(node)->keys : static_cast<Node16*>(node)->keys;
+            void** children = node->type == NODE4 ? static_cast<Node4*>(node)->children : static_cast<Node16*>(node)->children;
+            int pos = 0;
+            while (keys[pos] != b){
+                pos++;
+            }
+            memmove(keys + pos, keys + pos + 1, node->count - pos - 1);
+            memmove(children + pos, children + pos + 1, (node->count - pos - 1) * sizeof(void*));
+            break;
+        }
+        case NODE48:{
+            Node48* n = static_cast<Node48*>(node);
+            n->children[n->index[b] - 1] = nullptr;
+            n->index[b] = 0;
+            break;
+        }
+        case NODE256:
+            static_cast<Node256*>(node)->children[b] = nullptr;
+            break;
     }
-    return i;
+    node->count--;
+}
+
+/**
+ * @brief：将节点降级为更小的节点类型
+ * 降级阈值低于对应的升级阈值，避免在边界附近反复插入、删除时频繁地升降级
+ */
+template <class T>
+typename RadixTree<T>::Node* RadixTree<T>::shrink(Node* node){
+    Node* smaller = nullptr;
+    switch (node->type){
+        case NODE16:{
+            if (node->count > 3){
+                return node;
+            }
+            Node16* n = static_cast<Node16*>(node);
+            Node4* m = this->newNode<Node4>();
+            memcpy(m->keys, n->keys, n->count);
+            memcpy(m->children, n->children, n->count * sizeof(void*));
+            smaller = m;
+            break;
+        }
+        case NODE48:{
+            if (node->count > 12){
+                return node;
+            }
+            Node48* n = static_cast<Node48*>(node);
+            Node16* m = this->newNode<Node16>();
+            int pos = 0;
+            for (int b = 0; b < 256; b++){
+                if (n->index[b]){
+                    m->keys[pos] = b;
+                    m->children[pos++] = n->children[n->index[b] - 1];
+                }
+            }
+            smaller = m;
+            break;
+        }
+        case NODE256:{
+            if (node->count > 37){
+                return node;
+            }
+            Node256* n = static_cast<Node256*>(node);
+            Node48* m = this->newNode<Node48>();
+            int pos = 0;
+            for (int b = 0; b < 256; b++){
+                if (n->children[b]){
+                    m->children[pos] = n->children[b];
+                    m->index[b] = ++pos;
+                }
+            }
+            smaller = m;
+            break;
+        }
+        default:
+            return node;
+    }
+
+    smaller->count = node->count;
+    RadixTree::moveHeader(node, smaller);
+    this->freeNode(node);
+    return smaller;
+}
+
+template <class T>
+void RadixTree<T>::moveHeader(Node* from, Node* to){
+    to->prefixLen = from->prefixLen;
+    memcpy(to->inlinePrefix, from->inlinePrefix, sizeof(from->inlinePrefix));
+    to->value = from->value;
+    // 堆上的压缩路径已转移给新节点，回收原节点时不能释放
+    from->prefixLen = 0;
+    from->value = nullptr;
+}
+
+/**
+ * @brief：递归删除数据
+ * 1）抵达叶子节点：后缀与剩余 key 相同时回收叶子，并将所在位置置空
+ * 2）抵达内部节点：key 恰好终止于此时回收 value 叶子，否则递归进入对应的子节点；子节点为被删除的叶子时将其移除
+ * 3）删除成功后整理当前节点
+ */
+template <class T>
+bool RadixTree<T>::eraseAt(void** ref, const unsigned char* k, const uint32_t len, uint32_t depth){
+    void* cur = *ref;
+    if (cur == nullptr){
+        return false;
+    }
+
+    // 1）叶子节点
+    if (RadixTree::isLeaf(cur)){
+        Leaf* leaf = RadixTree::asLeaf(cur);
+        if (leaf->len != len - depth || memcmp(leaf->suffix(), k + depth, leaf->len) != 0){
+            return false;
+        }
+        this->freeLeaf(leaf);
+        *ref = nullptr;
+        return true;
+    }
+
+    // 2）内部节点
+    Node* node = static_cast<Node*>(cur);
+    if (node->prefixLen > len - depth || memcmp(node->prefix(), k + depth, node->prefixLen) != 0){
+        return false;
+    }
+    depth += node->prefixLen;
+    if (depth == len){
+        if (!node->value){
+            return false;
+        }
+        this->freeLeaf(node->value);
+        node->value = nullptr;
+    } else{
+        void** child = RadixTree::findChild(node, k[depth]);
+        if (!child || !this->eraseAt(child, k, len, depth + 1)){
+            return false;
+        }
+        if (*child == nullptr){
+            RadixTree::removeChild(node, k[depth]);
+        }
+    }
+
+    // 3）整理当前节点
+    this->compact(ref);
+    return true;
 }
 
 /**
- * 1）增加 children[pos] 子节点的 priority
- * 2）调整 children 中子节点的顺序，保证按照 priority 从高到底进行排序
- * 3）若 children 顺序发生了变化，则对 indices 执行相应的调整
- * 4）返回 children[pos] 在调整顺序后新的 index
+ * @brief：删除数据后整理节点
+ * 内部节点至少有一个子节点，只剩一个子节点时必然已降级为 Node4
  */
 template <class T>
-int RadixTree<T>::Node::incrementChildPrio(const int pos){
-    this->children[pos]->priority++;
-    // child[pos] 调整顺序后的新位置
-    int newPos = pos;
+void RadixTree<T>::compact(void** ref){
+    Node* node = this->shrink(static_cast<Node*>(*ref));
+    *ref = node;
 
-    // 保证 children 按照 priority 由高到低的顺序进行排列
-    while (newPos > 0 && this->children[newPos-1]->priority < this->children[newPos]->priority){
-        std::swap(this->children[newPos-1],this->children[newPos]);
-        std::swap(this->indices[newPos-1],this->indices[newPos]);
-        newPos--;
+    // 只剩 value，以 压缩路径 + value 作为叶子节点
+    if (node->count == 0){
+        *ref = RadixTree::tagLeaf(this->joinLeaf(node, -1, node->value));
+        node->value = nullptr;
+        this->freeNode(node);
+        return;
     }
 
-    return newPos;
+    if (node->count > 1 || node->value){
+        return;
+    }
+
+    // 只剩一个子节点，将 压缩路径 + 分支字节 拼接到子节点之前
+    Node4* n = static_cast<Node4*>(node);
+    unsigned char b = n->keys[0];
+    void* child = n->children[0];
+    if (RadixTree::isLeaf(child)){
+        *ref = RadixTree::tagLeaf(this->joinLeaf(node, b, RadixTree::asLeaf(child)));
+    } else{
+        Node* c = static_cast<Node*>(child);
+        std::string prefix(reinterpret_cast<const char*>(node->prefix()), node->prefixLen);
+        prefix.push_back(b);
+        prefix.append(reinterpret_cast<const char*>(c->prefix()), c->prefixLen);
+        this->setPrefix(c, reinterpret_cast<const unsigned char*>(prefix.data()), prefix.size());
+        *ref = c;
+    }
+    this->freeNode(node);
+}
+
+template <class T>
+typename RadixTree<T>::Leaf* RadixTree<T>::joinLeaf(Node* node, const int b, Leaf* leaf){
+    const uint32_t head = node->prefixLen + (b >= 0 ? 1 : 0);
+    void* mem = ::operator new(sizeof(Leaf) + head + leaf->len);
+    Leaf* joined = new (mem) Leaf(leaf->value, head + leaf->len);
+    memcpy(joined->suffix(), node->prefix(), node->prefixLen);
+    if (b >= 0){
+        joined->suffix()[node->prefixLen] = b;
+    }
+    memcpy(joined->suffix() + head, leaf->suffix(), leaf->len);
+    this->m_bytes += sizeof(Leaf) + joined->len;
+    this->freeLeaf(leaf);
+    return joined;
 }
 
-// 追加一个新的子节点
+/**
+ * @brief：按照字典序遍历子树
+ * 内部节点先回调自身的 value，再依次按照分支字节从小到大遍历子节点
+ */
 template <class T>
-void RadixTree<T>::Node::addChild(Node::ptr child){
-    this->children.push_back(child);
+template <class F>
+bool RadixTree<T>::walk(void* ptr, std::string& buf, F& f){
+    const size_t base = buf.size();
+    if (RadixTree::isLeaf(ptr)){
+        Leaf* leaf = RadixTree::asLeaf(ptr);
+        buf.append(reinterpret_cast<const char*>(leaf->suffix()), leaf->len);
+        bool ok = f(static_cast<const std::string&>(buf), static_cast<const T&>(leaf->value));
+        buf.resize(base);
+        return ok;
+    }
+
+    Node* node = static_cast<Node*>(ptr);
+    buf.append(reinterpret_cast<const char*>(node->prefix()), node->prefixLen);
+    const size_t path = buf.size();
+    bool ok = true;
+    if (node->value){
+        ok = f(static_cast<const std::string&>(buf), static_cast<const T&>(node->value->value));
+    }
+
+    switch (node->type){
+        case NODE4:
+        case NODE16:{
+            unsigned char* keys = node->type == NODE4 ? static_cast<Node4*>(node)->keys : static_cast<Node16*>(node)->keys;
+            void** children = node->type == NODE4 ? static_cast<Node4*>(node)->children : static_cast<Node16*>(node)->children;
+            for (int i = 0; ok && i < node->count; i++){
+                buf.push_back(keys[i]);
+                ok = this->walk(children[i], buf, f);
+                buf.resize(path);
+            }
+            break;
+        }
+        case NODE48:{
+            Node48* n = static_cast<Node48*>(node);
+            for (int b = 0; ok && b < 256; b++){
+                if (n->index[b]){
+                    buf.push_back(b);
+                    ok = this->walk(n->children[n->index[b] - 1], buf, f);
+                    buf.resize(path);
+                }
+            }
+            break;
+        }
+        case NODE256:{
+            Node256* n = static_cast<Node256*>(node);
+            for (int b = 0; ok && b < 256; b++){
+                if (n->children[b]){
+                    buf.push_back(b);
+                    ok = this->walk(n->children[b], buf, f);
+                    buf.resize(path);
+                }
+            }
+            break;
+        }
+    }
+
+    buf.resize(base);
+    return ok;
 }
-}}
\ No newline at end of file
+
+}}
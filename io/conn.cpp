@@ -11,7 +11,7 @@
 namespace cbricks{namespace io{
 
 // 构造函数
-ConnFd::ConnFd(int fd):Fd(fd){}
+ConnFd::ConnFd(int fd):Fd(fd),m_writeBuf(memory::ArenaAllocator<char>(&m_arena)){}
 
 // 从 fd 中读取数据并写入到读缓冲区中. 一次性读取全量
 void ConnFd::readFd(){
@@ -61,6 +61,13 @@ void ConnFd::writeFd(){
      *  - @param: 3)iovec 结构体的数量
      */
     writev(this->m_fd,&iv,1);
+
+    /**
+     * 响应写出后回收写缓冲区与 arena. arena 只增不减，若不回收，长连接上的写缓冲区会随响应数量无限增长.
+     * 先换入一个空的写缓冲区，使其不再引用 arena 中的内存，再一次性回收 arena
+     */
+    memory::ArenaString(memory::ArenaAllocator<char>(&this->m_arena)).swap(this->m_writeBuf);
+    this->m_arena.reset();
 }
 
 // 获取读缓冲区中的数据，一次性读取全量
@@ -73,7 +80,12 @@ std::string& ConnFd::readFromBuf(){
 void ConnFd::writeToBuf(std::string& data){
     // 互斥锁
     lock::lockGuard guard(this->m_lock);
-    this->m_writeBuf = data;
+    this->m_writeBuf.assign(data.data(), data.size());
+}
+
+// 连接级别的内存分配区
+memory::Arena& ConnFd::arena(){
+    return this->m_arena;
 }
 
 }}
\ No newline at end of file
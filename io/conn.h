@@ -4,6 +4,7 @@
 #include <string>
 
 #include "../sync/lock.h"
+#include "../memory/arena.h"
 #include "fd.h"
 
 namespace cbricks{namespace io{
@@ -44,13 +45,21 @@ public:
     // 向写缓冲区中写入数据，为全量覆盖
     void writeToBuf(std::string& body);
 
+    /**
+     * @brief: 连接级别的内存分配区. 处理请求过程中产生的临时数据可以从中分配，在 writeFd 写出响应后一次性回收
+     * 非并发安全，只允许由当前处理该连接的线程使用. 从中分配的内存不得跨越 writeFd 使用
+     */
+    memory::Arena& arena();
+
 private:
     // 互斥锁 保证并发安全
     lock m_lock;
     // 读缓冲区
     std::string m_readBuf;
-    // 写缓冲区
-    std::string m_writeBuf;
+    // 连接级别的内存分配区，需要先于 m_writeBuf 构造、晚于 m_writeBuf 析构
+    memory::Arena m_arena;
+    // 写缓冲区. 从 m_arena 中分配，每次 writeFd 写出后与 m_arena 一并回收
+    memory::ArenaString m_writeBuf;
 };
 
 }}
\ No newline at end of file
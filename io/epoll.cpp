@@ -91,8 +91,10 @@ std::vector<EpollFd::Event::ptr> EpollFd::wait(const int timeoutMilis){
     CBRICKS_ASSERT(ret > 0, "epoll wait fail");
     
     events.reserve(ret);
+    // 事件与共享指针的控制块一同从 slab 中分配，每个就绪事件只需一次线程本地的链表操作
+    memory::SlabAllocator<Event> alloc;
     for (int i = 0; i < ret; i++){
-        events.emplace_back(new Event(rawEvents[i].data.fd,rawEvents[i].events));
+        events.push_back(std::allocate_shared<Event>(alloc, (int)rawEvents[i].data.fd, (uint32_t)rawEvents[i].events));
     }
 
     return events;
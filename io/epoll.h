@@ -4,6 +4,7 @@
 #include <vector>
 #include <sys/epoll.h>
 
+#include "../memory/slab.h"
 #include "fd.h"
 
 namespace cbricks{namespace io{
@@ -11,14 +11,22 @@ namespace cbricks{namespace log
 
 // 析构函数私有化 防止误删
 Logger::~Logger(){
-    // 主动关闭 buffer
-    this->m_buffer->close();
-
     // 未初始化过，直接退出
     if (!this->m_initialized.load()){
         return;
     }
 
+    /**
+     * 优雅关闭 buffer，保证异步线程将缓冲区中残留的日志落盘后再退出.
+     * 异步线程已退出时不存在 reader，直接关闭，避免空等 idleTimeout. 异步线程落盘一条日志的耗时远低于 100ms，
+     * 因此只需给出较短的 idleTimeout，超时仅发生在异步线程恰好在此期间退出的场景
+     */
+    if (this->m_readerAlive.load()){
+        this->m_buffer->drainAndClose(std::chrono::milliseconds(100));
+    }else{
+        this->m_buffer->close();
+    }
+
     // 初始化过，需要等待异步线程退出
     this->m_sem.wait();
 
@@ -84,7 +92,8 @@ void Logger::Init(const char* fileName, const int splitLines, int bufferSize, in
     // 初始化缓冲区 buffer
     instance.m_buffer.reset(new buffer(bufferSize));
 
-    // 启动异步线程
+    // 启动异步线程. 在线程启动前标记 reader 存活，异步线程退出时清除
+    instance.m_readerAlive.store(true);
     thread thr(Logger::asyncWriteLog);
     // 走到这里为止都没发生异常，将初始化标识置为 true
     instance.m_initialized.store(true);
@@ -150,10 +159,13 @@ void Logger::operator<<(std::string info){
 
 // 异步线程持续读取缓冲区 完成日志落盘操作
 void Logger::asyncWriteLog(){
+    Logger& instance = Logger::GetInstance();
     // 线程退出前 notify 信号量
-    defer d([](){Logger::GetInstance().m_sem.notify();});
+    defer d([&instance](){
+        instance.m_readerAlive.store(false);
+        instance.m_sem.notify();
+    });
 
-    Logger& instance = Logger::GetInstance();
     // 一行日志内容
     std::string logItem;
     // 从 buffer 中取出一条日志数据
@@ -92,6 +92,8 @@ private:
 
     // 信号量，用于在 logger 析构前等待异步线程完成退出
     semaphore m_sem;
+    // 异步线程是否仍在消费 buffer. 异步线程已退出时，析构流程无需等待残留日志被消费
+    std::atomic<bool> m_readerAlive{false};
 
 }; 
 }}
@@ -11,6 +11,10 @@
 #include <stdlib.h>
 #include <cstring>
 #include <memory>
+#include <queue>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
 
 
 #include "sync/lock.h"
@@ -18,17 +22,29 @@
 #include "sync/coroutine.h"
 #include "sync/queue.h"
 #include "sync/channel.h"
+#include "sync/unboundedchannel.h"
 #include "sync/sem.h"
 #include "sync/map.h"
+#include "sync/shardedmap.h"
+#include "sync/cache.h"
+#include "sync/timewheel.h"
+#include "sync/epoch.h"
+#include "sync/hazard.h"
 #include "pool/instancepool.h"
 #include "pool/workerpool.h"
+#include "pool/objectpool.h"
 #include "server/server.h"
 #include "base/sys.h"
 #include "base/defer.h"
 #include "trace/assert.h"
 #include "log/log.h"
 #include "memory/ptr.h"
+#include "memory/intrusive.h"
+#include "memory/atomicptr.h"
+#include "memory/arena.h"
+#include "memory/slab.h"
 #include "datastruct/radix.h"
+#include "datastruct/flatmap.h"
 // #include "mysql/conn.h"
 
 
@@ -135,6 +151,16 @@ void testLinkedList(){
     for (int i = 0; i < res.size(); i++){
         std::cout<< res[i] << std::endl;
     }
+
+    // 弹出的元素被移出节点，成为新哨兵的节点不再持有元素的引用
+    cbricks::sync::Queue<std::shared_ptr<int>> owners;
+    std::shared_ptr<int> resource(new int(1));
+    std::weak_ptr<int> observer = resource;
+    owners.push(std::move(resource));
+    std::shared_ptr<int> popped;
+    CBRICKS_ASSERT(owners.pop(popped) && popped.use_count() == 1,"popped element still referenced by queue");
+    popped.reset();
+    CBRICKS_ASSERT(observer.expired(),"queue kept a hidden owner of popped element");
 }
 
 void testChannel(){
@@ -192,6 +218,210 @@ void testChannel(){
 
 }
 
+void testQueueBenchmark(){
+    typedef cbricks::sync::Queue<int> lockFreeQueue;
+    typedef cbricks::sync::Thread thread;
+    typedef cbricks::sync::Lock lock;
+
+    // 并发度以及每个线程的操作次数
+    const int threads = 4;
+    const int ops = 1000000;
+
+    /**
+     * 基准组：互斥锁 + std::queue
+     * 对照组：基于 Michael-Scott 算法实现的无锁队列
+     * 无锁队列每次操作需要发布 hazard pointer 并分配元素，在争抢激烈、核数较少时吞吐量通常低于互斥锁队列
+     * （单核环境下实测 lock free 耗时约为 mutex 的 5 倍）. 它的价值在于锁持有者被抢占时不会阻塞其他线程，而非吞吐量
+     */
+    std::queue<int> mutexQueue;
+    lock mutex;
+    lockFreeQueue queue;
+
+    // 分别启动 threads 个生产者和 threads 个消费者，消费者持续弹出直到取满 ops 条数据
+    auto bench = [&](std::function<void(int)> push, std::function<bool(int&)> pop)->long long{
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<thread::ptr> workers;
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([&push](){
+                for (int j = 0; j < ops; j++){
+                    push(j);
+                }
+            })));
+            workers.push_back(thread::ptr(new thread([&pop](){
+                int v;
+                for (int j = 0; j < ops;){
+                    if (pop(v)){
+                        j++;
+                    }
+                }
+            })));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+
+    long long mutexCost = bench([&](int v){
+        lock::lockGuard guard(mutex);
+        mutexQueue.push(v);
+    },[&](int& v)->bool{
+        lock::lockGuard guard(mutex);
+        if (mutexQueue.empty()){
+            return false;
+        }
+        v = mutexQueue.front();
+        mutexQueue.pop();
+        return true;
+    });
+
+    long long lockFreeCost = bench([&](int v){
+        queue.push(v);
+    },[&](int& v)->bool{
+        return queue.pop(v);
+    });
+
+    std::cout << "mutex queue: " << mutexCost << "ms" << std::endl;
+    std::cout << "lock free queue: " << lockFreeCost << "ms" << std::endl;
+    CBRICKS_ASSERT(queue.empty(),"queue should be empty");
+}
+
+void testChannelDrain(){
+    typedef cbricks::sync::Channel<int> chan;
+    typedef cbricks::sync::Thread thread;
+
+    chan ch(100);
+    for (int i = 0; i < 100; i++){
+        ch.write(i);
+    }
+
+    // reader 持续消费，直到 channel 被关闭
+    std::atomic<int> cnt{0};
+    thread reader([&ch,&cnt](){
+        int v;
+        while (ch.read(v)){
+            cnt++;
+        }
+    });
+
+    // 优雅关闭：拒绝新的写入，等待 reader 消费完残留数据后关闭. 最后一个 reader 退出时立即唤醒，无需轮询等待
+    auto begin = std::chrono::steady_clock::now();
+    ch.drainAndClose();
+    reader.join();
+    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+
+    // 预期结果为 100
+    std::cout << "consumed: " << cnt << " , cost: " << cost.count() << "us" << std::endl;
+    CBRICKS_ASSERT(!ch.write(0),"write after close should fail");
+
+    // 批量 reader：readSome 不等待凑满一批，残留数据不足一批时返回剩余的部分
+    chan batched(8);
+    for (int i = 0; i < 3; i++){
+        batched.write(i);
+    }
+    std::atomic<int> batchedCnt{0};
+    thread batchedReader([&batched,&batchedCnt](){
+        std::vector<int> vs(2);
+        size_t n;
+        while ((n = batched.readSome(vs)) > 0){
+            batchedCnt += n;
+        }
+    });
+    batched.drainAndClose();
+    batchedReader.join();
+    // 预期结果为 3
+    std::cout << "batched consumed: " << batchedCnt << std::endl;
+    CBRICKS_ASSERT(batchedCnt == 3,"readSome should consume the partial tail");
+
+    // readN 只读取完整的一批：残留数据不足一批时返回 false，不会截断 receivers
+    chan fixed(8);
+    for (int i = 0; i < 3; i++){
+        fixed.write(i);
+    }
+    std::atomic<int> fixedCnt{0};
+    thread fixedReader([&fixed,&fixedCnt](){
+        std::vector<int> vs(2);
+        while (fixed.readN(vs)){
+            CBRICKS_ASSERT(vs.size() == 2,"readN should not shrink receivers");
+            fixedCnt += vs.size();
+        }
+    });
+    fixed.drainAndClose(std::chrono::milliseconds(100));
+    fixedReader.join();
+    // 预期结果为 2，剩余的 1 条在 idleTimeout 后随 close 丢弃
+    std::cout << "fixed batch consumed: " << fixedCnt << std::endl;
+    CBRICKS_ASSERT(fixedCnt == 2,"readN should only consume full batches");
+
+    typedef cbricks::sync::UnboundedChannel<int> unboundedChan;
+    unboundedChan unbounded(16);
+    for (int i = 0; i < 3; i++){
+        unbounded.write(i);
+    }
+    std::atomic<int> unboundedCnt{0};
+    thread unboundedReader([&unbounded,&unboundedCnt](){
+        std::vector<int> vs(2);
+        size_t n;
+        while ((n = unbounded.readSome(vs)) > 0){
+            unboundedCnt += n;
+        }
+    });
+    unbounded.drainAndClose();
+    unboundedReader.join();
+    // 预期结果为 3
+    std::cout << "unbounded batched consumed: " << unboundedCnt << std::endl;
+    CBRICKS_ASSERT(unboundedCnt == 3,"readSome should consume the partial tail");
+
+    // 不存在 reader：等待 idleTimeout 后放弃，残留数据被丢弃
+    chan orphan(8);
+    orphan.write(0);
+    begin = std::chrono::steady_clock::now();
+    orphan.drainAndClose(std::chrono::milliseconds(100));
+    cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+    std::cout << "orphan drain cost: " << cost.count() / 1000 << "ms" << std::endl;
+}
+
+void testUnboundedChannel(){
+    typedef cbricks::sync::UnboundedChannel<int> chan;
+    typedef cbricks::sync::Thread thread;
+
+    // segment 容量设置为 16，保证写入过程中会发生多次 segment 切换与复用
+    chan ch(16);
+
+    // 10 个 writer 各写入 1000 条数据，写入过程不会因容量不足而阻塞
+    std::vector<thread::ptr> writers;
+    for (int i = 0; i < 10; i++){
+        writers.push_back(thread::ptr(new thread([&ch,i](){
+            for (int j = 0; j < 1000; j++){
+                CBRICKS_ASSERT(ch.write(i * 1000 + j),"write unbounded channel fail");
+            }
+        })));
+    }
+
+    // 5 个 reader 各读取 2000 条数据
+    std::atomic<long long> sum{0};
+    std::vector<thread::ptr> readers;
+    for (int i = 0; i < 5; i++){
+        readers.push_back(thread::ptr(new thread([&ch,&sum](){
+            for (int j = 0; j < 2000; j++){
+                int v;
+                CBRICKS_ASSERT(ch.read(v),"read unbounded channel fail");
+                sum += v;
+            }
+        })));
+    }
+
+    for (int i = 0; i < writers.size(); i++){
+        writers[i]->join();
+    }
+    for (int i = 0; i < readers.size(); i++){
+        readers[i]->join();
+    }
+
+    // 预期结果为 0 + 1 + ... + 9999 = 49995000
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "size: " << ch.size() << " , high watermark: " << ch.highWatermark() << std::endl;
+}
+
 void testWorkerPool(){
     // 协程调度框架类型别名定义
     typedef cbricks::pool::WorkerPool workerPool;
@@ -451,6 +681,362 @@ void testInstancePool(){
     std::this_thread::sleep_for(std::chrono::seconds(2));
 }
 
+void testArena(){
+    typedef cbricks::memory::Arena arena;
+    typedef cbricks::memory::ArenaString arenaString;
+    typedef cbricks::memory::ArenaAllocator<char> charAllocator;
+
+    // 基础语义：stl 容器与字符串从 arena 中分配，reset 后内存被复用
+    arena a;
+    {
+        std::vector<int, cbricks::memory::ArenaAllocator<int>> nums{cbricks::memory::ArenaAllocator<int>(&a)};
+        for (int i = 0; i < 100; i++){
+            nums.push_back(i);
+        }
+        arenaString str("hello arena, this string is longer than sso capacity", charAllocator(&a));
+        std::cout << "nums: " << nums.size() << " , str: " << str << " , used: " << a.used() << " , reserved: " << a.reserved() << std::endl;
+    }
+    a.reset();
+    std::cout << "after reset used: " << a.used() << " , reserved: " << a.reserved() << std::endl;
+
+    // 模拟一笔请求中产生的字符串：std::string 逐个释放 vs 从 arena 中分配并一次性 reset
+    const int requests = 100000;
+    const int strs = 64;
+    std::string payload(180, 'x');
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; i++){
+        std::vector<std::string> garbage;
+        garbage.reserve(strs);
+        for (int j = 0; j < strs; j++){
+            garbage.push_back(payload.substr(0, 32 + j * 2));
+        }
+    }
+    long long heapCost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; i++){
+        {
+            std::vector<arenaString, cbricks::memory::ArenaAllocator<arenaString>> garbage{cbricks::memory::ArenaAllocator<arenaString>(&a)};
+            garbage.reserve(strs);
+            for (int j = 0; j < strs; j++){
+                garbage.push_back(arenaString(payload.data(), 32 + j * 2, charAllocator(&a)));
+            }
+        }
+        a.reset();
+    }
+    long long arenaCost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << "requests: " << requests << " , heap: " << heapCost << "ms , arena: " << arenaCost << "ms" << std::endl;
+}
+
+// 与 EpollFd::Event 大小相近的小对象，分别通过 malloc 与 slab 分配
+struct heapEvent{
+    uint32_t events;
+    int fd;
+    heapEvent(int fd, uint32_t events):events(events),fd(fd){}
+};
+
+struct slabEvent : public cbricks::memory::SlabObject{
+    uint32_t events;
+    int fd;
+    slabEvent(int fd, uint32_t events):events(events),fd(fd){}
+};
+
+void testSlab(){
+    typedef cbricks::memory::Slab slab;
+    typedef cbricks::sync::Thread thread;
+
+    const int ops = 1000000;
+    const int batch = 256;
+
+    // 各线程成批地创建、销毁小对象，对比 malloc 与 slab 的耗时
+    for (int threads = 1; threads <= 8; threads *= 2){
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<thread::ptr> workers;
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([ops,batch](){
+                std::vector<std::shared_ptr<heapEvent>> es;
+                es.reserve(batch);
+                for (int j = 0; j < ops; j += batch){
+                    for (int k = 0; k < batch; k++){
+                        es.push_back(std::make_shared<heapEvent>(k, j));
+                    }
+                    es.clear();
+                }
+            })));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        long long heapCost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        begin = std::chrono::steady_clock::now();
+        workers.clear();
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([ops,batch](){
+                std::vector<std::shared_ptr<slabEvent>> es;
+                es.reserve(batch);
+                cbricks::memory::SlabAllocator<slabEvent> alloc;
+                for (int j = 0; j < ops; j += batch){
+                    for (int k = 0; k < batch; k++){
+                        es.push_back(std::allocate_shared<slabEvent>(alloc, k, j));
+                    }
+                    es.clear();
+                }
+            })));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        long long slabCost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        std::cout << "threads: " << threads << " , malloc: " << heapCost << "ms , slab: " << slabCost << "ms" << std::endl;
+    }
+
+    // 持有一批对象时的统计数据
+    std::vector<slabEvent*> held;
+    for (int i = 0; i < 10000; i++){
+        held.push_back(new slabEvent(i, 0));
+    }
+    slab::Stats stats = slab::Statistics();
+    std::cout << "allocs: " << stats.allocs << " , frees: " << stats.frees << " , reserved: " << stats.reservedBytes
+        << " , in use: " << stats.inUseBytes << " , fragmentation: " << stats.fragmentation << std::endl;
+    for (int i = 0; i < held.size(); i++){
+        delete held[i];
+    }
+}
+
+void testInstancePoolEvict(){
+    typedef cbricks::pool::Instance instance;
+    typedef cbricks::pool::InstancePool instancePool;
+    typedef cbricks::sync::Thread thread;
+
+    cbricks::log::Logger::Init("output/cbricks.log",5000);
+    std::atomic<int> created{0};
+    // 过期时长设得很短，使 evict thread 在 get/put 进行期间频繁地翻转代际
+    instancePool pool([&created]()->instance::ptr{
+        created++;
+        return instance::ptr(new demo);
+    }, 0, std::chrono::milliseconds(2));
+
+    std::vector<thread::ptr> workers;
+    for (int i = 0; i < 8; i++){
+        workers.push_back(thread::ptr(new thread([&pool](){
+            for (int j = 0; j < 100000; j++){
+                instance::ptr got = pool.get();
+                pool.put(got);
+            }
+        })));
+    }
+    for (int i = 0; i < workers.size(); i++){
+        workers[i]->join();
+    }
+    std::cout << "created during churn: " << created.load() << std::endl;
+
+    // 闲置超过两个轮询间隔后，池中的 instance 均已被回收，再次获取时需要重新构造
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    int before = created.load();
+    pool.get();
+    std::cout << "reconstructed after idle: " << (created.load() > before) << std::endl;
+}
+
+void testInstancePoolAdaptive(){
+    typedef cbricks::pool::Instance instance;
+    typedef cbricks::pool::InstancePool instancePool;
+
+    cbricks::log::Logger::Init("output/cbricks.log",5000);
+    // 闲置数量上限为 64
+    instancePool pool([]()->instance::ptr{
+        return instance::ptr(new demo);
+    }, 0, std::chrono::milliseconds(100), 64);
+
+    auto print = [&pool](const char* stage){
+        instancePool::Stats stats = pool.stats();
+        std::cout << stage << " idle: " << stats.idle << " , target: " << stats.target << " , gets: " << stats.gets
+            << " , constructions: " << stats.constructions << " , trimmed: " << stats.trimmed
+            << " , hit rate: " << stats.hitRate << " , constructions/s: " << stats.constructionsPerSecond << std::endl;
+    };
+
+    // 突发流量：同时持有 1000 个实例后全部归还，超出上限的部分在 put 时直接丢弃
+    std::vector<instance::ptr> burst;
+    for (int i = 0; i < 1000; i++){
+        burst.push_back(pool.get());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (size_t i = 0; i < burst.size(); i++){
+        pool.put(burst[i]);
+    }
+    burst.clear();
+    print("after burst");
+    instancePool::Stats stats = pool.stats();
+    CBRICKS_ASSERT(stats.idle <= 64 + std::thread::hardware_concurrency(),"idle exceeds max idle");
+    CBRICKS_ASSERT(stats.target <= 64 + std::thread::hardware_concurrency(),"target exceeds max idle");
+
+    /**
+     * 平稳流量：每次同时持有 4 个实例，持续若干个轮询间隔
+     * 目标闲置数量收敛到同时在用的数量附近，而非 get 的频率；池中实例足够，构造速率降到 0 附近
+     */
+    auto begin = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(1500)){
+        for (int i = 0; i < 1000; i++){
+            instance::ptr held[4];
+            for (int j = 0; j < 4; j++){
+                held[j] = pool.get();
+            }
+            for (int j = 0; j < 4; j++){
+                pool.put(held[j]);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    print("steady");
+    stats = pool.stats();
+    CBRICKS_ASSERT(stats.target <= 8,"target should follow outstanding instances");
+    CBRICKS_ASSERT(stats.constructionsPerSecond < 100,"steady state should not construct instances");
+
+    // 闲置一段时间后，在用数量峰值的 EWMA 衰减为 0，闲置实例被全部回收
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    print("after idle");
+    stats = pool.stats();
+    CBRICKS_ASSERT(stats.target == 0 && stats.idle == 0,"idle instances should be evicted after load stops");
+}
+
+// 与 server::HttpConn 字段布局一致的连接对象，分别适配 InstancePool 与 ObjectPool
+struct connFields{
+    int method = 0;
+    std::string url;
+    std::string proto;
+    std::string body;
+    std::string status;
+    int statusCode = 0;
+    std::string respProto;
+    std::string respBody;
+
+    void wipe(){
+        this->method = 0;
+        this->url.clear();
+        this->proto.clear();
+        this->body.clear();
+        this->status.clear();
+        this->statusCode = 0;
+        this->respProto.clear();
+        this->respBody.clear();
+    }
+};
+
+class instanceConn : public cbricks::pool::Instance, public connFields{
+public:
+    void clear() override{
+        this->wipe();
+    }
+};
+
+struct pooledConn : public connFields{
+    void reset(){
+        this->wipe();
+    }
+};
+
+void testObjectPool(){
+    typedef cbricks::pool::Instance instance;
+    typedef cbricks::pool::InstancePool instancePool;
+    typedef cbricks::pool::ObjectPool<pooledConn> objectPool;
+    typedef cbricks::sync::Thread thread;
+
+    const int ops = 1000000;
+
+    // 基础语义：归还后的对象被复用，且已经过 reset
+    objectPool pool;
+    pooledConn* addr;
+    {
+        objectPool::Handle conn = pool.get();
+        conn->url = "/index";
+        addr = conn.get();
+        objectPool::Handle moved = std::move(conn);
+        std::cout << "moved: " << (!conn && moved) << std::endl;
+    }
+    {
+        objectPool::Handle conn = pool.get();
+        std::cout << "reused: " << (conn.get() == addr) << " , url after reset: \"" << conn->url << "\"" << std::endl;
+    }
+
+    instancePool instances([]()->instance::ptr{
+        return instance::ptr(new instanceConn);
+    });
+
+    // 各线程反复 get 并归还，对比 InstancePool 与 ObjectPool 的吞吐
+    for (int threads = 1; threads <= 16; threads *= 4){
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<thread::ptr> workers;
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([&instances,ops](){
+                for (int j = 0; j < ops; j++){
+                    instance::ptr conn = instances.get();
+                    instances.put(conn);
+                }
+            })));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        long long instanceCost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        begin = std::chrono::steady_clock::now();
+        workers.clear();
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([&pool,ops](){
+                for (int j = 0; j < ops; j++){
+                    objectPool::Handle conn = pool.get();
+                }
+            })));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        long long objectCost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        std::cout << "threads: " << threads << " , instance pool: " << instanceCost << "ms , object pool: " << objectCost << "ms" << std::endl;
+    }
+}
+
+void testInstancePoolBenchmark(){
+    typedef cbricks::pool::Instance instance;
+    typedef cbricks::pool::InstancePool instancePool;
+    typedef cbricks::sync::Thread thread;
+
+    const int ops = 200000;
+
+    cbricks::log::Logger::Init("output/cbricks.log",5000);
+    instancePool pool([]()->instance::ptr{
+        return instance::ptr(new demo);
+    });
+
+    /**
+     * 各线程反复成对地 get/put. level 由线程所在的 CPU 决定，热路径上不存在共享计数器
+     * 每轮持有两个实例，第二个实例的归还与获取经过 shared 链表头部，其他 level 无锁地从尾部窃取，高并发下也不会因锁竞争陷入内核态等待
+     */
+    for (int threads = 1; threads <= 32; threads *= 2){
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<thread::ptr> workers;
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([&pool,ops](){
+                for (int j = 0; j < ops; j++){
+                    instance::ptr first = pool.get();
+                    instance::ptr second = pool.get();
+                    pool.put(first);
+                    pool.put(second);
+                }
+            })));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        long long cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "threads: " << threads << " , cost: " << cost << "ms , throughput: " << (long long)threads * ops / (cost + 1) << " ops/ms" << std::endl;
+    }
+}
+
 void testSyncMap(){
     typedef cbricks::sync::Map<int,int> smap;
     typedef cbricks::sync::Semaphore semaphore;
@@ -503,6 +1089,696 @@ void testSyncMap(){
     std::cout << "=========end=========" << std::endl;
 }
 
+void testSyncMapAtomic(){
+    typedef cbricks::sync::Map<int,long> counterMap;
+    typedef cbricks::sync::Map<int,std::string> stringMap;
+    typedef cbricks::sync::Thread thread;
+
+    const int threads = 8;
+    const int keys = 64;
+    const int ops = 10000;
+
+    counterMap cm;
+    stringMap strm;
+    std::atomic<int> stored{0};
+    std::atomic<int> created{0};
+    std::atomic<int> deleted{0};
+
+    // 启动 threads 个线程并发执行 f，等待全部执行完成
+    auto parallel = [threads](std::function<void()> f){
+        std::vector<thread::ptr> workers;
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread(f)));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+    };
+
+    parallel([&](){
+        for (int key = 0; key < keys; key++){
+            // 同一个 key 上至多只有一次 loadOrStore 写入成功
+            long actual;
+            if (!cm.loadOrStore(key, 0, actual)){
+                stored++;
+            }
+
+            // 同一个 key 上 factory 至多执行一次
+            std::string str;
+            strm.computeIfAbsent(key, [&created,key]()->std::string{
+                created++;
+                return "value-" + std::to_string(key);
+            }, str);
+            CBRICKS_ASSERT(str == "value-" + std::to_string(key),"compute if absent got wrong value");
+        }
+    });
+
+    // 基于 compareAndSwap 实现无锁计数
+    parallel([&](){
+        for (int j = 0; j < ops; j++){
+            int key = j % keys;
+            long cur;
+            do{
+                cm.load(key, cur);
+            } while (!cm.compareAndSwap(key, cur, cur + 1));
+        }
+    });
+
+    // 每个 key 上的数据至多被一个线程删除成功
+    parallel([&](){
+        for (int key = 0; key < keys; key++){
+            std::string str;
+            if (strm.loadAndDelete(key, str)){
+                deleted++;
+            }
+        }
+    });
+
+    long total = 0;
+    cm.range([&total](const int& key, const long& value)->bool{
+        total += value;
+        return true;
+    });
+    CBRICKS_ASSERT(!cm.compareAndDelete(0, -1),"compare and delete with wrong value");
+    long v;
+    cm.load(0, v);
+    CBRICKS_ASSERT(cm.compareAndDelete(0, v) && !cm.load(0, v),"compare and delete failed");
+
+    // 预期结果：stored 64, created 64, deleted 64, total 80000
+    std::cout << "stored: " << stored.load() << " , created: " << created.load() << " , deleted: " << deleted.load() << " , total: " << total << std::endl;
+}
+
+void testSyncMapRangeSnapshot(){
+    typedef cbricks::sync::Map<int,long> smap;
+    typedef cbricks::pool::WorkerPool workerPool;
+
+    const int keys = 100000;
+    const int rounds = 50;
+
+    /**
+     * 模拟周期性的指标采集：每轮先全量遍历一次，再插入一个新 key
+     * range 每次都会将 dirty 提升为 readonly，随后的插入需要重新执行 O(N) 的 dirtyLocked 流程；rangeSnapshot 不会修改 dirty
+     */
+    auto scrape = [&](bool snapshot)->long long{
+        smap sm;
+        for (int i = 0; i < keys; i++){
+            sm.store(i,i);
+        }
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++){
+            long sum = 0;
+            auto f = [&sum](const int& key, const long& value)->bool{
+                sum += value;
+                return true;
+            };
+            if (snapshot){
+                sm.rangeSnapshot(f);
+            } else{
+                sm.range(f);
+            }
+            CBRICKS_ASSERT(sum == (long)(keys + r) * (keys + r - 1) / 2,"scrape got wrong sum");
+            sm.store(keys + r, keys + r);
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+    std::cout << "range + store: " << scrape(false) << "ms , rangeSnapshot + store: " << scrape(true) << "ms" << std::endl;
+
+    // 快照缓存：key 集合不变时复用快照，value 的更新在遍历时可见；新增、删除 key 后快照重新构建
+    smap cached;
+    cached.store(0,0);
+    cached.store(1,1);
+    auto total = [&cached]()->long{
+        long sum = 0;
+        cached.rangeSnapshot([&sum](const int& key, const long& value)->bool{
+            sum += value;
+            return true;
+        });
+        return sum;
+    };
+    CBRICKS_ASSERT(total() == 1,"snapshot got wrong sum");
+    cached.store(1,10);
+    CBRICKS_ASSERT(total() == 10,"cached snapshot missed value update");
+    cached.store(2,100);
+    CBRICKS_ASSERT(total() == 110,"cached snapshot missed new key");
+    cached.evict(0);
+    cached.evict(2);
+    CBRICKS_ASSERT(total() == 10,"cached snapshot kept evicted key");
+
+    // 并行遍历：求和结果与串行遍历一致；f 返回 false 后其余区间尽快终止
+    smap sm;
+    for (int i = 0; i < keys; i++){
+        sm.store(i,i);
+    }
+    // map 不依赖具体的执行器，通过闭包将区间任务提交到协程调度池
+    workerPool workers(4);
+    auto submit = [&workers](std::function<void()> task)->bool{
+        return workers.submit(task);
+    };
+    std::atomic<long> sum{0};
+    sm.parallelRange(submit, [&sum](const int& key, const long& value)->bool{
+        sum += value;
+        return true;
+    });
+    CBRICKS_ASSERT(sum.load() == (long)keys * (keys - 1) / 2,"parallel range got wrong sum");
+
+    std::atomic<int> visited{0};
+    sm.parallelRange(submit, [&visited](const int& key, const long& value)->bool{
+        return ++visited < 100;
+    }, 16);
+
+    // 预期结果：sum 4999950000，visited 远小于 100000
+    std::cout << "parallel sum: " << sum.load() << " , visited before stop: " << visited.load() << std::endl;
+}
+
+void testSyncMapTtl(){
+    typedef cbricks::sync::Map<std::string,int> sessionMap;
+    typedef cbricks::sync::TimeWheel timeWheel;
+
+    // 时间轮：任务不早于指定时间执行，且至多延后若干个 tick；取消的任务不会执行
+    timeWheel wheel(timeWheel::ms(1));
+    std::atomic<int> fired{0};
+    std::atomic<long long> maxLate{0};
+    auto begin = std::chrono::steady_clock::now();
+    for (int delay = 1; delay <= 200; delay++){
+        wheel.schedule(timeWheel::ms(delay), [&fired,&maxLate,begin,delay](){
+            long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+            CBRICKS_ASSERT(elapsed >= delay,"timer fired too early");
+            if (elapsed - delay > maxLate.load()){
+                maxLate.store(elapsed - delay);
+            }
+            fired++;
+        });
+    }
+    uint64_t canceled = wheel.schedule(timeWheel::ms(100), [&fired](){
+        fired += 1000;
+    });
+    CBRICKS_ASSERT(wheel.cancel(canceled),"cancel timer failed");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    std::cout << "fired: " << fired.load() << " , max late: " << maxLate.load() << "ms" << std::endl;
+
+    /**
+     * map 过期：
+     * 1）带 ttl 写入的 session 到期后被删除
+     * 2）不带 ttl 重新写入的 session 取消过期时间
+     * 3）以更长的 ttl 重新写入的 session 以最后一次为准
+     */
+    const int sessions = 10000;
+    sessionMap sm;
+    for (int i = 0; i < sessions; i++){
+        sm.store("session-" + std::to_string(i), i, sessionMap::ms(50));
+    }
+    for (int i = 0; i < sessions; i += 2){
+        sm.store("session-" + std::to_string(i), i);
+    }
+    sm.store("session-1", 1, sessionMap::ms(1000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    int alive = 0;
+    sm.rangeSnapshot([&alive](const std::string& key, const int& value)->bool{
+        alive++;
+        return true;
+    });
+    int v;
+    CBRICKS_ASSERT(sm.load("session-0", v) && sm.load("session-1", v) && !sm.load("session-3", v),"ttl not respected");
+
+    /**
+     * 条件删除：
+     * 1）数据不相等时删除失败，key 保留原有的过期时间
+     * 2）删除成功后以 ttl 重新写入，新的过期时间不会被取消
+     */
+    sm.store("cas", 1, sessionMap::ms(50));
+    CBRICKS_ASSERT(!sm.compareAndDelete("cas", 2),"compareAndDelete removed unequal value");
+    CBRICKS_ASSERT(sm.compareAndDelete("cas", 1),"compareAndDelete failed");
+    sm.store("cas", 3, sessionMap::ms(50));
+    sm.store("kept", 1, sessionMap::ms(50));
+    CBRICKS_ASSERT(!sm.compareAndDelete("kept", 2),"compareAndDelete removed unequal value");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CBRICKS_ASSERT(!sm.load("cas", v) && !sm.load("kept", v),"ttl lost after compareAndDelete");
+
+    // map 析构时仍有未到期的定时任务，到期后不会访问已析构的 map
+    {
+        sessionMap tmp;
+        tmp.store("tmp", 1, sessionMap::ms(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // 预期结果：fired 200, alive 5001
+    std::cout << "alive: " << alive << std::endl;
+}
+
+void testSyncMapBatch(){
+    typedef cbricks::sync::Map<int,long> smap;
+
+    const int keys = 1000000;
+    std::vector<std::pair<int,long>> rows;
+    rows.reserve(keys);
+    for (int i = 0; i < keys; i++){
+        rows.push_back({i, i});
+    }
+
+    /**
+     * 冷启动加载：逐条 store、storeBatch、批量构建三种方式
+     * 分别统计加载耗时，以及加载后首次全量读取的耗时. 逐条 store 的数据位于 dirty 中，首次读取时需要逐一 miss 后才会提升到 readonly
+     * 预期结果：storeBatch 与批量构建直接构建 readonly，加载耗时为逐条 store 的数分之一，首次读取全部命中无锁路径
+     */
+    typedef std::chrono::steady_clock clock;
+    auto elapsed = [](clock::time_point begin)->long long{
+        return std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - begin).count();
+    };
+    auto readAll = [keys](smap& sm){
+        long v;
+        for (int i = 0; i < keys; i++){
+            CBRICKS_ASSERT(sm.load(i, v) && v == i,"load wrong value");
+        }
+    };
+    auto bench = [&](const std::string& name, std::function<void(smap&)> load){
+        smap sm;
+        clock::time_point begin = clock::now();
+        load(sm);
+        long long loadCost = elapsed(begin);
+        begin = clock::now();
+        readAll(sm);
+        std::cout << name << " load: " << loadCost << "ms , first read: " << elapsed(begin) << "ms" << std::endl;
+    };
+
+    bench("store", [&](smap& sm){
+        for (int i = 0; i < keys; i++){
+            sm.store(rows[i].first, rows[i].second);
+        }
+    });
+    bench("storeBatch", [&](smap& sm){
+        sm.storeBatch(rows.begin(), rows.end());
+    });
+    {
+        clock::time_point begin = clock::now();
+        smap sm(rows.begin(), rows.end());
+        long long loadCost = elapsed(begin);
+        begin = clock::now();
+        readAll(sm);
+        std::cout << "bulk build load: " << loadCost << "ms , first read: " << elapsed(begin) << "ms" << std::endl;
+    }
+
+    // 批量构建时重复的 key 以最后一次为准；批量读取与逐条读取结果一致
+    std::vector<std::pair<int,long>> dup = {{1, 1}, {2, 2}, {1, 10}};
+    smap sm(dup.begin(), dup.end());
+    std::vector<std::pair<int,long>> more = {{2, 20}, {3, 30}};
+    sm.storeBatch(more.begin(), more.end());
+
+    std::vector<long> values;
+    std::vector<bool> found;
+    size_t hits = sm.loadBatch({1, 2, 3, 4}, values, found);
+    CBRICKS_ASSERT(hits == 3 && values[0] == 10 && values[1] == 20 && values[2] == 30 && !found[3],"load batch got wrong result");
+    std::cout << "hits: " << hits << std::endl;
+}
+
+void testSyncMapBenchmark(){
+    typedef cbricks::sync::Map<int,int> smap;
+    typedef cbricks::sync::Thread thread;
+
+    // key 数量以及每个线程的读取次数
+    const int keys = 1024;
+    const int ops = 1000000;
+
+    // 写入数据后通过 range 将 dirty 全量提升为 readonly，此后的读取全部命中无锁路径
+    smap sm;
+    for (int i = 0; i < keys; i++){
+        sm.store(i,i);
+    }
+    sm.range([](const int& key, const int& value)->bool{
+        return true;
+    });
+
+    // 逐步提高并发度. 读路径不存在共享的引用计数，理想情况下总吞吐随线程数（不超过 CPU 核数时）线性增长
+    for (int threads = 1; threads <= 32; threads *= 2){
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<thread::ptr> readers;
+        for (int i = 0; i < threads; i++){
+            readers.push_back(thread::ptr(new thread([&sm,i](){
+                int v;
+                for (int j = 0; j < ops; j++){
+                    int key = (j + i) & (keys - 1);
+                    sm.load(key,v);
+                    CBRICKS_ASSERT(v == key,"load wrong value");
+                }
+            })));
+        }
+        for (int i = 0; i < readers.size(); i++){
+            readers[i]->join();
+        }
+        long long cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "threads: " << threads << " , cost: " << cost << "ms , throughput: " << (long long)threads * ops / (cost + 1) << " ops/ms" << std::endl;
+    }
+}
+
+void testSyncMapUpdateBenchmark(){
+    typedef cbricks::sync::Map<int,long> counterMap;
+    typedef cbricks::sync::Map<int,std::string> stringMap;
+    typedef cbricks::sync::Thread thread;
+
+    // 并发度、key 数量以及每个线程的更新次数
+    const int threads = 4;
+    const int keys = 1024;
+    const int ops = 1000000;
+
+    /**
+     * 更新密集场景：所有 key 已提升到 readonly 中，writer 持续覆盖已有 key，reader 同时读取并校验数据完整性
+     * long 类型的 value 内联存储在 entry 中，string 类型的 value 存放在池化复用的 WrappedV 中
+     */
+    auto bench = [&](std::function<void(int,int)> store, std::function<void(int)> check)->long long{
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<thread::ptr> workers;
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([&,i](){
+                for (int j = 0; j < ops; j++){
+                    store((j + i) & (keys - 1), j);
+                }
+            })));
+        }
+        workers.push_back(thread::ptr(new thread([&](){
+            for (int j = 0; j < ops; j++){
+                check(j & (keys - 1));
+            }
+        })));
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+
+    counterMap cm;
+    stringMap strm;
+    for (int i = 0; i < keys; i++){
+        cm.store(i,i);
+        strm.store(i,std::to_string(i));
+    }
+    cm.range([](const int& key, const long& value)->bool{
+        return true;
+    });
+    strm.range([](const int& key, const std::string& value)->bool{
+        return true;
+    });
+
+    long long counterCost = bench([&](int key, int j){
+        cm.store(key, (long)j * keys + key);
+    },[&](int key){
+        long v;
+        cm.load(key,v);
+        CBRICKS_ASSERT(v % keys == key,"torn counter value");
+    });
+    long long stringCost = bench([&](int key, int j){
+        strm.store(key, std::to_string(key) + ":" + std::to_string(j));
+    },[&](int key){
+        std::string v;
+        strm.load(key,v);
+        CBRICKS_ASSERT(v.compare(0, std::to_string(key).size(), std::to_string(key)) == 0,"torn string value");
+    });
+
+    std::cout << "long value: " << counterCost << "ms" << std::endl;
+    std::cout << "string value: " << stringCost << "ms" << std::endl;
+}
+
+void testCache(){
+    typedef cbricks::sync::Cache<int,int> cache;
+    typedef cbricks::sync::Cache<int,std::string> stringCache;
+    typedef cbricks::sync::Thread thread;
+
+    const int hotKeys = 100;
+    const int rounds = 100;
+    const int scanKeys = 1000;
+
+    /**
+     * 抗扫描：热点 key 被反复访问，同时穿插一次性访问的扫描 key
+     * 启用准入策略时，扫描 key 的访问频率低于热点 key，无法挤占缓存
+     */
+    auto scan = [&](bool admission)->double{
+        cache c(200, 0, nullptr, 4, admission);
+        int scanKey = hotKeys;
+        for (int r = 0; r < rounds; r++){
+            for (int i = 0; i < hotKeys; i++){
+                int v;
+                if (!c.load(i, v)){
+                    c.store(i, i);
+                }
+            }
+            for (int i = 0; i < scanKeys / rounds * 10; i++, scanKey++){
+                c.store(scanKey, scanKey);
+            }
+        }
+        cache::Stats stats = c.stats();
+        return (double)stats.hits / (stats.hits + stats.misses);
+    };
+    std::cout << "hot hit ratio without admission: " << scan(false) << " , with admission: " << scan(true) << std::endl;
+
+    // 字节数上限：每条数据按字符串长度计算，总量不超过上限
+    stringCache sc(0, 4096, [](const int& key, const std::string& value)->size_t{
+        return value.size();
+    }, 1);
+    for (int i = 0; i < 1000; i++){
+        sc.store(i, std::string(64, 'a'));
+    }
+    CBRICKS_ASSERT(sc.bytes() <= 4096 && sc.size() == 64,"byte budget exceeded");
+
+    // 准入判断先于淘汰：被拒绝的写入不会淘汰任何未过期数据
+    stringCache rc(0, 4, [](const int& key, const std::string& value)->size_t{
+        return value.size();
+    }, 1);
+    for (int i = 0; i < 4; i++){
+        rc.store(i, "a");
+    }
+    for (int r = 0; r < 5; r++){
+        for (int i = 1; i < 4; i++){
+            std::string s;
+            rc.load(i, s);
+        }
+    }
+    for (int r = 0; r < 2; r++){
+        std::string s;
+        rc.load(100, s);
+    }
+    CBRICKS_ASSERT(rc.store(100, "aa") || rc.size() == 4,"rejected store shrank the cache");
+
+    // 分片上限之和等于设定值：余数分配给前面的分片，总量不会因向上取整而超出
+    cache bc(10, 0, nullptr, 4, false);
+    for (int i = 0; i < 1000; i++){
+        bc.store(i, i);
+    }
+    CBRICKS_ASSERT(bc.size() <= 10,"sharded entry budget exceeded");
+
+    // 过期时间：过期数据读取时视为不存在
+    cache tc(100);
+    tc.store(1, 1, cache::ms(20));
+    tc.store(2, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    int v;
+    CBRICKS_ASSERT(!tc.load(1, v) && tc.load(2, v),"ttl not respected");
+
+    // 并发读写：数据条数始终不超过上限
+    cache cc(1024);
+    std::vector<thread::ptr> workers;
+    for (int i = 0; i < 8; i++){
+        workers.push_back(thread::ptr(new thread([&cc,i](){
+            for (int j = 0; j < 100000; j++){
+                int key = (j * 7 + i) & 4095;
+                int v;
+                if (cc.load(key, v)){
+                    CBRICKS_ASSERT(v == key,"cache load wrong value");
+                } else{
+                    cc.store(key, key);
+                }
+            }
+        })));
+    }
+    for (int i = 0; i < workers.size(); i++){
+        workers[i]->join();
+    }
+    CBRICKS_ASSERT(cc.size() <= 1024,"entry budget exceeded");
+
+    cache::Stats stats = cc.stats();
+    std::cout << "size: " << cc.size() << " , hits: " << stats.hits << " , misses: " << stats.misses << " , evictions: " << stats.evictions << " , rejections: " << stats.rejections << std::endl;
+}
+
+void testShardedMapBenchmark(){
+    typedef cbricks::sync::Map<int,int> smap;
+    typedef cbricks::sync::ShardedMap<int,int> shardedMap;
+    typedef cbricks::sync::Thread thread;
+
+    // 并发度、每个线程的操作次数以及 key 空间大小
+    const int threads = 4;
+    const int ops = 200000;
+    const int keys = 1 << 16;
+
+    /**
+     * 混合读写：每个线程按照写比例 writePct 随机写入或读取 key
+     * key 空间远大于预热数据量，写操作中大部分为插入新 key
+     */
+    auto bench = [&](int writePct, std::function<void(int)> store, std::function<void(int)> load)->long long{
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<thread::ptr> workers;
+        for (int i = 0; i < threads; i++){
+            workers.push_back(thread::ptr(new thread([&,i](){
+                // 线程私有的线性同余随机数
+                unsigned int seed = i + 1;
+                for (int j = 0; j < ops; j++){
+                    seed = seed * 1103515245 + 12345;
+                    int key = (seed >> 8) & (keys - 1);
+                    if ((seed >> 4) % 100 < writePct){
+                        store(key);
+                    } else{
+                        load(key);
+                    }
+                }
+            })));
+        }
+        for (int i = 0; i < workers.size(); i++){
+            workers[i]->join();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+
+    int writePcts[] = {1, 10, 50};
+    for (int i = 0; i < 3; i++){
+        smap sm;
+        shardedMap shm;
+        long long syncMapCost = bench(writePcts[i],[&](int key){
+            sm.store(key,key);
+        },[&](int key){
+            int v;
+            sm.load(key,v);
+        });
+        long long shardedMapCost = bench(writePcts[i],[&](int key){
+            shm.store(key,key);
+        },[&](int key){
+            int v;
+            shm.load(key,v);
+        });
+        std::cout << "write " << writePcts[i] << "%: sync map " << syncMapCost << "ms , sharded map " << shardedMapCost << "ms" << std::endl;
+    }
+}
+
+void testEpoch(){
+    typedef cbricks::sync::Epoch epoch;
+    typedef cbricks::sync::Thread thread;
+
+    // 被并发替换的配置对象，析构时统计回收次数并抹除 magic，便于发现释放后访问
+    static std::atomic<int> freed{0};
+    struct config{
+        int magic = 0x5a5a;
+        int version;
+        config(int version):version(version){}
+        ~config(){
+            magic = 0;
+            freed++;
+        }
+    };
+
+    std::atomic<config*> current{new config(0)};
+    std::atomic<bool> stop{false};
+    const int updates = 100000;
+
+    // 4 个 reader 在 epoch 临界区内持续读取最新配置
+    std::vector<thread::ptr> readers;
+    for (int i = 0; i < 4; i++){
+        readers.push_back(thread::ptr(new thread([&current,&stop](){
+            while (!stop.load()){
+                epoch::Guard guard;
+                config* c = current.load();
+                CBRICKS_ASSERT(c->magic == 0x5a5a,"read reclaimed config");
+            }
+        })));
+    }
+
+    // 1 个 writer 持续替换配置，被替换的旧配置退休到 epoch 中延迟回收
+    thread writer([&current](){
+        for (int i = 1; i <= updates; i++){
+            config* old = current.exchange(new config(i));
+            epoch::Retire(old);
+        }
+    });
+    writer.join();
+    stop.store(true);
+    for (int i = 0; i < readers.size(); i++){
+        readers[i]->join();
+    }
+
+    // 此时已没有线程处于临界区，推进两轮 epoch 后所有退休数据均满足回收条件（预期结果为 100000）
+    for (int i = 0; i < 3; i++){
+        epoch::Reclaim();
+    }
+    std::cout << "retired: " << updates << " , freed: " << freed.load() << std::endl;
+    delete current.load();
+}
+
+void testHazardPointer(){
+    typedef cbricks::sync::HazardPointer hazard;
+    typedef cbricks::sync::Thread thread;
+
+    // 被并发替换的数据，析构时统计回收次数并抹除 magic，便于发现释放后访问
+    static std::atomic<int> freed{0};
+    struct data{
+        int magic = 0x5a5a;
+        int version;
+        data(int version):version(version){}
+        ~data(){
+            magic = 0;
+            freed++;
+        }
+    };
+    hazard::deleter deleter = [](void* ptr){
+        delete static_cast<data*>(ptr);
+    };
+
+    // 模拟 sync::Map 中的 readonly 快照以及 entry 中的 value 容器
+    std::atomic<data*> readonly{new data(0)};
+    std::atomic<data*> entries[8];
+    for (int i = 0; i < 8; i++){
+        entries[i].store(new data(0));
+    }
+    std::atomic<bool> stop{false};
+    const int updates = 100000;
+
+    // 4 个长期持有快照的 reader，每持有一份快照的期间内反复读取 entry
+    std::vector<thread::ptr> readers;
+    for (int i = 0; i < 4; i++){
+        readers.push_back(thread::ptr(new thread([&readonly,&entries,&stop](){
+            hazard::Guard snapshotGuard;
+            hazard::Guard entryGuard;
+            while (!stop.load()){
+                data* snapshot = snapshotGuard.protect(readonly);
+                for (int j = 0; j < 1000; j++){
+                    data* entry = entryGuard.protect(entries[j % 8]);
+                    CBRICKS_ASSERT(snapshot->magic == 0x5a5a && entry->magic == 0x5a5a,"read reclaimed data");
+                }
+            }
+        })));
+    }
+
+    // 2 个 writer 分别替换快照和 entry，被替换的旧数据退休到 hazard pointer 中延迟回收
+    thread snapshotWriter([&readonly,deleter](){
+        for (int i = 1; i <= updates; i++){
+            hazard::Retire(readonly.exchange(new data(i)), deleter);
+        }
+    });
+    thread entryWriter([&entries,deleter](){
+        for (int i = 1; i <= updates; i++){
+            hazard::Retire(entries[i % 8].exchange(new data(i)), deleter);
+        }
+    });
+    snapshotWriter.join();
+    entryWriter.join();
+    stop.store(true);
+    for (int i = 0; i < readers.size(); i++){
+        readers[i]->join();
+    }
+
+    // writer 退出时遗留的节点由主线程扫描接管. 此时已没有线程持有指针，预期结果为 200000
+    hazard::Scan();
+    std::cout << "retired: " << 2 * updates << " , freed: " << freed.load() << std::endl;
+    delete readonly.load();
+    for (int i = 0; i < 8; i++){
+        delete entries[i].load();
+    }
+}
+
 void testSharedPtr(){
     class demo{
     public:
@@ -525,6 +1801,214 @@ void testSharedPtr(){
     }
     
     std::cout << "use cnt: " << ptr.use_count() << std::endl;
+
+    // 对象与计数一次分配；移动时不修改计数
+    sharedPtr made = cbricks::memory::makeShared<demo>();
+    sharedPtr moved = std::move(made);
+    std::cout << "use cnt after move: " << moved.use_count() << " , source: " << made.use_count() << std::endl;
+
+    // 赋值的来源由被替换的对象持有：沿链表前进时，旧节点释放前已取走 next 的引用
+    struct listNode{
+        explicit listNode(int v):v(v){}
+        cbricks::memory::SharedPtr<listNode> next;
+        int v;
+    };
+    cbricks::memory::SharedPtr<listNode> head = cbricks::memory::makeShared<listNode>(1);
+    head->next = cbricks::memory::makeShared<listNode>(2);
+    head = std::move(head->next);
+    std::cout << "head: " << head->v << " , use cnt: " << head.use_count() << std::endl;
+}
+
+void testWeakPtr(){
+    typedef cbricks::memory::SharedPtr<std::string> sharedPtr;
+    typedef cbricks::memory::WeakPtr<std::string> weakPtr;
+
+    weakPtr weak;
+    {
+        sharedPtr ptr = cbricks::memory::makeShared<std::string>("cbricks");
+        weak = weakPtr(ptr);
+        sharedPtr locked = weak.lock();
+        std::cout << "expired: " << weak.expired() << " , locked: " << *locked << " , use cnt: " << ptr.use_count() << std::endl;
+    }
+    // 对象已析构，控制块仍由 weak 持有
+    std::cout << "expired: " << weak.expired() << " , lock empty: " << !weak.lock() << std::endl;
+}
+
+// RCU 风格的配置：写入方整体替换，读取方无锁读取
+struct rcuConfig{
+    rcuConfig(int64_t version):version(version),checksum(version * 31){}
+    ~rcuConfig(){
+        destructed++;
+    }
+    int64_t version;
+    int64_t checksum;
+    static std::atomic<int64_t> destructed;
+};
+std::atomic<int64_t> rcuConfig::destructed{0};
+
+void testAtomicSharedPtr(){
+    typedef cbricks::memory::SharedPtr<rcuConfig> sharedPtr;
+    typedef cbricks::memory::AtomicSharedPtr<rcuConfig> atomicPtr;
+    typedef cbricks::sync::Thread thread;
+
+    const int updates = 100000;
+    std::atomic<int64_t> torn{0};
+    std::atomic<int64_t> reads{0};
+    std::atomic<bool> stop{false};
+    {
+        atomicPtr config(cbricks::memory::makeShared<rcuConfig>(0));
+
+        // 读取方反复加载配置并校验内容完整
+        std::vector<thread::ptr> readers;
+        for (int i = 0; i < 4; i++){
+            readers.push_back(thread::ptr(new thread([&config,&torn,&reads,&stop](){
+                int64_t last = 0;
+                while (!stop.load()){
+                    sharedPtr cur = config.load();
+                    if (cur->checksum != cur->version * 31 || cur->version < last){
+                        torn++;
+                    }
+                    last = cur->version;
+                    reads++;
+                }
+            })));
+        }
+
+        // 写入方：一半 store，一半 compareExchange
+        for (int64_t v = 1; v <= updates; v++){
+            if (v % 2){
+                config.store(cbricks::memory::makeShared<rcuConfig>(v));
+                continue;
+            }
+            sharedPtr expected = config.load();
+            while (!config.compareExchange(expected, cbricks::memory::makeShared<rcuConfig>(v))){}
+        }
+        stop.store(true);
+        for (int i = 0; i < readers.size(); i++){
+            readers[i]->join();
+        }
+        std::cout << "final version: " << config.load()->version << " , reads: " << reads.load() << " , torn: " << torn.load() << std::endl;
+    }
+    // 被替换的配置经 epoch 延迟回收，推进 epoch 后应全部析构
+    for (int i = 0; i < 4; i++){
+        cbricks::sync::Epoch::Reclaim();
+    }
+    std::cout << "constructed: " << updates + 1 << " , destructed: " << rcuConfig::destructed.load() << std::endl;
+}
+
+// 引用计数存放在对象内部的节点，计数策略由模板参数指定
+template <class Count>
+struct refNode : public cbricks::memory::RefCounted<refNode<Count>, Count>{
+    int64_t v = 0;
+};
+
+void testIntrusivePtr(){
+    typedef cbricks::memory::AtomicCount atomicCount;
+    typedef cbricks::memory::PlainCount plainCount;
+
+    // 基础语义：计数存放在对象内部，从裸指针重新构造不会产生新的计数
+    cbricks::memory::IntrusivePtr<refNode<atomicCount>> ptr = cbricks::memory::makeIntrusive<refNode<atomicCount>>();
+    {
+        cbricks::memory::IntrusivePtr<refNode<atomicCount>> ptr2(ptr.get());
+        std::cout << "ref cnt: " << ptr->refCount() << std::endl;
+        cbricks::memory::IntrusivePtr<refNode<atomicCount>> ptr3 = std::move(ptr2);
+        std::cout << "ref cnt after move: " << ptr->refCount() << std::endl;
+    }
+    std::cout << "ref cnt: " << ptr->refCount() << std::endl;
+
+    // 各类指针反复创建对象并拷贝若干次的耗时
+    const int ops = 1000000;
+    const int copies = 4;
+    auto bench = [ops,copies](const char* name, std::function<void()> round){
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ops; i++){
+            round();
+        }
+        std::cout << name << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count() << "ms" << std::endl;
+    };
+
+    bench("SharedPtr(new T)", [copies](){
+        cbricks::memory::SharedPtr<int64_t> p(new int64_t(0));
+        for (int j = 0; j < copies; j++){
+            cbricks::memory::SharedPtr<int64_t> q = p;
+            (*q)++;
+        }
+    });
+    bench("makeShared<T>", [copies](){
+        cbricks::memory::SharedPtr<int64_t> p = cbricks::memory::makeShared<int64_t>(0);
+        for (int j = 0; j < copies; j++){
+            cbricks::memory::SharedPtr<int64_t> q = p;
+            (*q)++;
+        }
+    });
+    bench("makeShared<T, PlainCount>", [copies](){
+        cbricks::memory::SharedPtr<int64_t, plainCount> p = cbricks::memory::makeShared<int64_t, plainCount>(0);
+        for (int j = 0; j < copies; j++){
+            cbricks::memory::SharedPtr<int64_t, plainCount> q = p;
+            (*q)++;
+        }
+    });
+    bench("IntrusivePtr<AtomicCount>", [copies](){
+        cbricks::memory::IntrusivePtr<refNode<atomicCount>> p = cbricks::memory::makeIntrusive<refNode<atomicCount>>();
+        for (int j = 0; j < copies; j++){
+            cbricks::memory::IntrusivePtr<refNode<atomicCount>> q = p;
+            q->v++;
+        }
+    });
+    bench("IntrusivePtr<PlainCount>", [copies](){
+        cbricks::memory::IntrusivePtr<refNode<plainCount>> p = cbricks::memory::makeIntrusive<refNode<plainCount>>();
+        for (int j = 0; j < copies; j++){
+            cbricks::memory::IntrusivePtr<refNode<plainCount>> q = p;
+            q->v++;
+        }
+    });
+}
+
+void testFlatMap(){
+    typedef cbricks::datastruct::FlatMap<int,int> flatMap;
+
+    // 数据规模以及查找次数
+    const int keys = 1 << 20;
+    const int ops = 10000000;
+
+    std::unordered_map<int,int> um;
+    for (int i = 0; i < keys; i++){
+        um[i * 7] = i;
+    }
+    flatMap fm(um.begin(), um.end(), um.size());
+
+    // 校验命中与未命中
+    for (int i = 0; i < keys; i++){
+        const int* v = fm.find(i * 7);
+        CBRICKS_ASSERT(v && *v == i,"flat map lost key");
+        CBRICKS_ASSERT(fm.find(i * 7 + 1) == nullptr,"flat map found absent key");
+    }
+
+    // 随机命中查找，key 分布远超 cache 容量
+    auto bench = [&](std::function<int(int)> find)->long long{
+        auto begin = std::chrono::steady_clock::now();
+        unsigned int seed = 1;
+        long long sum = 0;
+        for (int i = 0; i < ops; i++){
+            seed = seed * 1103515245 + 12345;
+            sum += find(((seed >> 8) & (keys - 1)) * 7);
+        }
+        CBRICKS_ASSERT(sum > 0,"unexpected sum");
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+
+    long long umCost = bench([&](int key)->int{
+        return um.find(key)->second;
+    });
+    long long fmCost = bench([&](int key)->int{
+        return *fm.find(key);
+    });
+
+    // unordered_map 的内存按 桶数组 + 每个节点（后继指针 + kv）估算，未计入分配器的额外开销
+    double umBytes = double(um.bucket_count() * sizeof(void*) + um.size() * (sizeof(void*) + sizeof(std::pair<const int,int>))) / um.size();
+    double fmBytes = double(fm.memoryUsage()) / fm.size();
+    std::cout << "unordered_map: " << umCost << "ms , " << umBytes << " bytes/entry" << std::endl;
+    std::cout << "flat map: " << fmCost << "ms , " << fmBytes << " bytes/entry" << std::endl;
 }
 
 void testRadix(){
@@ -569,11 +2053,110 @@ void testRadix(){
     std::cout << "key:" << "/banana;" << "ret:" << ret << ";value:" << receiver << "\n";
 }
 
+void testRadixPrefix(){
+    typedef cbricks::datastruct::RadixTree<std::string> radix;
+    radix routes;
+    routes.put("/", "index");
+    routes.put("/api", "api");
+    routes.put("/api/v1", "v1");
+    routes.put("/api/v1/user", "user");
+    routes.put("/api/v1/user/profile", "profile");
+    routes.put("/api/v2", "v2");
+    routes.put("/static", "static");
+
+    // 最长前缀匹配：为请求路径选择最具体的路由
+    const char* paths[] = {"/api/v1/user/42", "/api/v1/order", "/api/v3", "/static/app.js", "/favicon.ico", ""};
+    for (int i = 0; i < 6; i++){
+        std::string matched, handler;
+        bool ret = routes.longestPrefix(paths[i], matched, handler);
+        std::cout << "path:" << paths[i] << ";ret:" << ret << ";matched:" << matched << ";handler:" << handler << "\n";
+    }
+
+    // 有序前缀扫描：逐条回调，返回 false 时提前终止
+    std::cout << "===========\n";
+    routes.scanPrefix("/api/v1", [](const std::string& key, const std::string& value)->bool{
+        std::cout << "scan key:" << key << ";value:" << value << "\n";
+        return true;
+    });
+    int limit = 2;
+    routes.scanPrefix("", [&limit](const std::string& key, const std::string& value)->bool{
+        std::cout << "first key:" << key << "\n";
+        return --limit > 0;
+    });
+
+    // 删除后节点收缩、合并，前缀匹配退回到更短的路由
+    std::cout << "===========\n";
+    std::cout << "erase /api/v1/user:" << routes.erase("/api/v1/user") << ";erase /api/v1/user again:" << routes.erase("/api/v1/user") << "\n";
+    std::string matched, handler;
+    routes.longestPrefix("/api/v1/user/42", matched, handler);
+    std::cout << "matched:" << matched << ";handler:" << handler << ";size:" << routes.size() << "\n";
+
+    std::vector<std::string> keys;
+    routes.scanPrefix("", [&keys](const std::string& key, const std::string& value)->bool{
+        keys.push_back(key);
+        return true;
+    });
+    for (int i = 0; i < keys.size(); i++){
+        routes.erase(keys[i]);
+    }
+    std::cout << "after erase all, size:" << routes.size() << ";bytes:" << routes.memoryUsage() << "\n";
+}
+
+void testRadixBenchmark(){
+    typedef cbricks::datastruct::RadixTree<int> radix;
+
+    const int keys = 1000000;
+    std::vector<std::string> paths;
+    paths.reserve(keys);
+    for (int i = 0; i < keys; i++){
+        paths.push_back("/api/v" + std::to_string(i % 8) + "/user/" + std::to_string((long long)i * 7919 % 1000003) + "/profile");
+    }
+
+    // 写入耗时与每个 key 占用的字节数
+    radix tree;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < keys; i++){
+        tree.put(paths[i], i);
+    }
+    long long putCost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << "keys: " << tree.size() << " , put: " << putCost << "ms , bytes/key: " << tree.memoryUsage() / tree.size() << std::endl;
+
+    // 查询延迟，与 unordered_map 对比
+    std::unordered_map<std::string,int> hash;
+    for (int i = 0; i < keys; i++){
+        hash[paths[i]] = i;
+    }
+
+    int receiver, hits = 0;
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < keys; i++){
+        if (tree.get(paths[i], receiver) && receiver == i){
+            hits++;
+        }
+    }
+    long long radixCost = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < keys; i++){
+        auto it = hash.find(paths[i]);
+        if (it != hash.end() && it->second == i){
+            hits++;
+        }
+    }
+    long long hashCost = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << "hits: " << hits << "/" << 2 * keys << " , radix get: " << radixCost / keys << "ns/op , unordered_map get: " << hashCost / keys << "ns/op" << std::endl;
+    std::cout << "miss /api/v1/user: " << tree.get("/api/v1/user", receiver) << " , miss /api/v9/user/1/profile: " << tree.get("/api/v9/user/1/profile", receiver) << std::endl;
+}
+
 int main(int argc, char** argv){
     // testThread();
     // testCoroutine();
     // testLinkedList();
+    // testQueueBenchmark();
     // testChannel();
+    // testChannelDrain();
+    // testUnboundedChannel();
     // testWorkerPool();
     // testAssert();
     // testLog();
@@ -581,8 +2164,30 @@ int main(int argc, char** argv){
     // testFc();
     // testSignal();
     // testSyncMap();
+    // testSyncMapAtomic();
+    // testSyncMapRangeSnapshot();
+    // testSyncMapTtl();
+    // testSyncMapBatch();
+    // testSyncMapBenchmark();
+    // testSyncMapUpdateBenchmark();
+    // testShardedMapBenchmark();
+    // testCache();
+    // testEpoch();
+    // testHazardPointer();
     // testInstancePool();
+    // testInstancePoolBenchmark();
+    // testInstancePoolEvict();
+    // testInstancePoolAdaptive();
+    // testObjectPool();
+    // testArena();
+    // testSlab();
     // testSharedPtr();
+    // testIntrusivePtr();
+    // testWeakPtr();
+    // testAtomicSharedPtr();
+    // testFlatMap();
     // testRadix();
+    // testRadixPrefix();
+    // testRadixBenchmark();
 }
 
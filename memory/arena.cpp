@@ -0,0 +1,142 @@
+#include <stdlib.h>
+
+#include "arena.h"
+#include "../sync/lock.h"
+#include "../trace/assert.h"
+
+namespace cbricks{namespace memory{
+
+/**
+ * 进程级的标准 chunk 空闲链表. 通过函数内静态变量保证在首次使用前完成初始化，
+ * 并且不随静态变量析构，避免其他静态对象析构时归还 chunk 访问到已析构的链表
+ */
+struct ChunkCache{
+    sync::SpinLock lock;
+    void* head = nullptr;
+    size_t size = 0;
+};
+
+static ChunkCache* chunkCache(){
+    static ChunkCache* cache = new ChunkCache;
+    return cache;
+}
+
+Arena::~Arena(){
+    Chunk* chunk = this->m_head;
+    while (chunk){
+        Chunk* next = chunk->next;
+        Arena::freeChunk(chunk);
+        chunk = next;
+    }
+}
+
+/**
+ * @brief: 一次性回收所有已分配的内存
+ * 1）保留一个标准 chunk 供后续分配复用
+ * 2）其余标准 chunk 归还到进程级空闲链表，单独申请的大 chunk 直接释放
+ */
+void Arena::reset(){
+    Chunk* kept = nullptr;
+    Chunk* chunk = this->m_head;
+    while (chunk){
+        Chunk* next = chunk->next;
+        if (!kept && chunk->size == CHUNK_SIZE){
+            kept = chunk;
+        } else{
+            Arena::freeChunk(chunk);
+        }
+        chunk = next;
+    }
+
+    this->m_head = kept;
+    this->m_used = 0;
+    this->m_reserved = 0;
+    this->m_ptr = nullptr;
+    this->m_end = nullptr;
+    if (kept){
+        kept->next = nullptr;
+        this->m_ptr = Arena::dataOf(kept);
+        this->m_end = this->m_ptr + kept->size;
+        this->m_reserved = kept->size;
+    }
+}
+
+size_t Arena::used() const{
+    return this->m_used;
+}
+
+size_t Arena::reserved() const{
+    return this->m_reserved;
+}
+
+/**
+ * @brief: 当前 chunk 空间不足时的慢路径
+ * 1）大块内存单独申请一个 chunk，挂在当前 chunk 之后，不影响当前 chunk 剩余空间的使用
+ * 2）否则申请一个新的标准 chunk 作为当前 chunk，原 chunk 的剩余空间被舍弃
+ */
+void* Arena::allocateSlow(const size_t bytes, const size_t align){
+    CBRICKS_ASSERT(align > 0 && (align & (align - 1)) == 0, "align must be power of 2");
+
+    if (bytes + align > CHUNK_SIZE / 4){
+        Chunk* chunk = Arena::newChunk(bytes + align);
+        if (this->m_head){
+            chunk->next = this->m_head->next;
+            this->m_head->next = chunk;
+        } else{
+            // 尚未持有任何 chunk 时，大 chunk 作为链表头，当前 chunk 仍为空
+            chunk->next = nullptr;
+            this->m_head = chunk;
+        }
+        this->m_reserved += chunk->size;
+        char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(Arena::dataOf(chunk)) + align - 1) & ~(uintptr_t)(align - 1));
+        this->m_used += bytes;
+        return p;
+    }
+
+    Chunk* chunk = Arena::newChunk(CHUNK_SIZE);
+    chunk->next = this->m_head;
+    this->m_head = chunk;
+    this->m_reserved += chunk->size;
+    this->m_ptr = Arena::dataOf(chunk);
+    this->m_end = this->m_ptr + chunk->size;
+    return this->allocate(bytes, align);
+}
+
+Arena::Chunk* Arena::newChunk(const size_t size){
+    if (size == CHUNK_SIZE){
+        ChunkCache* cache = chunkCache();
+        sync::SpinLock::lockGuard guard(cache->lock);
+        if (cache->head){
+            Chunk* chunk = static_cast<Chunk*>(cache->head);
+            cache->head = chunk->next;
+            cache->size--;
+            return chunk;
+        }
+    }
+
+    Chunk* chunk = static_cast<Chunk*>(malloc(sizeof(Chunk) + size));
+    CBRICKS_ASSERT(chunk != nullptr, "malloc fail");
+    chunk->next = nullptr;
+    chunk->size = size;
+    return chunk;
+}
+
+void Arena::freeChunk(Chunk* chunk){
+    if (chunk->size == CHUNK_SIZE){
+        ChunkCache* cache = chunkCache();
+        sync::SpinLock::lockGuard guard(cache->lock);
+        if (cache->size < MAX_CACHED_CHUNKS){
+            chunk->next = static_cast<Chunk*>(cache->head);
+            cache->head = chunk;
+            cache->size++;
+            return;
+        }
+    }
+    free(chunk);
+}
+
+char* Arena::dataOf(Chunk* chunk){
+    return reinterpret_cast<char*>(chunk) + sizeof(Chunk);
+}
+
+}}
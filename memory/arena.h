@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "../base/nocopy.h"
+
+namespace cbricks{namespace memory{
+
+/**
+ * @brief: 基于指针碰撞（bump pointer）的内存分配区
+ * 核心思路：
+ *  - 以 chunk 为单位向系统申请内存，分配时只需要移动指针，释放单个对象是空操作
+ *  - 一批生命周期相同的对象（例如一笔请求中的各个字符串）都从同一个 arena 中分配，随 reset 或析构一次性回收
+ *  - 标准大小的 chunk 回收时放入进程级的空闲链表，供其他 arena 复用，避免频繁地 malloc/free
+ *  - 超过 chunk 四分之一大小的分配单独申请一个 chunk，回收时直接释放
+ * 非并发安全，一个 arena 同一时刻只允许被一个线程使用
+ */
+class Arena : base::Noncopyable{
+public:
+    // 标准 chunk 的大小
+    static const size_t CHUNK_SIZE = 4096;
+    // 进程级空闲链表中最多缓存的 chunk 数量
+    static const size_t MAX_CACHED_CHUNKS = 1024;
+
+public:
+    // 构造函数. 首次分配时才申请 chunk
+    Arena() = default;
+    // 析构函数. 归还所有 chunk
+    ~Arena();
+
+public:
+    /**
+     * @brief: 分配一段内存
+     * @param: bytes——字节数
+     * @param: align——对齐字节数，要求为 2 的整数次幂
+     * @return: 内存起始地址. 内存在 reset 或 arena 析构前始终有效
+     */
+    void* allocate(const size_t bytes, const size_t align = alignof(max_align_t));
+
+    /**
+     * @brief: 一次性回收所有已分配的内存
+     * 1）保留一个标准 chunk 供后续分配复用
+     * 2）其余标准 chunk 归还到进程级空闲链表，单独申请的大 chunk 直接释放
+     */
+    void reset();
+
+    // 已分配的字节数（包含对齐产生的空洞）
+    size_t used() const;
+    // 持有的 chunk 总字节数
+    size_t reserved() const;
+
+private:
+    // chunk 头部，数据紧随其后
+    struct Chunk{
+        Chunk* next;
+        size_t size;
+    };
+
+private:
+    // 当前 chunk 空间不足时的慢路径
+    void* allocateSlow(const size_t bytes, const size_t align);
+    // 申请一个 chunk. 标准大小的 chunk 优先从空闲链表中获取
+    static Chunk* newChunk(const size_t size);
+    // 释放一个 chunk. 标准大小的 chunk 优先归还到空闲链表
+    static void freeChunk(Chunk* chunk);
+    // chunk 的数据起始地址
+    static char* dataOf(Chunk* chunk);
+
+private:
+    // 当前用于指针碰撞的 chunk，通过 next 串联起 arena 持有的所有 chunk
+    Chunk* m_head = nullptr;
+    // 当前 chunk 中下一次分配的起始位置
+    char* m_ptr = nullptr;
+    // 当前 chunk 的末尾
+    char* m_end = nullptr;
+    // 已分配的字节数
+    size_t m_used = 0;
+    // 持有的 chunk 总字节数
+    size_t m_reserved = 0;
+};
+
+/**
+ * @brief: 从 arena 中分配内存的 STL 分配器
+ * deallocate 为空操作，内存随 arena 的 reset 或析构统一回收. 因此使用该分配器的容器不能比 arena 存活得更久，
+ * 并且在 arena reset 之前必须先清空（例如与一个新构造的空容器 swap）
+ */
+template <class T>
+class ArenaAllocator{
+public:
+    typedef T value_type;
+
+    template <class U>
+    struct rebind{
+        typedef ArenaAllocator<U> other;
+    };
+
+public:
+    explicit ArenaAllocator(Arena* arena):m_arena(arena){}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other):m_arena(other.arena()){}
+
+public:
+    T* allocate(const size_t n){
+        return static_cast<T*>(this->m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t){}
+
+    Arena* arena() const{
+        return this->m_arena;
+    }
+
+private:
+    Arena* m_arena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+    return a.arena() == b.arena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+    return a.arena() != b.arena();
+}
+
+// 从 arena 中分配内存的字符串
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+inline void* Arena::allocate(const size_t bytes, const size_t align){
+    char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(this->m_ptr) + align - 1) & ~(uintptr_t)(align - 1));
+    if (this->m_ptr && p + bytes <= this->m_end){
+        this->m_used += p + bytes - this->m_ptr;
+        this->m_ptr = p + bytes;
+        return p;
+    }
+    return this->allocateSlow(bytes, align);
+}
+
+}}
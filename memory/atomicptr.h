@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+#include "../base/nocopy.h"
+#include "../sync/epoch.h"
+#include "ptr.h"
+
+namespace cbricks{ namespace memory{
+
+/**
+ * @brief: 支持原子读写的共享智能指针，适用于 RCU 风格的配置、路由表整体替换
+ * 核心思路：
+ *  - 内部仅存放一个指向控制块的原子指针，并持有该控制块的一个强引用
+ *  - load 在 epoch 临界区内读取控制块并将强引用计数加一. 写入方替换控制块后，并不立即释放旧控制块上的强引用，
+ *    而是通过 epoch 延迟到所有可能读到旧控制块的线程离开临界区之后，因此 load 加一时计数一定不为零，控制块也一定有效
+ *  - store/exchange/compareExchange 均为无锁操作，读写双方不存在互斥锁
+ */
+template <typename T, class Count = AtomicCount>
+class AtomicSharedPtr : base::Noncopyable{
+    // load 会在多个线程中并发地增加强引用计数，非原子的计数策略必然产生数据竞争
+    static_assert(std::is_same<Count, AtomicCount>::value, "AtomicSharedPtr requires AtomicCount");
+
+public:
+    // 共享智能指针 类型别名
+    typedef SharedPtr<T, Count> sharedPtr;
+
+public:
+    /**
+     * 构造&析构函数
+     */
+    explicit AtomicSharedPtr(sharedPtr desired = sharedPtr());
+    // 析构函数. 要求此时不存在并发的读写
+    ~AtomicSharedPtr();
+
+public:
+    // 原子读取，返回一个新的强引用
+    sharedPtr load() const;
+
+    // 原子写入
+    void store(sharedPtr desired);
+
+    // 原子写入，返回写入前的数据
+    sharedPtr exchange(sharedPtr desired);
+
+    /**
+     * @brief: 当前数据与 expected 指向同一个对象时，写入 desired
+     * @param: expected——期望的数据. 失败时被更新为当前数据
+     * @param: desired——拟写入的数据
+     * @return: true——写入成功 false——当前数据与 expected 不一致
+     */
+    bool compareExchange(sharedPtr& expected, sharedPtr desired);
+
+private:
+    typedef typename sharedPtr::Block Block;
+
+private:
+    // 从 SharedPtr 中取走控制块及其强引用
+    static Block* detach(sharedPtr& ptr);
+    // [epoch 回收函数] 释放控制块上由 AtomicSharedPtr 持有的强引用
+    static void releaseLater(void* block);
+    // 延迟释放一个强引用
+    static void retire(Block* block);
+
+private:
+    // 当前数据的控制块，AtomicSharedPtr 持有其一个强引用
+    std::atomic<Block*> m_block;
+};
+
+template <typename T, class Count>
+AtomicSharedPtr<T, Count>::AtomicSharedPtr(sharedPtr desired):m_block(AtomicSharedPtr::detach(desired)){}
+
+template <typename T, class Count>
+AtomicSharedPtr<T, Count>::~AtomicSharedPtr(){
+    Block* block = this->m_block.load();
+    if (block){
+        Block::releaseStrong(block);
+    }
+}
+
+/**
+ * @brief: 原子读取
+ * 1）进入 epoch 临界区，读取当前控制块
+ * 2）强引用计数加一. 即便控制块已被并发替换，AtomicSharedPtr 持有的强引用也要等到当前线程离开临界区后才会释放
+ */
+template <typename T, class Count>
+typename AtomicSharedPtr<T, Count>::sharedPtr AtomicSharedPtr<T, Count>::load() const{
+    sync::Epoch::Guard guard;
+    Block* block = this->m_block.load(std::memory_order_acquire);
+    if (block == nullptr){
+        return sharedPtr();
+    }
+    block->strong.increment();
+    return sharedPtr(block->ptr, block);
+}
+
+template <typename T, class Count>
+void AtomicSharedPtr<T, Count>::store(sharedPtr desired){
+    Block* old = this->m_block.exchange(AtomicSharedPtr::detach(desired), std::memory_order_acq_rel);
+    AtomicSharedPtr::retire(old);
+}
+
+/**
+ * @brief: 原子写入，返回写入前的数据
+ * 返回给调用方的是一个新增的强引用，AtomicSharedPtr 原本持有的强引用仍然延迟释放.
+ * 若直接将原有的强引用转交给调用方，调用方随即释放时对象可能在并发的 load 加一之前就被析构
+ */
+template <typename T, class Count>
+typename AtomicSharedPtr<T, Count>::sharedPtr AtomicSharedPtr<T, Count>::exchange(sharedPtr desired){
+    Block* old = this->m_block.exchange(AtomicSharedPtr::detach(desired), std::memory_order_acq_rel);
+    if (old == nullptr){
+        return sharedPtr();
+    }
+    old->strong.increment();
+    sharedPtr prev(old->ptr, old);
+    AtomicSharedPtr::retire(old);
+    return prev;
+}
+
+/**
+ * @brief: 比较并交换
+ * 1）以控制块地址作为比较依据，expected 与当前数据指向同一个控制块时，将其替换为 desired 的控制块
+ * 2）成功时 desired 的强引用转交给 AtomicSharedPtr，原有的强引用延迟释放
+ * 3）失败时 desired 保持不变，expected 更新为当前数据
+ */
+template <typename T, class Count>
+bool AtomicSharedPtr<T, Count>::compareExchange(sharedPtr& expected, sharedPtr desired){
+    Block* current = expected.m_block;
+    Block* next = desired.m_block;
+    if (this->m_block.compare_exchange_strong(current, next, std::memory_order_acq_rel, std::memory_order_acquire)){
+        AtomicSharedPtr::detach(desired);
+        AtomicSharedPtr::retire(current);
+        return true;
+    }
+
+    expected = this->load();
+    return false;
+}
+
+template <typename T, class Count>
+typename AtomicSharedPtr<T, Count>::Block* AtomicSharedPtr<T, Count>::detach(sharedPtr& ptr){
+    Block* block = ptr.m_block;
+    ptr.m_ptr = nullptr;
+    ptr.m_block = nullptr;
+    return block;
+}
+
+template <typename T, class Count>
+void AtomicSharedPtr<T, Count>::releaseLater(void* block){
+    Block::releaseStrong(static_cast<Block*>(block));
+}
+
+template <typename T, class Count>
+void AtomicSharedPtr<T, Count>::retire(Block* block){
+    if (block){
+        sync::Epoch::Retire(block, &AtomicSharedPtr::releaseLater);
+    }
+}
+
+}}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <utility>
+
+#include "refcount.h"
+
+namespace cbricks{ namespace memory{
+
+/**
+ * @brief: 侵入式引用计数的基类
+ * 引用计数存放在对象内部，对象与计数只需一次内存分配，访问计数也不会产生额外的 cache miss
+ * @param: T——派生类类型，计数归零时以 T* 的类型析构
+ * @param: Count——计数策略，默认为原子计数. 仅在单个线程内使用的对象可以指定为 PlainCount
+ */
+template <typename T, class Count = AtomicCount>
+class RefCounted{
+public:
+    // 增加一个引用
+    void addRef() const{
+        this->m_refs.increment();
+    }
+
+    // 释放一个引用. 计数归零时析构对象
+    void releaseRef() const{
+        if (this->m_refs.decrement() == 0){
+            delete static_cast<const T*>(this);
+        }
+    }
+
+    // 当前对象被多少指针引用
+    int refCount() const{
+        return this->m_refs.load();
+    }
+
+protected:
+    RefCounted():m_refs(0){}
+    // 拷贝对象时不拷贝计数
+    RefCounted(const RefCounted&):m_refs(0){}
+    RefCounted& operator=(const RefCounted&){
+        return *this;
+    }
+    ~RefCounted() = default;
+
+private:
+    mutable Count m_refs;
+};
+
+/**
+ * @brief: 侵入式智能指针
+ * 要求 T 提供 addRef、releaseRef 方法，通常通过继承 RefCounted<T> 获得.
+ * 由于计数存放在对象内部，可以随时从裸指针重新构造出 IntrusivePtr，不会产生多套计数
+ */
+template <typename T>
+class IntrusivePtr{
+public:
+    /**
+     * 构造&析构函数
+     */
+    // 基础构造函数. 接管裸指针，计数加一
+    IntrusivePtr(T* ptr = nullptr):m_ptr(ptr){
+        if (this->m_ptr){
+            this->m_ptr->addRef();
+        }
+    }
+
+    // 拷贝构造函数
+    IntrusivePtr(const IntrusivePtr<T>& other):IntrusivePtr(other.m_ptr){}
+
+    // 移动构造函数. 直接转移引用，不修改计数
+    IntrusivePtr(IntrusivePtr<T>&& other):m_ptr(other.m_ptr){
+        other.m_ptr = nullptr;
+    }
+
+    // 析构函数
+    ~IntrusivePtr(){
+        if (this->m_ptr){
+            this->m_ptr->releaseRef();
+        }
+    }
+
+public:
+    /**
+     * 公有方法
+     */
+    // = 赋值操作符重载. 通过拷贝再交换实现，自赋值时也是安全的
+    IntrusivePtr<T>& operator=(const IntrusivePtr<T>& other){
+        IntrusivePtr<T>(other).swap(*this);
+        return *this;
+    }
+
+    // 移动赋值
+    IntrusivePtr<T>& operator=(IntrusivePtr<T>&& other){
+        IntrusivePtr<T>(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    // * 操作符重载
+    T& operator*() const{
+        return *this->m_ptr;
+    }
+
+    // -> 操作符重载
+    T* operator->() const{
+        return this->m_ptr;
+    }
+
+    T* get() const{
+        return this->m_ptr;
+    }
+
+    explicit operator bool() const{
+        return this->m_ptr != nullptr;
+    }
+
+    // 重置指针
+    void reset(T* ptr = nullptr){
+        IntrusivePtr<T>(ptr).swap(*this);
+    }
+
+    void swap(IntrusivePtr<T>& other){
+        std::swap(this->m_ptr, other.m_ptr);
+    }
+
+private:
+    T* m_ptr;
+};
+
+// 构造对象并返回对应的侵入式智能指针
+template <typename T, typename... Args>
+IntrusivePtr<T> makeIntrusive(Args&&... args){
+    return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+}
+
+}}
@@ -1,11 +1,35 @@
 #pragma once 
 
-#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "refcount.h"
 
 namespace cbricks{ namespace memory{
 
-// 共享智能指针
-template <typename T>
+template <typename T, class Count>
+class SharedPtr;
+
+template <typename T, class Count>
+class WeakPtr;
+
+template <typename T, class Count>
+class AtomicSharedPtr;
+
+/**
+ * @brief: 构造对象并返回对应的共享智能指针
+ * 对象与引用计数所在的控制块通过一次内存分配获得，相比 SharedPtr<T>(new T) 少一次分配，访问计数时也不会产生额外的 cache miss
+ * @param: Count——计数策略，默认为原子计数. 仅在单个线程内使用的对象可以指定为 PlainCount
+ */
+template <typename T, class Count = AtomicCount, typename... Args>
+SharedPtr<T, Count> makeShared(Args&&... args);
+
+/**
+ * 共享智能指针
+ * @param: Count——计数策略，默认为原子计数. 仅在单个线程内使用的对象可以指定为 PlainCount
+ */
+template <typename T, class Count = AtomicCount>
 class SharedPtr{
 public:
     /**
@@ -14,7 +38,9 @@ public:
     // 基础构造函数
     explicit SharedPtr(T* ptr = nullptr);
     // 拷贝构造函数
-    SharedPtr(const SharedPtr<T>& other);
+    SharedPtr(const SharedPtr<T, Count>& other);
+    // 移动构造函数. 直接转移引用，不修改计数
+    SharedPtr(SharedPtr<T, Count>&& other);
     // 析构函数
     ~SharedPtr();
 
@@ -23,12 +49,15 @@ public:
      * 公有方法
      */
     // = 赋值操作符重载
-    SharedPtr<T>& operator=(const SharedPtr<T>& other);
+    SharedPtr<T, Count>& operator=(const SharedPtr<T, Count>& other);
+    // 移动赋值
+    SharedPtr<T, Count>& operator=(SharedPtr<T, Count>&& other);
     // * 操作符重载
     T& operator*();
     // -> 操作符重载
     T* operator->();
     T* get();
+    explicit operator bool() const;
 
     // 重置指针
     void reset();
@@ -37,153 +66,322 @@ public:
     int use_count();
 
 private:
+    /**
+     * 控制块. 存放引用计数，并负责析构对象
+     * - strong：强引用计数，归零时析构对象
+     * - weak：弱引用计数. 所有强引用共同持有一个弱引用，因此强引用全部释放后才可能归零，归零时回收控制块
+     */
+    struct Block{
+        Block():ptr(nullptr),strong(1),weak(1){}
+        virtual ~Block() = default;
+        // 析构所管理的对象
+        virtual void dispose() = 0;
+
+        // 释放一个强引用
+        static void releaseStrong(Block* block){
+            if (block->strong.decrement() > 0){
+                return;
+            }
+            block->dispose();
+            Block::releaseWeak(block);
+        }
+
+        // 释放一个弱引用
+        static void releaseWeak(Block* block){
+            if (block->weak.decrement() == 0){
+                delete block;
+            }
+        }
+
+        T* ptr;
+        Count strong;
+        Count weak;
+    };
+
+    // 管理外部传入裸指针的控制块
+    struct PtrBlock : Block{
+        explicit PtrBlock(T* ptr){
+            this->ptr = ptr;
+        }
+        void dispose() override{
+            delete this->ptr;
+        }
+    };
+
+    // 对象内嵌在控制块中，由 makeShared 使用
+    struct InplaceBlock : Block{
+        template <typename... Args>
+        explicit InplaceBlock(Args&&... args){
+            this->ptr = new (&this->storage) T(std::forward<Args>(args)...);
+        }
+        void dispose() override{
+            this->ptr->~T();
+        }
+
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    friend class WeakPtr<T, Count>;
+    friend class AtomicSharedPtr<T, Count>;
+
+    template <typename U, class C, typename... Args>
+    friend SharedPtr<U, C> makeShared(Args&&... args);
+
+private:
+    SharedPtr(T* ptr, Block* block);
     void release();    
 
 private:
     T* m_ptr;
-    std::atomic<int>* m_cnt;
+    Block* m_block;
 };
 
 /**
  * 构造&析构函数
  */
 // 基础构造函数
-template<typename T>
-SharedPtr<T>::SharedPtr(T* ptr):m_ptr(ptr),m_cnt(ptr != nullptr ? new std::atomic<int>(1) : nullptr){}
+template<typename T, class Count>
+SharedPtr<T, Count>::SharedPtr(T* ptr):m_ptr(ptr),m_block(ptr != nullptr ? new PtrBlock(ptr) : nullptr){}
+
+template<typename T, class Count>
+SharedPtr<T, Count>::SharedPtr(T* ptr, Block* block):m_ptr(ptr),m_block(block){}
 
 // 拷贝构造函数
-template<typename T>
-SharedPtr<T>::SharedPtr(const SharedPtr<T>& other):m_ptr(other.m_ptr),m_cnt(other.m_cnt){
-    if (this->m_cnt == nullptr){
+template<typename T, class Count>
+SharedPtr<T, Count>::SharedPtr(const SharedPtr<T, Count>& other):m_ptr(other.m_ptr),m_block(other.m_block){
+    if (this->m_block == nullptr){
         return;
     }
-    ++(*this->m_cnt);
+    this->m_block->strong.increment();
+}
+
+// 移动构造函数
+template<typename T, class Count>
+SharedPtr<T, Count>::SharedPtr(SharedPtr<T, Count>&& other):m_ptr(other.m_ptr),m_block(other.m_block){
+    other.m_ptr = nullptr;
+    other.m_block = nullptr;
 }
 
 // 析构函数
-template<typename T>
-SharedPtr<T>::~SharedPtr(){
+template<typename T, class Count>
+SharedPtr<T, Count>::~SharedPtr(){
     this->release();
 }
 
 // 赋值操作符重载
-template<typename T>
-SharedPtr<T>& SharedPtr<T>::operator=(const SharedPtr<T>& other){
+template<typename T, class Count>
+SharedPtr<T, Count>& SharedPtr<T, Count>::operator=(const SharedPtr<T, Count>& other){
     if (this == &other){
         return *this;
     }
 
+    // 先增加新对象的引用再释放旧对象，other 由旧对象间接持有时也是安全的
+    if (other.m_block != nullptr){
+        other.m_block->strong.increment();
+    }
     this->release();
     this->m_ptr = other.m_ptr;
-    this->m_cnt = other.m_cnt;
-    if (this->m_cnt == nullptr){
+    this->m_block = other.m_block;
+    return *this;
+}
+
+// 移动赋值
+template<typename T, class Count>
+SharedPtr<T, Count>& SharedPtr<T, Count>::operator=(SharedPtr<T, Count>&& other){
+    if (this == &other){
         return *this;
     }
-    ++(*this->m_cnt);
+
+    // 先从 other 中取走引用再释放旧对象，other 由旧对象间接持有时，释放后不会再访问到 other
+    T* ptr = other.m_ptr;
+    Block* block = other.m_block;
+    other.m_ptr = nullptr;
+    other.m_block = nullptr;
+    this->release();
+    this->m_ptr = ptr;
+    this->m_block = block;
     return *this;
 }
 
 // * 操作符重载
-template<typename T>
-T& SharedPtr<T>::operator*(){
+template<typename T, class Count>
+T& SharedPtr<T, Count>::operator*(){
     return *this->m_ptr;
 }
 
 // -> 操作符重载
-template<typename T>
-T* SharedPtr<T>::operator->(){
+template<typename T, class Count>
+T* SharedPtr<T, Count>::operator->(){
     return this->m_ptr;
 }
 
-template<typename T>
-T* SharedPtr<T>::get(){
+template<typename T, class Count>
+T* SharedPtr<T, Count>::get(){
     return this->m_ptr;
 }
 
+template<typename T, class Count>
+SharedPtr<T, Count>::operator bool() const{
+    return this->m_ptr != nullptr;
+}
+
 // 重置指针
-template<typename T>
-void SharedPtr<T>::reset(){
+template<typename T, class Count>
+void SharedPtr<T, Count>::reset(){
     this->release();
     this->m_ptr = nullptr;
-    this->m_cnt = nullptr;
+    this->m_block = nullptr;
 }
 
-template<typename T>
-void SharedPtr<T>::reset(T* ptr){
+template<typename T, class Count>
+void SharedPtr<T, Count>::reset(T* ptr){
     this->release();
     this->m_ptr = ptr;
-    this->m_cnt = new std::atomic<int>(1);
+    this->m_block = ptr != nullptr ? new PtrBlock(ptr) : nullptr;
 }
 
-template<typename T>
-int SharedPtr<T>::use_count(){
-    if (this->m_cnt == nullptr){
+template<typename T, class Count>
+int SharedPtr<T, Count>::use_count(){
+    if (this->m_block == nullptr){
         return 0;
     }
-    return this->m_cnt->load();
+    return this->m_block->strong.load();
 }
 
-template<typename T>
-void SharedPtr<T>::release(){
-    if (this->m_cnt == nullptr){
+template<typename T, class Count>
+void SharedPtr<T, Count>::release(){
+    if (this->m_block == nullptr){
         return;
     }
-    if (--(*this->m_cnt) > 0){
-        return;
-    }
-    delete this->m_ptr;
-    delete this->m_cnt;
+    Block::releaseStrong(this->m_block);
+}
+
+template <typename T, class Count, typename... Args>
+SharedPtr<T, Count> makeShared(Args&&... args){
+    typedef typename SharedPtr<T, Count>::InplaceBlock block;
+    block* b = new block(std::forward<Args>(args)...);
+    return SharedPtr<T, Count>(b->ptr, b);
 }
 
-template<typename T>
+/**
+ * 弱引用智能指针
+ * 不影响对象的生命周期，只持有控制块的弱引用. 对象析构后控制块仍然有效，因此可以安全地判断对象是否过期
+ */
+template<typename T, class Count = AtomicCount>
 class WeakPtr{
 public:
     /**
      * 构造 析构
      */
-    WeakPtr(const SharedPtr<T>& other);
-    WeakPtr(const WeakPtr<T>& other);
-    ~WeakPtr() = default;
+    WeakPtr();
+    WeakPtr(const SharedPtr<T, Count>& other);
+    WeakPtr(const WeakPtr<T, Count>& other);
+    WeakPtr(WeakPtr<T, Count>&& other);
+    ~WeakPtr();
 
 public:
     // 公有方法
-    WeakPtr<T>& operator=(const WeakPtr<T>& other);
+    WeakPtr<T, Count>& operator=(const WeakPtr<T, Count>& other);
+    WeakPtr<T, Count>& operator=(WeakPtr<T, Count>&& other);
     // 判断观察的对象是否过期
     bool expired();
-    // 获取观察的对象
-    SharedPtr<T> lock();
+    // 获取观察的对象. 对象已过期时返回空指针
+    SharedPtr<T, Count> lock();
+    // 重置为空
+    void reset();
+
+private:
+    typedef typename SharedPtr<T, Count>::Block Block;
 
 private:
-    SharedPtr<T>& m_ptr;
+    T* m_ptr;
+    Block* m_block;
 };
 
-template <typename T>
-WeakPtr<T>::WeakPtr(const SharedPtr<T>& other):m_ptr(other){}
+template <typename T, class Count>
+WeakPtr<T, Count>::WeakPtr():m_ptr(nullptr),m_block(nullptr){}
 
-template <typename T>
-WeakPtr<T>::WeakPtr(const WeakPtr<T>& other):m_ptr(other.m_ptr){}
+template <typename T, class Count>
+WeakPtr<T, Count>::WeakPtr(const SharedPtr<T, Count>& other):m_ptr(other.m_ptr),m_block(other.m_block){
+    if (this->m_block){
+        this->m_block->weak.increment();
+    }
+}
+
+template <typename T, class Count>
+WeakPtr<T, Count>::WeakPtr(const WeakPtr<T, Count>& other):m_ptr(other.m_ptr),m_block(other.m_block){
+    if (this->m_block){
+        this->m_block->weak.increment();
+    }
+}
+
+template <typename T, class Count>
+WeakPtr<T, Count>::WeakPtr(WeakPtr<T, Count>&& other):m_ptr(other.m_ptr),m_block(other.m_block){
+    other.m_ptr = nullptr;
+    other.m_block = nullptr;
+}
+
+template <typename T, class Count>
+WeakPtr<T, Count>::~WeakPtr(){
+    this->reset();
+}
 
-template <typename T>
-WeakPtr<T>& WeakPtr<T>::operator=(const WeakPtr<T>& other){
+template <typename T, class Count>
+WeakPtr<T, Count>& WeakPtr<T, Count>::operator=(const WeakPtr<T, Count>& other){
     if (this == &other){
         return *this;
     }
 
+    if (other.m_block){
+        other.m_block->weak.increment();
+    }
+    this->reset();
     this->m_ptr = other.m_ptr;
+    this->m_block = other.m_block;
     return *this;
 }
 
-template <typename T>
-bool WeakPtr<T>::expired(){
-    return this->m_ptr == nullptr;
-}
+template <typename T, class Count>
+WeakPtr<T, Count>& WeakPtr<T, Count>::operator=(WeakPtr<T, Count>&& other){
+    if (this == &other){
+        return *this;
+    }
 
-template <typename T>
-SharedPtr<T> WeakPtr<T>::lock(){
-    return nullptr;
+    // 与 SharedPtr 的移动赋值一致，先从 other 中取走引用再释放旧的弱引用
+    T* ptr = other.m_ptr;
+    Block* block = other.m_block;
+    other.m_ptr = nullptr;
+    other.m_block = nullptr;
+    this->reset();
+    this->m_ptr = ptr;
+    this->m_block = block;
+    return *this;
 }
 
+template <typename T, class Count>
+bool WeakPtr<T, Count>::expired(){
+    return this->m_block == nullptr || this->m_block->strong.load() == 0;
+}
 
+/**
+ * @brief: 获取观察的对象
+ * 强引用计数不为零时才能加一，计数一旦归零就不会再被复活，避免与析构流程竞争
+ */
+template <typename T, class Count>
+SharedPtr<T, Count> WeakPtr<T, Count>::lock(){
+    if (this->m_block == nullptr || !this->m_block->strong.incrementIfNonZero()){
+        return SharedPtr<T, Count>();
+    }
+    return SharedPtr<T, Count>(this->m_ptr, this->m_block);
+}
 
+template <typename T, class Count>
+void WeakPtr<T, Count>::reset(){
+    if (this->m_block){
+        Block::releaseWeak(this->m_block);
+    }
+    this->m_ptr = nullptr;
+    this->m_block = nullptr;
+}
 
-}}
\ No newline at end of file
+}}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+
+namespace cbricks{ namespace memory{
+
+/**
+ * 引用计数策略，作为 SharedPtr、RefCounted 的模板参数
+ * 需要提供：
+ *  - 以初始值构造
+ *  - void increment()：计数加一
+ *  - int decrement()：计数减一，返回减一后的值
+ *  - int load() const：读取当前计数
+ *  - bool incrementIfNonZero()：计数不为零时加一，返回是否成功. 用于由弱引用获取强引用
+ */
+
+// 原子计数. 默认策略，对象可以在多个线程之间共享
+struct AtomicCount{
+    explicit AtomicCount(const int n = 0):m_n(n){}
+
+    void increment(){
+        // 增加引用时调用方已经持有一个引用，对象不会被并发析构，无需额外的内存序
+        this->m_n.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int decrement(){
+        // 释放引用前对对象的读写，必须对最终执行析构的线程可见
+        return this->m_n.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+
+    int load() const{
+        return this->m_n.load(std::memory_order_acquire);
+    }
+
+    bool incrementIfNonZero(){
+        int n = this->m_n.load(std::memory_order_relaxed);
+        while (n != 0){
+            if (this->m_n.compare_exchange_weak(n, n + 1, std::memory_order_acq_rel, std::memory_order_relaxed)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::atomic<int> m_n;
+};
+
+// 普通整型计数. 适用于只在单个线程内使用的对象，避免原子操作带来的总线锁开销
+struct PlainCount{
+    explicit PlainCount(const int n = 0):m_n(n){}
+
+    void increment(){
+        this->m_n++;
+    }
+
+    int decrement(){
+        return --this->m_n;
+    }
+
+    int load() const{
+        return this->m_n;
+    }
+
+    bool incrementIfNonZero(){
+        if (this->m_n == 0){
+            return false;
+        }
+        this->m_n++;
+        return true;
+    }
+
+private:
+    int m_n;
+};
+
+}}
@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <atomic>
+
+#include "slab.h"
+#include "../sync/lock.h"
+#include "../trace/assert.h"
+
+namespace cbricks{namespace memory{
+
+// 空闲对象的头部复用为链表指针
+struct FreeObject{
+    FreeObject* next;
+};
+
+/**
+ * 某个 size class 对应的中心空闲链表
+ * 线程本地的计数在批量交互时累加到 allocs/frees 中
+ */
+struct CentralList{
+    sync::SpinLock lock;
+    FreeObject* head = nullptr;
+    size_t size = 0;
+    std::atomic<uint64_t> allocs{0};
+    std::atomic<uint64_t> frees{0};
+    // 填充字节，避免相邻 class 之间伪共享
+    char padding[64];
+};
+
+struct Central{
+    CentralList lists[Slab::NUM_CLASSES];
+    // 向系统申请的 span 总字节数
+    std::atomic<size_t> reserved{0};
+};
+
+/**
+ * 中心空闲链表. 线程退出时线程本地缓存需要归还对象，其他静态对象析构时也可能释放对象，
+ * 因此中心链表在首次使用时创建，此后不再回收
+ */
+static Central* central(){
+    static Central* c = new Central;
+    return c;
+}
+
+/**
+ * 线程本地缓存
+ * 线程退出时其他线程本地对象（例如 epoch、hazard pointer 的记录）的析构流程仍可能释放对象，而线程本地对象的析构顺序不可控，
+ * 因此缓存本身为平凡类型，在线程整个生命周期内有效；由单独的 ThreadCacheCleaner 负责在析构时归还所有对象并将其关闭
+ */
+struct ThreadCache{
+    struct List{
+        FreeObject* head;
+        uint32_t size;
+        // 尚未汇总到中心链表的计数
+        uint64_t allocs;
+        uint64_t frees;
+    };
+    List lists[Slab::NUM_CLASSES];
+    // 缓存是否已关闭. 关闭后直接与中心链表交互
+    bool closed;
+};
+
+static thread_local ThreadCache t_cache;
+
+// 线程本地计数累积到该值时汇总到中心链表，保证只在本地复用对象的线程的统计数据也能及时更新
+static const uint64_t FLUSH_THRESHOLD = 1024;
+
+struct ThreadCacheCleaner{
+    ~ThreadCacheCleaner();
+};
+
+static ThreadCache& threadCache(){
+    static thread_local ThreadCacheCleaner cleaner;
+    (void)cleaner;
+    return t_cache;
+}
+
+// 每次与中心链表交互的对象数量. 小对象一批多取一些，大对象少取一些，一批的总字节数约为 8KB
+static uint32_t batchOf(const int cls){
+    size_t batch = 8192 / Slab::ClassSize(cls);
+    if (batch < 4){
+        batch = 4;
+    }
+    if (batch > 64){
+        batch = 64;
+    }
+    return batch;
+}
+
+/**
+ * @brief: 从中心链表中批量获取对象
+ * @param: cls——size class
+ * @param: n——获取数量
+ * @param: allocs——汇总到中心链表的分配计数
+ * @return: 由 n 个对象构成的链表
+ * 中心链表中的对象不足时，申请一个新的 span 切分后补充
+ */
+static FreeObject* fetchFromCentral(const int cls, const uint32_t n, const uint64_t allocs){
+    CentralList& list = central()->lists[cls];
+    list.allocs.fetch_add(allocs, std::memory_order_relaxed);
+
+    sync::SpinLock::lockGuard guard(list.lock);
+    if (list.size < n){
+        size_t size = Slab::ClassSize(cls);
+        char* span = static_cast<char*>(malloc(Slab::SPAN_SIZE));
+        CBRICKS_ASSERT(span != nullptr, "malloc fail");
+        central()->reserved.fetch_add(Slab::SPAN_SIZE, std::memory_order_relaxed);
+        for (size_t offset = 0; offset + size <= Slab::SPAN_SIZE; offset += size){
+            FreeObject* obj = reinterpret_cast<FreeObject*>(span + offset);
+            obj->next = list.head;
+            list.head = obj;
+            list.size++;
+        }
+    }
+
+    FreeObject* head = list.head;
+    FreeObject* tail = head;
+    for (uint32_t i = 1; i < n; i++){
+        tail = tail->next;
+    }
+    list.head = tail->next;
+    list.size -= n;
+    tail->next = nullptr;
+    return head;
+}
+
+/**
+ * @brief: 批量归还对象到中心链表
+ * @param: head/tail——待归还链表的首尾节点
+ * @param: n——归还数量
+ * @param: frees——汇总到中心链表的释放计数
+ */
+static void releaseToCentral(const int cls, FreeObject* head, FreeObject* tail, const uint32_t n, const uint64_t frees){
+    CentralList& list = central()->lists[cls];
+    list.frees.fetch_add(frees, std::memory_order_relaxed);
+
+    sync::SpinLock::lockGuard guard(list.lock);
+    tail->next = list.head;
+    list.head = head;
+    list.size += n;
+}
+
+// 线程退出时，将本地缓存的对象与计数全部归还到中心链表，此后的分配与释放直接与中心链表交互
+ThreadCacheCleaner::~ThreadCacheCleaner(){
+    for (int cls = 0; cls < Slab::NUM_CLASSES; cls++){
+        ThreadCache::List& local = t_cache.lists[cls];
+        if (local.head){
+            FreeObject* tail = local.head;
+            while (tail->next){
+                tail = tail->next;
+            }
+            releaseToCentral(cls, local.head, tail, local.size, local.frees);
+        } else{
+            central()->lists[cls].frees.fetch_add(local.frees, std::memory_order_relaxed);
+        }
+        central()->lists[cls].allocs.fetch_add(local.allocs, std::memory_order_relaxed);
+        local.head = nullptr;
+        local.size = local.allocs = local.frees = 0;
+    }
+    t_cache.closed = true;
+}
+
+/**
+ * @brief: 分配内存
+ * 1）超过 MAX_SIZE 的请求直接使用 ::operator new
+ * 2）从线程本地链表中弹出一个对象
+ * 3）本地链表为空时，从中心链表批量获取 batch 个对象
+ */
+void* Slab::Allocate(const size_t size){
+    if (size > MAX_SIZE){
+        return ::operator new(size);
+    }
+
+    int cls = Slab::ClassOf(size);
+    ThreadCache& cache = threadCache();
+    if (cache.closed){
+        return fetchFromCentral(cls, 1, 1);
+    }
+
+    ThreadCache::List& local = cache.lists[cls];
+    if (!local.head){
+        uint32_t batch = batchOf(cls);
+        local.head = fetchFromCentral(cls, batch, local.allocs);
+        local.size = batch;
+        local.allocs = 0;
+    }
+
+    FreeObject* obj = local.head;
+    local.head = obj->next;
+    local.size--;
+    if (++local.allocs >= FLUSH_THRESHOLD){
+        central()->lists[cls].allocs.fetch_add(local.allocs, std::memory_order_relaxed);
+        local.allocs = 0;
+    }
+    return obj;
+}
+
+/**
+ * @brief: 释放内存
+ * 1）超过 MAX_SIZE 的请求直接使用 ::operator delete
+ * 2）放入线程本地链表
+ * 3）本地链表超过 2 * batch 时，将 batch 个对象批量归还到中心链表
+ */
+void Slab::Deallocate(void* ptr, const size_t size){
+    if (!ptr){
+        return;
+    }
+    if (size > MAX_SIZE){
+        ::operator delete(ptr);
+        return;
+    }
+
+    int cls = Slab::ClassOf(size);
+    FreeObject* obj = static_cast<FreeObject*>(ptr);
+    ThreadCache& cache = threadCache();
+    if (cache.closed){
+        releaseToCentral(cls, obj, obj, 1, 1);
+        return;
+    }
+
+    ThreadCache::List& local = cache.lists[cls];
+    obj->next = local.head;
+    local.head = obj;
+    local.size++;
+    local.frees++;
+
+    uint32_t batch = batchOf(cls);
+    if (local.size > 2 * batch){
+        FreeObject* head = local.head;
+        FreeObject* tail = head;
+        for (uint32_t i = 1; i < batch; i++){
+            tail = tail->next;
+        }
+        local.head = tail->next;
+        local.size -= batch;
+        releaseToCentral(cls, head, tail, batch, local.frees);
+        local.frees = 0;
+    } else if (local.frees >= FLUSH_THRESHOLD){
+        central()->lists[cls].frees.fetch_add(local.frees, std::memory_order_relaxed);
+        local.frees = 0;
+    }
+}
+
+// 统计数据
+Slab::Stats Slab::Statistics(){
+    Stats stats = {0, 0, 0, 0, 0};
+    Central* c = central();
+    for (int cls = 0; cls < NUM_CLASSES; cls++){
+        uint64_t allocs = c->lists[cls].allocs.load(std::memory_order_relaxed);
+        uint64_t frees = c->lists[cls].frees.load(std::memory_order_relaxed);
+        stats.allocs += allocs;
+        stats.frees += frees;
+        if (allocs > frees){
+            stats.inUseBytes += (allocs - frees) * Slab::ClassSize(cls);
+        }
+    }
+    stats.reservedBytes = c->reserved.load(std::memory_order_relaxed);
+    if (stats.reservedBytes > 0 && stats.inUseBytes <= stats.reservedBytes){
+        stats.fragmentation = 1 - (double)stats.inUseBytes / stats.reservedBytes;
+    }
+    return stats;
+}
+
+/**
+ * @brief: 字节数对应的 size class
+ * - (0, 256]：以 16 字节为步长，共 16 个 class
+ * - (256, 1024]：以 128 字节为步长，共 6 个 class
+ * - (1024, 2048]：以 256 字节为步长，共 4 个 class
+ */
+int Slab::ClassOf(const size_t size){
+    if (size <= 256){
+        return size == 0 ? 0 : (size + 15) / 16 - 1;
+    }
+    if (size <= 1024){
+        return 16 + (size - 256 + 127) / 128 - 1;
+    }
+    return 22 + (size - 1024 + 255) / 256 - 1;
+}
+
+size_t Slab::ClassSize(const int cls){
+    if (cls < 16){
+        return (cls + 1) * 16;
+    }
+    if (cls < 22){
+        return 256 + (cls - 15) * 128;
+    }
+    return 1024 + (cls - 21) * 256;
+}
+
+}}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+namespace cbricks{namespace memory{
+
+/**
+ * @brief: 面向小对象的 size class slab 分配器
+ * 核心思路：
+ *  - 不超过 MAX_SIZE 的分配请求按照大小向上取整到 size class，同一 class 的对象大小相同，释放后可以直接复用
+ *  - 每个线程为各 class 维护一条本地空闲链表，分配与释放只操作本地链表，不加锁也不访问共享变量
+ *  - 本地链表为空时，从中心空闲链表批量获取 batch 个对象；本地链表超过 2 * batch 时，批量归还 batch 个对象.
+ *    每次与中心链表交互时才需要加锁，锁的开销被一整批对象平摊
+ *  - 中心链表为空时，向系统申请 SPAN_SIZE 大小的 span 并切分为对象. span 不会归还给系统
+ *  - 超过 MAX_SIZE 的请求直接使用 ::operator new / ::operator delete
+ * 释放时需要传入分配时的字节数，由 sized operator delete 或者 stl 分配器提供
+ */
+class Slab{
+public:
+    // 由 slab 管理的最大对象字节数
+    static const size_t MAX_SIZE = 2048;
+    // size class 数量
+    static const int NUM_CLASSES = 26;
+    // 向系统申请内存的单位
+    static const size_t SPAN_SIZE = 64 * 1024;
+
+    // 分配器的统计数据. 线程本地的计数在与中心链表交互时汇总，因此为近似值
+    struct Stats{
+        // 累计分配次数
+        uint64_t allocs;
+        // 累计释放次数
+        uint64_t frees;
+        // 向系统申请的 span 总字节数
+        size_t reservedBytes;
+        // 正在使用中的对象总字节数（按 size class 计算）
+        size_t inUseBytes;
+        // 碎片率，即 span 中未被使用的字节占比，包含线程本地链表与中心链表中缓存的对象
+        double fragmentation;
+    };
+
+public:
+    /**
+     * @brief: 分配内存
+     * @param: size——字节数
+     * @return: 内存起始地址，按照 16 字节对齐
+     */
+    static void* Allocate(const size_t size);
+
+    /**
+     * @brief: 释放内存
+     * @param: ptr——Allocate 返回的地址
+     * @param: size——分配时的字节数
+     */
+    static void Deallocate(void* ptr, const size_t size);
+
+    // 统计数据
+    static Stats Statistics();
+
+    // 字节数对应的 size class
+    static int ClassOf(const size_t size);
+    // size class 对应的对象字节数
+    static size_t ClassSize(const int cls);
+};
+
+/**
+ * @brief: 使用 slab 分配内存的基类. 继承该类即可让 new/delete 使用 slab 分配器
+ * 析构函数为 virtual 的派生类，sized operator delete 接收到的是实际对象的字节数
+ */
+class SlabObject{
+public:
+    static void* operator new(size_t size){
+        return Slab::Allocate(size);
+    }
+
+    static void operator delete(void* ptr, size_t size){
+        Slab::Deallocate(ptr, size);
+    }
+};
+
+/**
+ * @brief: 使用 slab 分配内存的 stl 分配器. 无状态，可配合 std::allocate_shared 使对象与控制块一同从 slab 中分配
+ */
+template <class T>
+class SlabAllocator{
+public:
+    typedef T value_type;
+
+    template <class U>
+    struct rebind{
+        typedef SlabAllocator<U> other;
+    };
+
+public:
+    SlabAllocator() = default;
+
+    template <class U>
+    SlabAllocator(const SlabAllocator<U>&){}
+
+public:
+    T* allocate(const size_t n){
+        return static_cast<T*>(Slab::Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, const size_t n){
+        Slab::Deallocate(ptr, n * sizeof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const SlabAllocator<T>&, const SlabAllocator<U>&){
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const SlabAllocator<T>&, const SlabAllocator<U>&){
+    return false;
+}
+
+}}
@@ -1,3 +1,4 @@
+#include <sched.h>
 #include <thread>
 
 #include "instancepool.h"
@@ -8,13 +9,33 @@ namespace cbricks{namespace pool{
 /**
  * @brief：构造函数
  * @param：_constructF——实例构造函数
- * @param：level——资源粒度分级，默认分成 8 份
+ * @param：level——资源粒度分级，默认为 0，表示与 CPU 核数保持一致
  * @param：expDuration——过期回收时间，表示 instance 在对象池中闲置多长时间后会被自动回收
+ * @param：maxIdle——闲置 instance 数量上限，0 表示不限制. 上限在各 level 之间均分
+ * @param：maxBytes——闲置 instance 占用字节数上限，0 表示不限制. 需要同时指定 instanceBytes
+ * @param：instanceBytes——单个 instance 占用的字节数，仅用于将 maxBytes 换算为数量上限
 */
-InstancePool::InstancePool(constructF _constructF, const int level, const ms expDuration):m_constructF(_constructF),m_levelSize(level){
+InstancePool::InstancePool(constructF _constructF, const int level, const ms expDuration, const size_t maxIdle, const size_t maxBytes, const size_t instanceBytes):m_constructF(_constructF),m_levelSize(level){
     CBRICKS_ASSERT(_constructF != nullptr, "constructor is empty");
-    CBRICKS_ASSERT(level > 0, "level is nonpositive");
+    CBRICKS_ASSERT(level >= 0, "level is negative");
+    if (this->m_levelSize == 0){
+        this->m_levelSize = std::thread::hardware_concurrency();
+        if (this->m_levelSize <= 0){
+            this->m_levelSize = 1;
+        }
+    }
     CBRICKS_ASSERT(expDuration.count(), "expDuration is nonpositive");
+    CBRICKS_ASSERT(maxBytes == 0 || instanceBytes > 0, "maxBytes requires instanceBytes");
+
+    // 字节数上限换算为数量上限，与 maxIdle 取较小者，再在各 level 之间均分（向上取整）
+    size_t cap = maxIdle;
+    if (maxBytes > 0){
+        size_t byBytes = maxBytes / instanceBytes;
+        if (cap == 0 || byBytes < cap){
+            cap = byBytes > 0 ? byBytes : 1;
+        }
+    }
+    this->m_levelCap = cap == 0 ? 0 : (cap + this->m_levelSize - 1) / this->m_levelSize;
 
     // evict thread 轮询间隔为用户设定 instance 过期时长 expDuration 的一半
     int64_t ecivtInterval = expDuration.count() / 2;
@@ -23,11 +44,10 @@ InstancePool::InstancePool(constructF _constructF, const int level, const ms exp
     }
     this->m_evictInterval = ms(ecivtInterval);
 
-    // 完成 local 中指定数量 levelPool 的初始化
-    this->m_local.reserve(level);
-    for (int i = 0; i < level; i++){
-        this->m_local.push_back(LevelPool::ptr(new LevelPool));
-    }
+    // 一次性完成两个代际中指定数量 levelPool 的初始化，此后只复用不再分配
+    this->m_generations[0].reset(new LevelPool[this->m_levelSize]);
+    this->m_generations[1].reset(new LevelPool[this->m_levelSize]);
+    this->m_stats.reset(new LevelStats[this->m_levelSize]);
 
     // 异步启动 evict thread
     thread thr(std::bind(&InstancePool::asyncEvict,this));
@@ -43,32 +63,42 @@ InstancePool::~InstancePool(){
 
 /**
  * @brief: 从 instance pool 中获取一个 instance 实例：
- *  - 0）根据 level 递增计数器，分配得到一个 level
- * - 针对 m_local 操作：
+ *  - 0）根据当前线程所在的 CPU 得到 level，不访问任何共享计数器
+ * - 读取一次 m_generation，得到本次使用的 local 与 victim 代际
+ * - 针对 local 操作：
  *  - 1）根据 level 获取对应的 levelPool
  *  - 2）尝试获取当前 levelPool 的 private instance（ 加 level 粒度 spinLock，只有同 level 下的 get 和 put 行为会发生竞争 ）
- *  - 3）尝试从当前 levelPool 的 shared 队列中获取 instance（加 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
- *  - 4） 尝试从其他 levelPool 的 shared 队列中获取 instance（加其他 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
+ *  - 3）尝试从当前 levelPool 的 shared 链表头部获取最近归还的 instance（同样在 level 粒度 spinLock 内进行）
+ *  - 4） 尝试从其他 levelPool 的 shared 链表尾部窃取 instance（无锁操作，不会因竞争而陷入内核态等待）
  *  - 5）使用 newFc 构造出新实例
- * - 针对 m_victim 操作：
+ * - 针对 victim 操作：
  *  - 6）根据 level 获取对应的 levelPool
  *  - 7）尝试获取当前 levelPool 的 private instance（ 加 level 粒度 spinLock，只有同 level 下的 get 和 put 行为会发生竞争 ）
- *  - 8）尝试从当前 levelPool 的 shared 队列中获取 instance（加 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
- *  - 9） 尝试从其他 levelPool 的 shared 队列中获取 instance（加其他 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
+ *  - 8）尝试从当前 levelPool 的 shared 链表头部获取最近归还的 instance（同样在 level 粒度 spinLock 内进行）
+ *  - 9） 尝试从其他 levelPool 的 shared 链表尾部窃取 instance（无锁操作，不会因竞争而陷入内核态等待）
  *  - 10）使用 newFc 构造出新实例
  * @return: 返回获取到的实例
  */
 Instance::ptr InstancePool::get(){
     // 获取 level 层级
-    int level = (this->m_level++)%this->m_levelSize;
-    // 从 m_local 中获取
-    Instance::ptr got = this->getFromPool(this->m_local,level);
+    int level = this->currentLevel();
+    this->m_stats[level].gets.fetch_add(1, std::memory_order_relaxed);
+    // 更新在用数量及本轮峰值. 峰值只增不减，直到 evict thread 在轮询时重置
+    int64_t outstanding = this->m_outstanding.fetch_add(1, std::memory_order_relaxed) + 1;
+    int64_t peak = this->m_peak.load(std::memory_order_relaxed);
+    while (outstanding > peak && !this->m_peak.compare_exchange_weak(peak, outstanding, std::memory_order_relaxed)){
+    }
+    // 读取一次代际下标，local 与 victim 始终来自同一次翻转
+    int generation = this->m_generation.load(std::memory_order_acquire);
+    // 从 local 中获取
+    Instance::ptr got = this->getFromPool(this->m_generations[generation].get(),level);
     if (!got){
-        // 从 m_victim 中获取
-        got = this->getFromPool(this->m_victim,level);
+        // 从 victim 中获取
+        got = this->getFromPool(this->m_generations[generation ^ 1].get(),level);
         if (!got){
             // 使用 constructF 兜底
             got = this->m_constructF();
+            this->m_stats[level].constructions.fetch_add(1, std::memory_order_relaxed);
         }
     }
 
@@ -80,35 +110,44 @@ Instance::ptr InstancePool::get(){
 /**
  * @brief：将一个 instance 归还回到 instancePool
  * @param: instance——归还的 instance
- * - 1）根据 level 递增计数器，分配得到一个 level
- * - 2）根据 level 从 m_local 获取对应的 levelPool
+ * - 1）根据当前线程所在的 CPU 得到 level
+ * - 2）根据 level 从当前 local 代际获取对应的 levelPool
  * - 3）尝试放置到当前 levelPool 的 private 中（ 加 level 粒度 spinLock，只有同 level 下的 get 和 put 行为会发生竞争 ）
- * - 4）放置到当前 levelPool 的 shared 队列（加 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
+ * - 4）放置到当前 levelPool 的 shared 链表头部（同样在 level 粒度 spinLock 内进行）
+ * 当前 level 的闲置数量达到上限时，instance 不再放回池中，由调用方释放最后一个引用时析构
  */
 void InstancePool::put(Instance::ptr instance){
+    int level = this->currentLevel();
+    LevelStats& stats = this->m_stats[level];
+    this->m_outstanding.fetch_sub(1, std::memory_order_relaxed);
+    // 闲置数量达到上限，直接丢弃. 检查与累加之间不加锁，上限允许被并发的 put 短暂突破
+    if (this->m_levelCap > 0 && stats.idle.load(std::memory_order_relaxed) >= (int64_t)this->m_levelCap){
+        stats.trimmed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    stats.idle.fetch_add(1, std::memory_order_relaxed);
+
     // 获取 level 层级对应的 levelPool
-    LevelPool::ptr levelPool = this->m_local[(this->m_level++)%this->m_levelSize];
-    {
-        // 加自旋锁并尝试放置到 levelPool->single
-        spinLock::lockGuard guard(levelPool->singleLock);
-        if (!levelPool->single){
-            levelPool->single = instance;
-            return;
-        }
+    LevelPool* levelPool = &this->m_generations[this->m_generation.load(std::memory_order_acquire)][level];
+    // 加自旋锁并尝试放置到 levelPool->single
+    spinLock::lockGuard guard(levelPool->ownerLock);
+    if (!levelPool->single){
+        levelPool->single = std::move(instance);
+        return;
     }
 
-    // 加互斥锁，并追加到 levelPool->shared 中
-    lock::lockGuard guard(levelPool->sharedLock);
-    levelPool->shared.push(instance);
+    // 追加到 levelPool->shared 头部
+    levelPool->shared.pushHead(std::move(instance));
 }
 
 /**
  * @brief: [异步执行] 定时清理达到过期时长的 instance
  * - 1）每隔 expDuration/2 执行一次
- * - 2）构造新的 m_local 实例
- * - 3）回收 m_victim
- * - 4）将前一轮的 m_local 变为 m_victim
- * - 5）将新的 m_local 变为 m_local
+ * - 2）在 evict thread 中清空当前的 victim 代际，instance 的析构不会发生在 get/put 的调用路径上
+ * - 3）根据本轮在用 instance 数量的峰值更新 EWMA，得到目标闲置数量，并以闲置数量上限为界. local 中超出目标的部分同样被回收.
+ *      峰值由 get 维护，evict thread 读取后重置为当前在用数量，作为下一轮峰值的起点
+ * - 4）原子地翻转 m_generation：前一轮的 local 变为 victim，清空后的 victim 复用为新的 local
+ * 两个代际的 levelPool 在构造时一次性分配，轮换过程不涉及任何内存分配
  */
 void InstancePool::asyncEvict(){
     // thread 退出前必须执行一次 sem.notify.
@@ -116,75 +155,146 @@ void InstancePool::asyncEvict(){
         this->m_sem.notify();
     });
 
+    uint64_t lastConstructions = 0;
+    double seconds = std::chrono::duration<double>(this->m_evictInterval).count();
+
     // 在 instance pool 未关闭前持续运行
     while (!this->m_closed.load()){
         // 每间隔 expDuration/2 执行一次
         std::this_thread::sleep_for(this->m_evictInterval);
 
-        // 构造新的 local
-        std::vector<LevelPool::ptr> newLocal;
-        newLocal.reserve(this->m_local.size());
-        for (int i = 0; i < this->m_local.size();i++){
-            newLocal.push_back(LevelPool::ptr(new LevelPool));
+        // 只有 evict thread 会修改 m_generation，因此可以直接读取
+        int generation = this->m_generation.load(std::memory_order_relaxed);
+
+        /**
+         * 清空 victim. 此时 put 只会写入 local，victim 中的 instance 均已闲置超过一个轮询间隔.
+         * 即便有线程在上一次翻转前读取了代际下标，向 victim 写入了 instance，也只是推迟到下一轮回收，不会访问到已释放的内存
+         */
+        this->drain(this->m_generations[generation ^ 1].get());
+
+        // 更新在用数量峰值的 EWMA 与构造速率. 一个轮询间隔内同时在用的峰值即为下一轮需要的闲置数量
+        uint64_t constructions = 0;
+        for (int i = 0; i < this->m_levelSize; i++){
+            constructions += this->m_stats[i].constructions.load(std::memory_order_relaxed);
+        }
+        // 取出本轮峰值，并以当前在用数量作为下一轮的起点. 调用方 put 了并非来自 get 的 instance 时计数可能为负，按 0 处理
+        int64_t peak = this->m_peak.exchange(this->m_outstanding.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        if (peak < 0){
+            peak = 0;
         }
+        // 超出闲置数量上限的峰值没有意义，put 时同样会被丢弃. 峰值先行截断，突发流量过后 EWMA 不必从远超上限的数值开始衰减
+        if (this->m_levelCap > 0 && (size_t)peak > this->m_levelCap * this->m_levelSize){
+            peak = this->m_levelCap * this->m_levelSize;
+        }
+        this->m_ewma = EWMA_ALPHA * peak + (1 - EWMA_ALPHA) * this->m_ewma;
+        this->m_constructRate.store((constructions - lastConstructions) / seconds, std::memory_order_relaxed);
+        lastConstructions = constructions;
+
+        // 峰值不超过闲置数量上限，EWMA 及目标闲置数量同样不会超过
+        size_t target = (size_t)(this->m_ewma + 0.5);
+        this->m_target.store(target, std::memory_order_relaxed);
 
-        // 新老 m_local/m_victim 轮换
-        this->m_victim = this->m_local;
-        this->m_local = newLocal;
+        // local 中超出目标的部分提前回收，突发流量过后不必等待 instance 过期
+        this->drain(this->m_generations[generation].get(), target);
+
+        // 新老 local/victim 轮换
+        this->m_generation.store(generation ^ 1, std::memory_order_release);
     }
 }
 
 /**
- * @brief: 从某个指定 levelPool 中获取 instance 实例
- * @param：levelPool——指定的 levelPool
- * @param：获取 instance 过程中，是否忽略 levelPool 中的 single instance 实例. 默认为 false
+ * @brief: 回收某个代际中的 instance 实例
+ * @param：pool——待回收的代际
+ * @param：keep——所有 level 合计保留的闲置数量，与闲置上限一样在各 level 之间均分（向上取整），各 level 只回收超出自身份额的部分.
+ * 若按照全局数量逐个 level 回收，突发流量过后下标靠前的 level 会被清空而靠后的 level 全部保留，映射到前者的 CPU 只能重新构造
  */
-Instance::ptr InstancePool::getFromLevelPool(LevelPool::ptr levelPool, bool ignoreSingle){
-    // 尝试从当前 levelPool 的 single 中获取 instance 实例
-    if (!ignoreSingle){
-        spinLock::lockGuard guard(levelPool->singleLock);
-        if (levelPool->single){
-            Instance::ptr got = levelPool->single;
-            levelPool->single = nullptr;
-            return got;
+void InstancePool::drain(LevelPool* pool, size_t keep){
+    const int64_t share = (keep + this->m_levelSize - 1) / this->m_levelSize;
+    for (int i = 0; i < this->m_levelSize; i++){
+        while (this->m_stats[i].idle.load(std::memory_order_relaxed) > share){
+            // 优先从 shared 尾部回收闲置最久的 instance，为空时再回收 single
+            Instance::ptr got = this->getFromLevelPool(&pool[i], true);
+            if (!got){
+                got = this->getFromLevelPool(&pool[i]);
+            }
+            if (!got){
+                break;
+            }
+            this->m_stats[i].idle.fetch_sub(1, std::memory_order_relaxed);
         }
     }
+}
+
+// 当前闲置的 instance 数量（近似值）
+size_t InstancePool::idle() const{
+    int64_t total = 0;
+    for (int i = 0; i < this->m_levelSize; i++){
+        total += this->m_stats[i].idle.load(std::memory_order_relaxed);
+    }
+    return total > 0 ? total : 0;
+}
+
+// 统计数据
+InstancePool::Stats InstancePool::stats() const{
+    Stats stats = {0, 0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < this->m_levelSize; i++){
+        stats.gets += this->m_stats[i].gets.load(std::memory_order_relaxed);
+        stats.constructions += this->m_stats[i].constructions.load(std::memory_order_relaxed);
+        stats.trimmed += this->m_stats[i].trimmed.load(std::memory_order_relaxed);
+    }
+    stats.idle = this->idle();
+    stats.target = this->m_target.load(std::memory_order_relaxed);
+    stats.hitRate = stats.gets == 0 ? 0 : (double)(stats.gets - stats.constructions) / stats.gets;
+    stats.constructionsPerSecond = this->m_constructRate.load(std::memory_order_relaxed);
+    return stats;
+}
 
-    // 尝试从当前 levelPool 的 shared 中获取 instance 实例
-    lock::lockGuard guard(levelPool->sharedLock);
-    if (!levelPool->shared.empty()){
-        Instance::ptr got = levelPool->shared.front();
-        levelPool->shared.pop();
+/**
+ * @brief: 从某个指定 levelPool 中获取 instance 实例
+ * @param：levelPool——指定的 levelPool
+ * @param：steal——是否以窃取方的身份获取. 窃取时忽略 single，只从 shared 尾部弹出，不加锁. 默认为 false
+ */
+Instance::ptr InstancePool::getFromLevelPool(LevelPool* levelPool, bool steal){
+    Instance::ptr got;
+    // 窃取方只从 shared 尾部弹出闲置最久的 instance 实例
+    if (steal){
+        levelPool->shared.popTail(got);
         return got;
-    }   
+    }
 
-    return nullptr;
+    // 所属方先尝试 single，再从 shared 头部弹出最近归还的 instance 实例
+    spinLock::lockGuard guard(levelPool->ownerLock);
+    if (levelPool->single){
+        got = std::move(levelPool->single);
+        levelPool->single = nullptr;
+        return got;
+    }
+    levelPool->shared.popHead(got);
+    return got;
 }
 
 /**
  * @brief: 从某个 pool 的指定 level 中获取 instance 实例
- * @param：pool——m_local 或者 m_victim
+ * @param：pool——local 或者 victim 代际
  * @param：level——指定 level 层级
  */
-Instance::ptr InstancePool::getFromPool(std::vector<LevelPool::ptr>& pool, int level){
-    if (pool.empty()){
-        return nullptr;
-    }
-
+Instance::ptr InstancePool::getFromPool(LevelPool* pool, int level){
     // 从当前 level 的 levelPool 中获取. 会分别尝试 single 和 shared
-    Instance::ptr got = this->getFromLevelPool(pool[level]);
+    Instance::ptr got = this->getFromLevelPool(&pool[level]);
     if (got){
+        this->m_stats[level].idle.fetch_sub(1, std::memory_order_relaxed);
         return got;
     }
 
-    // 从其他 level 的 levelPool 中获取. 只尝试 shared.
-    for (int i = 0; i < pool.size(); i++){
+    // 从其他 level 的 levelPool 中窃取. 只尝试 shared 尾部
+    for (int i = 0; i < this->m_levelSize; i++){
         if (i == level){
             continue;
         }
 
-        got = this->getFromLevelPool(pool[i],true);
+        got = this->getFromLevelPool(&pool[i],true);
         if (got){
+            this->m_stats[i].idle.fetch_sub(1, std::memory_order_relaxed);
             return got;
         }
     }
@@ -192,5 +302,21 @@ Instance::ptr InstancePool::getFromPool(std::vector<LevelPool::ptr>& pool, int l
     return nullptr;    
 }
 
+// 线程粒度的编号生成器，仅在无法获取 CPU 编号时使用
+static std::atomic<int> s_threadIndex{0};
+// 当前线程的编号，首次使用时分配
+static thread_local int t_threadIndex = -1;
+
+int InstancePool::currentLevel() const{
+    int cpu = sched_getcpu();
+    if (cpu < 0){
+        if (t_threadIndex < 0){
+            t_threadIndex = s_threadIndex++;
+        }
+        cpu = t_threadIndex;
+    }
+    return cpu % this->m_levelSize;
+}
+
 
 }}
\ No newline at end of file
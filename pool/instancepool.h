@@ -6,10 +6,10 @@
 #include <functional>
 // 智能指针相关
 #include <memory>
-// 队列
-#include <queue>
 // 原子变量、原子操作
 #include <atomic>
+// 动态数组
+#include <vector>
 
 // 禁用类的拷贝、赋值操作
 #include "../base/nocopy.h"
@@ -21,6 +21,8 @@
 #include "../sync/thread.h"
 // 信号量相关
 #include "../sync/sem.h"
+// 所属方头部读写、窃取方尾部弹出的无锁双端队列
+#include "poolchain.h"
 
 namespace cbricks{namespace pool{
 
@@ -63,50 +65,95 @@ public:
     typedef sync::SpinLock spinLock;
     // 互斥锁 类型别名
     typedef sync::Lock lock;
+public:
+    // 计算目标闲置数量时 EWMA 的平滑系数，取值越大越偏向最近一个轮询间隔的数据
+    static constexpr double EWMA_ALPHA = 0.3;
+
+    // 对象池的统计数据
+    struct Stats{
+        // 当前闲置的 instance 数量（近似值）
+        size_t idle;
+        // 根据各轮询间隔内在用 instance 数量峰值的 EWMA 计算得到的目标闲置数量，不超过闲置数量上限
+        size_t target;
+        // 累计 get 次数
+        uint64_t gets;
+        // 累计通过 constructF 构造的 instance 数量
+        uint64_t constructions;
+        // 因闲置数量达到上限而在 put 时直接丢弃的 instance 数量
+        uint64_t trimmed;
+        // 累计命中率，即无需构造新实例的 get 占比
+        double hitRate;
+        // 最近一个轮询间隔内每秒构造的 instance 数量
+        double constructionsPerSecond;
+    };
+
 public:
     /**
      * @brief：构造函数
      * @param：_constructF——实例构造函数
-     * @param：level——资源粒度分级，默认分成 8 份
+     * @param：level——资源粒度分级，默认为 0，表示与 CPU 核数保持一致
      * @param：expDuration——过期回收时间，表示 instance 在对象池中闲置多长时间后会被自动回收
+     * @param：maxIdle——闲置 instance 数量上限，0 表示不限制. 上限在各 level 之间均分
+     * @param：maxBytes——闲置 instance 占用字节数上限，0 表示不限制. 需要同时指定 instanceBytes
+     * @param：instanceBytes——单个 instance 占用的字节数，仅用于将 maxBytes 换算为数量上限
      */
-    InstancePool(constructF _constructF, const int level = 8, const ms expDuration = ms(500));
+    InstancePool(constructF _constructF, const int level = 0, const ms expDuration = ms(500), const size_t maxIdle = 0, const size_t maxBytes = 0, const size_t instanceBytes = 0);
     /** 析构函数 */
     ~InstancePool();
 
 private:
     /**
      * 某个 level 下的 instance 队列
+     * 各 level 分别对应一个 CPU，由运行在该 CPU 上的线程访问. 结构体末尾通过填充字节与相邻的堆上数据隔开，避免伪共享
      */
     struct LevelPool{
-        // 共享指针 类型别名
-        typedef std::shared_ptr<LevelPool> ptr;
-        // 保护私有 instance 实例的自旋锁
-        spinLock singleLock;
+        /**
+         * 所属方自旋锁. 保护私有 instance 实例，以及 shared 头部的读写.
+         * 同一 CPU 上的线程可能先后被调度，均作为所属方访问该 level，PoolChain 要求所属方之间互斥
+         */
+        spinLock ownerLock;
         // 私有 instance 实例
         Instance::ptr single = nullptr;
 
-        // 保护共享 instance 队列的互斥锁
-        lock sharedLock;
-        // 共享 instance 队列
-        std::queue<Instance::ptr> shared;
+        /**
+         * 共享 instance 链表. 所属 level 在头部后进先出地读写，其他 level 与 evict thread 从尾部无锁窃取闲置最久的 instance，
+         * 链表为空时 popTail 只需读取一次 headTail，因此窃取时逐一尝试其他 level 的成本很低
+         */
+        PoolChain<Instance::ptr> shared;
+
+        // 填充字节，保证相邻 levelPool 的锁位于不同的 cache line
+        char padding[64];
+    };
+
+    /**
+     * 某个 level 下的计数器. 由运行在对应 CPU 上的线程更新，热路径上不存在跨 CPU 共享的计数器
+     * idle 统计两个代际中该 level 下的闲置 instance 总数
+     */
+    struct LevelStats{
+        std::atomic<uint64_t> gets{0};
+        std::atomic<uint64_t> constructions{0};
+        std::atomic<uint64_t> trimmed{0};
+        std::atomic<int64_t> idle{0};
+        // 填充字节，避免相邻 level 的计数器之间伪共享
+        char padding[64];
     };
 
 public:
     /**
      * @brief: 从 instance pool 中获取一个 instance 实例：
-     * - 0）根据 level 递增计数器，分配得到一个 level
-     * - 针对 m_local 操作：
+     * - 0）根据当前线程所在的 CPU 得到 level，不访问任何共享计数器
+     * - 读取一次 m_generation，得到本次使用的 local 与 victim 代际
+     * - 针对 local 操作：
      *  - 1）根据 level 获取对应的 levelPool
      *  - 2）尝试获取当前 levelPool 的 private instance（ 加 level 粒度 spinLock，只有同 level 下的 get 和 put 行为会发生竞争 ）
-     *  - 3）尝试从当前 levelPool 的 shared 队列中获取 instance（加 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
-     *  - 4） 尝试从其他 levelPool 的 shared 队列中获取 instance（加其他 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
+     *  - 3）尝试从当前 levelPool 的 shared 链表头部获取最近归还的 instance（同样在 level 粒度 spinLock 内进行）
+     *  - 4） 尝试从其他 levelPool 的 shared 链表尾部窃取 instance（无锁操作，不会因竞争而陷入内核态等待）
      *  - 5）使用 newFc 构造出新实例
-     * - 针对 m_victim 操作：
+     * - 针对 victim 操作：
      *  - 6）根据 level 获取对应的 levelPool
      *  - 7）尝试获取当前 levelPool 的 private instance（ 加 level 粒度 spinLock，只有同 level 下的 get 和 put 行为会发生竞争 ）
-     *  - 8）尝试从当前 levelPool 的 shared 队列中获取 instance（加 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
-     *  - 9） 尝试从其他 levelPool 的 shared 队列中获取 instance（加其他 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
+     *  - 8）尝试从当前 levelPool 的 shared 链表头部获取最近归还的 instance（同样在 level 粒度 spinLock 内进行）
+     *  - 9） 尝试从其他 levelPool 的 shared 链表尾部窃取 instance（无锁操作，不会因竞争而陷入内核态等待）
      *  - 10）使用 newFc 构造出新实例
      * @return: 返回获取到的实例
      */
@@ -115,51 +162,93 @@ public:
     /**
      * @brief：将一个 instance 归还回到 instancePool
      * @param: instance——归还的 instance
-     * - 1）根据 level 递增计数器，分配得到一个 level
-     * - 2）根据 level 从 m_local 获取对应的 levelPool
+     * - 1）根据当前线程所在的 CPU 得到 level
+     * - 2）根据 level 从当前 local 代际获取对应的 levelPool
      * - 3）尝试放置到当前 levelPool 的 private 中（ 加 level 粒度 spinLock，只有同 level 下的 get 和 put 行为会发生竞争 ）
-     * - 4）放置到当前 levelPool 的 shared 队列（加 level 粒度 lock，可能和任意 level 的 get 和 put 行为发生竞争）
+     * - 4）放置到当前 levelPool 的 shared 链表头部（同样在 level 粒度 spinLock 内进行）
+     * 当前 level 的闲置数量达到上限时，instance 不再放回池中，由调用方释放最后一个引用时析构
      */
     void put(Instance::ptr instance); 
 
+    // 统计数据
+    Stats stats() const;
+
 private:
     /**
      * @brief: [异步执行] 定时清理达到过期时长的 instance
      * - 1）每隔 expDuration/2 执行一次
-     * - 2）构造新的 m_local 实例
-     * - 3）回收 m_victim
-     * - 4）将前一轮的 m_local 变为 m_victim
-     * - 5）将新的 m_local 变为 m_local
+     * - 2）在 evict thread 中清空当前的 victim 代际，instance 的析构不会发生在 get/put 的调用路径上
+     * - 3）根据本轮在用 instance 数量的峰值更新 EWMA，得到目标闲置数量. local 中超出目标的部分同样被回收.
+     *      get 频率只反映吞吐量，同一个 instance 可以在一个间隔内被反复获取、归还，需要保留的闲置数量取决于同时在用的数量
+     * - 4）原子地翻转 m_generation：前一轮的 local 变为 victim，清空后的 victim 复用为新的 local
+     * 两个代际的 levelPool 在构造时一次性分配，轮换过程不涉及任何内存分配
      */
     void asyncEvict();
 
+    /**
+     * @brief: 回收某个代际中的 instance 实例
+     * @param：pool——待回收的代际
+     * @param：keep——所有 level 合计保留的闲置数量. 在各 level 之间均分，各 level 只回收超出自身份额的部分
+     */
+    void drain(LevelPool* pool, size_t keep = 0);
+
+    // 当前闲置的 instance 数量（近似值）
+    size_t idle() const;
+
     /**
      * @brief: 从某个指定 levelPool 中获取 instance 实例
      * @param：levelPool——指定的 levelPool
-     * @param：获取 instance 过程中，是否忽略 levelPool 中的 single instance 实例. 默认为 false
+     * @param：steal——是否以窃取方的身份获取. 窃取时忽略 single，只从 shared 尾部弹出，不加锁. 默认为 false
      */
-    Instance::ptr getFromLevelPool(LevelPool::ptr levelPool, const bool ignoreSingle = false);
+    Instance::ptr getFromLevelPool(LevelPool* levelPool, const bool steal = false);
     
     /**
      * @brief: 从某个 pool 的指定 level 中获取 instance 实例
-     * @param：pool——m_local 或者 m_victim
+     * @param：pool——local 或者 victim 代际
      * @param：level——指定 level 层级
      */
-    Instance::ptr getFromPool(std::vector<LevelPool::ptr>& pool, int level);
+    Instance::ptr getFromPool(LevelPool* pool, int level);
+
+    /**
+     * @brief: 获取当前线程对应的 level
+     * 优先使用当前线程所在的 CPU 编号（仿 golang sync.Pool 中 pin 到 P 的思路），同一 CPU 上的线程不会同时运行，level 内几乎不存在竞争.
+     * 无法获取 CPU 编号时退化为线程粒度的编号
+     */
+    int currentLevel() const;
 
 private:
     // evict thread 轮询间隔
     ms m_evictInterval;
     // 用于构造 instance 实例的构造器函数
     constructF m_constructF;
-    // 当前轮次的 instance 缓冲池
-    std::vector<LevelPool::ptr> m_local;
-    // 上一轮次的 instance 缓冲池
-    std::vector<LevelPool::ptr> m_victim;
-    // level 计数器
-    std::atomic<int> m_level{0};
+    /**
+     * 双缓冲的两个代际，各包含 m_levelSize 个 levelPool，在构造时分配，析构时回收.
+     * m_generations[m_generation] 为当前轮次的 local，另一个为上一轮次的 victim
+     */
+    std::unique_ptr<LevelPool[]> m_generations[2];
+    // 当前 local 代际的下标. get/put 读取一次后即可得到一致的 local/victim 组合，不存在读到半更新状态的可能
+    std::atomic<int> m_generation{0};
+    // level 数量
     int m_levelSize;
 
+    // 各 level 的计数器
+    std::unique_ptr<LevelStats[]> m_stats;
+    // 单个 level 的闲置数量上限，0 表示不限制
+    size_t m_levelCap;
+    /**
+     * 当前在用的 instance 数量，即已获取但尚未归还的数量. 包含因达到上限而在 put 时丢弃的 instance.
+     * 峰值无法由各 level 的计数器分别得到（线程可能在一个 CPU 上 get、在另一个 CPU 上 put），因此使用全局计数器
+     */
+    std::atomic<int64_t> m_outstanding{0};
+    // 本轮询间隔内 m_outstanding 的峰值. 只在出现新的峰值时写入，平稳流量下 get 只需读取一次
+    std::atomic<int64_t> m_peak{0};
+    // 每轮在用 instance 数量峰值的 EWMA
+    double m_ewma = 0;
+    // 目标闲置数量
+    std::atomic<size_t> m_target{0};
+    // 最近一个轮询间隔内每秒构造的 instance 数量
+    std::atomic<double> m_constructRate{0};
+
     // 标识 instance pool 是否关闭
     std::atomic<bool> m_closed{false};
     // 信号量，用于在 instance pool 析构时控制保证 evict thread 先行退出
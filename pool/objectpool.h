@@ -0,0 +1,258 @@
+#pragma once
+
+// 类型萃取
+#include <type_traits>
+// 智能指针相关
+#include <memory>
+// 原子变量、原子操作
+#include <atomic>
+// 获取当前线程所在的 CPU
+#include <sched.h>
+#include <thread>
+
+// 禁用类的拷贝、赋值操作
+#include "../base/nocopy.h"
+// 锁相关，包含自旋锁 spinLock 互斥锁 lock
+#include "../sync/lock.h"
+
+namespace cbricks{namespace pool{
+
+/**
+ * @brief: 类型化的对象池
+ * 与 InstancePool 的区别：
+ *  - 不要求对象继承 Instance 接口，只需要提供 void reset() 成员函数，在编译期检测，不存在虚函数调用
+ *  - 对象与空闲链表的 next 指针存放在同一个节点中（侵入式链表），对象在池中流转时不需要额外分配内存
+ *  - get 返回只可移动的 Handle，Handle 析构时自动将对象归还，不涉及 shared_ptr 的控制块与引用计数
+ * 空闲链表按照 CPU 分片，与 InstancePool 的 level 一致，同一 CPU 上的 get/put 只竞争本分片的自旋锁
+ * 使用约束：ObjectPool 的生命周期必须长于其发放的所有 Handle
+ */
+template <class T>
+class ObjectPool : base::Noncopyable{
+private:
+    /**
+     * @brief: 编译期检测 T 是否具有 reset() 成员函数
+     */
+    template <class U>
+    static auto hasReset(int) -> decltype(std::declval<U&>().reset(), std::true_type());
+    template <class U>
+    static std::false_type hasReset(...);
+
+    static_assert(decltype(hasReset<T>(0))::value, "ObjectPool<T> requires T to have a reset() member function");
+
+    // 自旋锁 类型别名
+    typedef sync::SpinLock spinLock;
+
+    // 侵入式链表节点. 对象与 next 指针一同分配
+    struct Node{
+        T value;
+        Node* next = nullptr;
+    };
+
+    // 某个 CPU 对应的空闲链表
+    struct Shard{
+        spinLock lock;
+        Node* head = nullptr;
+        size_t size = 0;
+        // 填充字节，保证相邻分片的锁位于不同的 cache line
+        char padding[64];
+    };
+
+public:
+    /**
+     * @brief: 对象句柄. 只可移动，析构时将对象归还到对象池中
+     */
+    class Handle{
+    public:
+        Handle() = default;
+        ~Handle(){
+            this->recycle();
+        }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        Handle(Handle&& other):m_pool(other.m_pool),m_node(other.m_node){
+            other.m_pool = nullptr;
+            other.m_node = nullptr;
+        }
+
+        Handle& operator=(Handle&& other){
+            if (this != &other){
+                this->recycle();
+                this->m_pool = other.m_pool;
+                this->m_node = other.m_node;
+                other.m_pool = nullptr;
+                other.m_node = nullptr;
+            }
+            return *this;
+        }
+
+    public:
+        T& operator*() const{
+            return this->m_node->value;
+        }
+
+        T* operator->() const{
+            return &this->m_node->value;
+        }
+
+        T* get() const{
+            return this->m_node ? &this->m_node->value : nullptr;
+        }
+
+        explicit operator bool() const{
+            return this->m_node != nullptr;
+        }
+
+    private:
+        friend class ObjectPool<T>;
+        Handle(ObjectPool<T>* pool, Node* node):m_pool(pool),m_node(node){}
+
+        // 将持有的对象归还到对象池中
+        void recycle(){
+            if (this->m_node){
+                this->m_pool->put(this->m_node);
+                this->m_pool = nullptr;
+                this->m_node = nullptr;
+            }
+        }
+
+    private:
+        ObjectPool<T>* m_pool = nullptr;
+        Node* m_node = nullptr;
+    };
+
+public:
+    /**
+     * @brief: 构造函数
+     * @param: maxIdle——每个分片中最多缓存的空闲对象数量，超出部分在归还时直接析构
+     * @param: shards——分片数量，默认为 0，表示与 CPU 核数保持一致
+     */
+    ObjectPool(const size_t maxIdle = 1024, int shards = 0);
+    // 析构函数. 析构所有空闲对象
+    ~ObjectPool();
+
+public:
+    /**
+     * @brief: 获取一个对象
+     * 1）尝试从当前 CPU 对应分片的空闲链表中获取
+     * 2）尝试从其他分片的空闲链表中获取
+     * 3）默认构造一个新对象
+     */
+    Handle get();
+
+    // 当前缓存的空闲对象数量（近似值）
+    size_t idle();
+
+private:
+    /**
+     * @brief: 归还一个对象. 由 Handle 析构时调用
+     * 1）调用 reset 重置对象
+     * 2）放入当前 CPU 对应分片的空闲链表，分片已满时直接析构
+     */
+    void put(Node* node);
+
+    // 从指定分片中弹出一个节点
+    Node* pop(Shard& shard);
+
+    // 当前线程对应的分片下标
+    int currentShard() const;
+
+private:
+    // 每个分片中最多缓存的空闲对象数量
+    size_t m_maxIdle;
+    // 分片数量
+    int m_shardSize;
+    // 分片数组
+    std::unique_ptr<Shard[]> m_shards;
+};
+
+template <class T>
+ObjectPool<T>::ObjectPool(const size_t maxIdle, int shards):m_maxIdle(maxIdle),m_shardSize(shards){
+    if (this->m_shardSize <= 0){
+        this->m_shardSize = std::thread::hardware_concurrency();
+        if (this->m_shardSize <= 0){
+            this->m_shardSize = 1;
+        }
+    }
+    this->m_shards.reset(new Shard[this->m_shardSize]);
+}
+
+template <class T>
+ObjectPool<T>::~ObjectPool(){
+    for (int i = 0; i < this->m_shardSize; i++){
+        Node* node = this->m_shards[i].head;
+        while (node){
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+}
+
+template <class T>
+typename ObjectPool<T>::Handle ObjectPool<T>::get(){
+    int index = this->currentShard();
+    Node* node = this->pop(this->m_shards[index]);
+
+    // 从其他分片中窃取
+    for (int i = 1; !node && i < this->m_shardSize; i++){
+        node = this->pop(this->m_shards[(index + i) % this->m_shardSize]);
+    }
+
+    if (!node){
+        node = new Node;
+    }
+    return Handle(this, node);
+}
+
+template <class T>
+size_t ObjectPool<T>::idle(){
+    size_t total = 0;
+    for (int i = 0; i < this->m_shardSize; i++){
+        spinLock::lockGuard guard(this->m_shards[i].lock);
+        total += this->m_shards[i].size;
+    }
+    return total;
+}
+
+template <class T>
+void ObjectPool<T>::put(Node* node){
+    // 在归还时重置，使空闲对象不再持有外部资源
+    node->value.reset();
+
+    Shard& shard = this->m_shards[this->currentShard()];
+    {
+        spinLock::lockGuard guard(shard.lock);
+        if (shard.size < this->m_maxIdle){
+            node->next = shard.head;
+            shard.head = node;
+            shard.size++;
+            return;
+        }
+    }
+    delete node;
+}
+
+template <class T>
+typename ObjectPool<T>::Node* ObjectPool<T>::pop(Shard& shard){
+    spinLock::lockGuard guard(shard.lock);
+    Node* node = shard.head;
+    if (node){
+        shard.head = node->next;
+        node->next = nullptr;
+        shard.size--;
+    }
+    return node;
+}
+
+template <class T>
+int ObjectPool<T>::currentShard() const{
+    int cpu = sched_getcpu();
+    if (cpu < 0){
+        cpu = 0;
+    }
+    return cpu % this->m_shardSize;
+}
+
+}}
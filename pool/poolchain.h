@@ -0,0 +1,253 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "../base/nocopy.h"
+#include "../sync/epoch.h"
+
+namespace cbricks{namespace pool{
+
+/**
+ * @brief: 仿 golang sync.Pool 中 poolChain 实现的双端队列：所属方在头部读写，窃取方从尾部弹出
+ * 功能点：
+ *  - 由若干环形缓冲区（Dequeue）串联而成. 头部缓冲区写满后，所属方分配一个容量翻倍的新缓冲区挂到链表头部，
+ *    窃取方将已经读空且不会再被写入的尾部缓冲区摘除
+ *  - 缓冲区的 head、tail 打包在同一个 64 位原子变量中，弹出操作通过一次 cas 抢占槽位，所属方的 popHead 与窃取方的 popTail 均不加锁
+ *  - 所属方后进先出，取到的是最近归还、最可能仍在 cache 中的元素；窃取方先进先出，取到的是闲置最久的元素，两端很少发生竞争
+ *  - 弹出时元素从槽位中移出，队列中不会残留对已弹出元素的引用
+ *  - 被摘除的缓冲区可能仍在被其他线程访问，通过 epoch 延迟回收
+ * pushHead、popHead 只能由所属方调用，多个线程共同作为所属方时需要由调用方保证互斥；popTail 可以被任意线程并发调用
+ */
+template <typename T>
+class PoolChain : base::Noncopyable{
+public:
+    // 构造函数. 首次写入时才分配缓冲区
+    PoolChain() = default;
+    // 析构函数. 调用时需保证不存在并发访问
+    ~PoolChain();
+
+public:
+    // [所属方] 从头部写入元素
+    void pushHead(T val);
+    /**
+     * @brief: [所属方] 从头部弹出元素
+     * @param: val——接收元素的容器
+     * @return: true——弹出成功 false——队列为空
+     */
+    bool popHead(T& val);
+    /**
+     * @brief: [窃取方] 从尾部弹出元素
+     * @param: val——接收元素的容器
+     * @return: true——弹出成功 false——队列为空
+     */
+    bool popTail(T& val);
+
+private:
+    // 首个缓冲区的容量
+    static const uint32_t INITIAL_SIZE = 8;
+    // 单个缓冲区的容量上限. head、tail 均为 32 位并允许回绕，容量需远小于 2^32
+    static const uint32_t MAX_SIZE = 1u << 30;
+
+    /**
+     * 环形缓冲区中的槽位
+     * used 由 pushHead 置为 true，由弹出方在移出元素后置为 false. 窃取方通过 cas 抢到槽位后仍需读取元素，
+     * 所属方在 used 复位之前不能再次写入该槽位
+     */
+    struct Slot{
+        T val;
+        std::atomic<bool> used{false};
+    };
+
+    /**
+     * 定长的环形缓冲区
+     * headTail 高 32 位为 head，指向下一个写入位置；低 32 位为 tail，指向最早写入的元素. head == tail 时为空
+     */
+    struct Dequeue{
+        explicit Dequeue(const uint32_t n):size(n),slots(new Slot[n]){}
+
+        // [所属方] 写入头部. 缓冲区已满时返回 false
+        bool pushHead(T& val);
+        // [所属方] 弹出头部
+        bool popHead(T& val);
+        // [窃取方] 弹出尾部
+        bool popTail(T& val);
+        // 从抢占到的槽位中移出元素并释放槽位
+        void take(Slot& slot, T& val);
+
+        static uint64_t pack(const uint32_t head, const uint32_t tail){
+            return ((uint64_t)head << 32) | tail;
+        }
+
+        std::atomic<uint64_t> headTail{0};
+        // 容量，为 2 的整数次幂
+        const uint32_t size;
+        std::unique_ptr<Slot[]> slots;
+        // 更新的缓冲区，由所属方写入，窃取方读取
+        std::atomic<Dequeue*> next{nullptr};
+        // 更早的缓冲区，由所属方读取，窃取方摘除尾部缓冲区时置空
+        std::atomic<Dequeue*> prev{nullptr};
+    };
+
+private:
+    // 头部缓冲区，仅由所属方访问
+    Dequeue* m_head = nullptr;
+    // 尾部缓冲区，窃取方从这里开始弹出
+    std::atomic<Dequeue*> m_tail{nullptr};
+};
+
+// 析构时释放链表中的所有缓冲区
+template <typename T>
+PoolChain<T>::~PoolChain(){
+    Dequeue* move = this->m_tail.load();
+    while (move){
+        Dequeue* next = move->next.load();
+        delete move;
+        move = next;
+    }
+}
+
+/**
+ * @brief: [所属方] 从头部写入元素
+ * 1）头部缓冲区不存在时，分配首个缓冲区
+ * 2）写入头部缓冲区
+ * 3）头部缓冲区已满时，分配一个容量翻倍的新缓冲区作为头部，原缓冲区此后不再写入
+ */
+template <typename T>
+void PoolChain<T>::pushHead(T val){
+    Dequeue* d = this->m_head;
+    if (d == nullptr){
+        d = new Dequeue(INITIAL_SIZE);
+        this->m_head = d;
+        this->m_tail.store(d, std::memory_order_release);
+    }
+
+    if (d->pushHead(val)){
+        return;
+    }
+
+    uint32_t n = d->size < MAX_SIZE ? d->size * 2 : MAX_SIZE;
+    Dequeue* d2 = new Dequeue(n);
+    d2->prev.store(d, std::memory_order_relaxed);
+    d2->pushHead(val);
+    this->m_head = d2;
+    d->next.store(d2, std::memory_order_release);
+}
+
+/**
+ * @brief: [所属方] 从头部弹出元素
+ * 由头部缓冲区出发，沿 prev 依次尝试更早的缓冲区. 更早的缓冲区可能被窃取方并发摘除，因此在 epoch 临界区内访问
+ */
+template <typename T>
+bool PoolChain<T>::popHead(T& val){
+    sync::Epoch::Guard guard;
+    for (Dequeue* d = this->m_head; d; d = d->prev.load(std::memory_order_acquire)){
+        if (d->popHead(val)){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief: [窃取方] 从尾部弹出元素
+ * 1）先读取尾部缓冲区的 next，再尝试弹出. 顺序不能颠倒：next 存在说明所属方已不再写入该缓冲区，此时弹出失败才能断定它永久为空
+ * 2）弹出失败且 next 存在时，通过 cas 将其从链表中摘除并退休，然后继续尝试 next
+ */
+template <typename T>
+bool PoolChain<T>::popTail(T& val){
+    sync::Epoch::Guard guard;
+    Dequeue* d = this->m_tail.load(std::memory_order_acquire);
+    if (d == nullptr){
+        return false;
+    }
+
+    while (true){
+        Dequeue* d2 = d->next.load(std::memory_order_acquire);
+        if (d->popTail(val)){
+            return true;
+        }
+        if (d2 == nullptr){
+            return false;
+        }
+
+        Dequeue* expected = d;
+        if (this->m_tail.compare_exchange_strong(expected, d2, std::memory_order_acq_rel)){
+            d2->prev.store(nullptr, std::memory_order_release);
+            sync::Epoch::Retire(d);
+        }
+        d = d2;
+    }
+}
+
+template <typename T>
+bool PoolChain<T>::Dequeue::pushHead(T& val){
+    uint64_t ht = this->headTail.load(std::memory_order_acquire);
+    uint32_t head = ht >> 32, tail = (uint32_t)ht;
+    if ((uint32_t)(tail + this->size) == head){
+        return false;
+    }
+
+    // 窃取方已抢到该槽位但尚未取走元素，视为已满
+    Slot& slot = this->slots[head & (this->size - 1)];
+    if (slot.used.load(std::memory_order_acquire)){
+        return false;
+    }
+
+    slot.val = std::move(val);
+    slot.used.store(true, std::memory_order_relaxed);
+    // 推进 head，元素对抢到该槽位的弹出方可见
+    this->headTail.fetch_add((uint64_t)1 << 32, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool PoolChain<T>::Dequeue::popHead(T& val){
+    uint64_t ht = this->headTail.load(std::memory_order_acquire);
+    uint32_t head;
+    while (true){
+        head = ht >> 32;
+        uint32_t tail = (uint32_t)ht;
+        if (head == tail){
+            return false;
+        }
+        head--;
+        if (this->headTail.compare_exchange_weak(ht, Dequeue::pack(head, tail), std::memory_order_acq_rel, std::memory_order_acquire)){
+            break;
+        }
+    }
+
+    this->take(this->slots[head & (this->size - 1)], val);
+    return true;
+}
+
+template <typename T>
+bool PoolChain<T>::Dequeue::popTail(T& val){
+    uint64_t ht = this->headTail.load(std::memory_order_acquire);
+    uint32_t tail;
+    while (true){
+        uint32_t head = ht >> 32;
+        tail = (uint32_t)ht;
+        if (head == tail){
+            return false;
+        }
+        if (this->headTail.compare_exchange_weak(ht, Dequeue::pack(head, tail + 1), std::memory_order_acq_rel, std::memory_order_acquire)){
+            break;
+        }
+    }
+
+    this->take(this->slots[tail & (this->size - 1)], val);
+    return true;
+}
+
+template <typename T>
+void PoolChain<T>::Dequeue::take(Slot& slot, T& val){
+    val = std::move(slot.val);
+    // 确保槽位不再持有元素的资源
+    slot.val = T();
+    slot.used.store(false, std::memory_order_release);
+}
+
+}}
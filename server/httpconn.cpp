@@ -2,7 +2,33 @@
 
 namespace cbricks{ namespace server{
 
+// 构造函数. 各字符串字段绑定到连接持有的 arena
+HttpConn::HttpConn():m_method(GET),m_url(memory::ArenaAllocator<char>(&m_arena)),m_proto(memory::ArenaAllocator<char>(&m_arena)),m_body(memory::ArenaAllocator<char>(&m_arena)),m_response(&m_arena){}
 
+HttpConn::Response::Response(memory::Arena* arena):status(memory::ArenaAllocator<char>(arena)),statusCode(0),proto(memory::ArenaAllocator<char>(arena)),body(memory::ArenaAllocator<char>(arena)){}
 
+/**
+ * @brief: 清空实现 instance interface 方法
+ * 1）各字符串字段与新构造的空字符串交换，不再引用 arena 中的内存
+ * 2）reset arena，一次性回收本次请求分配的所有内存
+ */
+void HttpConn::clear(){
+    memory::ArenaAllocator<char> alloc(&this->m_arena);
+    memory::ArenaString(alloc).swap(this->m_url);
+    memory::ArenaString(alloc).swap(this->m_proto);
+    memory::ArenaString(alloc).swap(this->m_body);
+    memory::ArenaString(alloc).swap(this->m_response.status);
+    memory::ArenaString(alloc).swap(this->m_response.proto);
+    memory::ArenaString(alloc).swap(this->m_response.body);
+    this->m_method = GET;
+    this->m_response.statusCode = 0;
 
-}}
\ No newline at end of file
+    this->m_arena.reset();
+}
+
+// 请求级别的内存分配区
+memory::Arena& HttpConn::arena(){
+    return this->m_arena;
+}
+
+}}
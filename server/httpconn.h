@@ -6,10 +6,15 @@
 
 #include "../io/conn.h"
 #include "../pool/instancepool.h"
+#include "../memory/arena.h"
 
 namespace cbricks{namespace server{
 
-// http 连接
+/**
+ * http 连接
+ * 一笔请求解析、处理过程中产生的字符串均从连接持有的 arena 中分配，clear 时通过一次 arena reset 统一回收，
+ * 连接实例经由 InstancePool 复用时，arena 保留的 chunk 也随之复用
+ */
 class HttpConn : public pool::Instance{
 public:
     // 智能指针 类型别名
@@ -17,16 +22,18 @@ public:
 
 public:
     /** 构造/析构 */
-    // 构造函数，默认逻辑
-    HttpConn() = default;
+    // 构造函数. 各字符串字段绑定到连接持有的 arena
+    HttpConn();
     // 析构函数，默认逻辑
     ~HttpConn() override = default;
 
 public:
     // 初始化 http 连接. 传入原始请求内容，在构造函数中完成内容解析，填充各项内容，生成完备的 http conn
     void init(std::string& rawBody);
-    // 清空实现 instance interface 方法
+    // 清空实现 instance interface 方法. 清空各字段后 reset arena，一次性回收本次请求分配的内存
     void clear() override;
+    // 请求级别的内存分配区，供处理请求时分配临时数据. 在 clear 时回收
+    memory::Arena& arena();
 
 public:
     // 请求头
@@ -52,13 +59,13 @@ public:
     // 获取这笔请求的方法
     const Method& getMethod() const;
     // 获取请求路径
-    const std::string& getUrl() const;
+    const memory::ArenaString& getUrl() const;
     // 获取路径参数
     const Queries& getQueries() const;
     // 获取请求头
     const Headers& getHeaders() const;
     // 获取请求体
-    const std::string& getBody() const;
+    const memory::ArenaString& getBody() const;
 
     // 写入类
     // 写入响应内容
@@ -67,27 +74,30 @@ public:
 private:
     // 内部私有类. http 响应
     struct Response{
-        std::string status; // e.g. "200 OK"
+        explicit Response(memory::Arena* arena);
+        memory::ArenaString status; // e.g. "200 OK"
         int statusCode; // e.g. 200
-        std::string proto; // e.g "HTTP/1.0"
+        memory::ArenaString proto; // e.g "HTTP/1.0"
         Headers header; // 请求头
-        std::string body; // 内容
+        memory::ArenaString body; // 内容
         // 组装生成原始
     };
 
 private:
+    // 请求级别的内存分配区，需要先于各字符串字段构造、晚于各字符串字段析构
+    memory::Arena m_arena;
     // http 方法
     Method m_method;
     // 请求路径
-    std::string m_url;
+    memory::ArenaString m_url;
     // 请求路径参数
     Queries m_queries;    
     // 协议 "HTTP/1.0"
-    std::string m_proto;
+    memory::ArenaString m_proto;
     // 请求头
     Headers m_headers;
     // 请求体
-    std::string m_body;
+    memory::ArenaString m_body;
     // 响应
     Response m_response;
 };
@@ -0,0 +1,549 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#include "../base/nocopy.h"
+#include "lock.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * @brief: 并发安全的有界缓存
+ * 适用场景：数据规模需要受限的缓存场景. sync::Map 不存在容量上限和淘汰机制，作为缓存使用时内存会无限增长
+ * 功能点：
+ *  - 容量：支持按照数据条数和字节数两个维度设置上限，两者均可选. 字节数由 weigher 计算
+ *  - 分片：数据按 key 的哈希值分散到多个分片中，各分片独立加锁、独立淘汰，不存在全局锁
+ *  - 淘汰：分片内采用 CLOCK 算法. 命中时只需在读锁下设置访问标识，无需像 LRU 一样在写锁下调整链表
+ *  - 准入：基于 TinyLFU 思路，通过 count-min sketch 统计 key 的近期访问频率. 分片已满时，新数据的访问频率需高于
+ *          待淘汰数据才允许写入，避免一次性的扫描流量冲掉热点数据
+ *  - 过期：写入时可以指定过期时间，过期数据在读取时视为不存在，并优先被淘汰
+ *  - 统计：命中、未命中、淘汰、过期、准入拒绝次数
+ */
+template <class Key, class Value, class Hash = std::hash<Key>>
+class Cache : base::Noncopyable{
+public:
+    // 毫秒 类型别名
+    typedef std::chrono::milliseconds ms;
+    // 计算一条数据占用字节数的闭包函数 类型别名
+    typedef std::function<size_t(const Key& key, const Value& value)> weigher;
+
+    // 默认分片数量
+    static const int DEFAULT_SHARDS = 16;
+
+    // 缓存的统计数据
+    struct Stats{
+        // 命中次数
+        uint64_t hits;
+        // 未命中次数（包含读取到过期数据）
+        uint64_t misses;
+        // 因容量不足而淘汰的数据条数
+        uint64_t evictions;
+        // 因过期而移除的数据条数
+        uint64_t expirations;
+        // 未通过准入策略而被拒绝写入的次数
+        uint64_t rejections;
+    };
+
+public:
+    /**
+     * @brief: 构造函数
+     * @param: maxEntries——数据条数上限，0 表示不限制
+     * @param: maxBytes——数据字节数上限，0 表示不限制
+     * @param: w——计算一条数据占用字节数的闭包函数，为空时按照 sizeof(Key) + sizeof(Value) 计算
+     * @param: shards——分片数量，会向上取整为 2 的整数次幂. 容量上限不足以让每个分片至少分到 1 时，分片数量相应减半
+     * @param: admission——是否启用 TinyLFU 准入策略
+     * 容量上限在各分片之间均分，余数依次分配给前面的分片，所有分片的上限之和恰好等于设定值
+     */
+    Cache(const size_t maxEntries, const size_t maxBytes = 0, weigher w = nullptr, const int shards = DEFAULT_SHARDS, const bool admission = true);
+    ~Cache();
+
+public:
+    /**
+     * @brief：读取数据，存储到 receiver 中
+     * @return: true——数据存在且未过期，false——数据不存在或已过期
+     */
+    bool load(const Key& key, Value& receiver);
+
+    /**
+     * @brief: 写入数据
+     * @param: ttl——过期时间，0 表示永不过期
+     * @return: true——写入成功 false——被准入策略拒绝，或数据大小超过单个分片的字节数上限
+     */
+    bool store(const Key& key, const Value& value, const ms ttl = ms(0));
+
+    /**
+     * @brief: 删除数据
+     * @return: true——数据存在且已删除 false——数据不存在
+     */
+    bool evict(const Key& key);
+
+    // 数据条数（包含尚未移除的过期数据）
+    size_t size();
+    // 数据占用的字节数
+    size_t bytes();
+    // 统计数据
+    Stats stats();
+
+private:
+    // 单条缓存数据. 位于 CLOCK 环中的固定位置，删除后位置被复用
+    struct Node{
+        Key key;
+        Value value;
+        // 占用的字节数
+        size_t bytes;
+        // 过期时间点，单位为纳秒. 0 表示永不过期
+        int64_t expireAt;
+        // 是否存放了有效数据
+        bool used;
+        /**
+         * 访问标识. 命中时在读锁下置为 true，CLOCK 指针经过时若为 true 则置为 false 并跳过，为 false 则淘汰
+         * 由于多个读取方可能同时设置，使用原子类型
+         */
+        std::atomic<bool> referenced;
+
+        Node():bytes(0),expireAt(0),used(false),referenced(false){}
+    };
+
+    /**
+     * 频率统计：4 行 count-min sketch，计数器上限为 15
+     * 累计记录次数达到采样上限时，所有计数器减半，使频率统计偏向近期的访问
+     * 计数器在读锁下并发更新，采用原子类型的读写，少量的更新丢失对近似统计没有影响
+     */
+    struct Sketch{
+        // 各行计数器
+        std::vector<std::atomic<uint8_t>> counters;
+        // 每行计数器数量的掩码
+        uint64_t mask;
+        // 累计记录次数
+        std::atomic<uint64_t> additions;
+        // 采样上限
+        uint64_t sampleSize;
+
+        Sketch(const size_t width);
+        // 记录一次访问
+        void increment(const uint64_t h);
+        // 估算访问频率
+        int frequency(const uint64_t h) const;
+        // 第 row 行中 h 对应的计数器下标
+        size_t indexOf(const uint64_t h, const int row) const;
+    };
+
+    // 分片
+    struct Shard{
+        // 保护分片数据的读写锁. 命中时只需读锁
+        RWLock lock;
+        // 分片的数据条数上限，0 表示不限制
+        size_t maxEntries;
+        // 分片的字节数上限，0 表示不限制
+        size_t maxBytes;
+        // key 到 CLOCK 环中位置的映射
+        std::unordered_map<Key, size_t, Hash> index;
+        // CLOCK 环. deque 在尾部追加时不会移动已有元素
+        std::deque<Node> ring;
+        // 已删除数据空出的位置
+        std::vector<size_t> freeSlots;
+        // CLOCK 指针
+        size_t hand;
+        // 数据占用的字节数
+        size_t bytes;
+        // 访问频率统计
+        Sketch sketch;
+
+        // 统计数据
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> evictions;
+        std::atomic<uint64_t> expirations;
+        std::atomic<uint64_t> rejections;
+
+        // 填充字节，保证相邻分片的锁位于不同的 cache line
+        char padding[64];
+
+        Shard(const size_t maxEntries, const size_t maxBytes, const size_t sketchWidth);
+    };
+
+private:
+    // 计算 key 的哈希值
+    uint64_t hashOf(const Key& key) const;
+    // 获取哈希值对应的分片
+    Shard& shardOf(const uint64_t h);
+    // 分片数据是否超出容量上限. extra——拟追加的字节数
+    bool overflowLocked(const Shard& shard, const size_t entries, const size_t extra) const;
+    /**
+     * @brief: 通过 CLOCK 指针选出待淘汰的数据. 调用方需持有分片写锁，且分片不为空
+     * 过期数据直接选中；访问标识为 true 的数据清除标识后跳过；访问标识为 false 的数据被选中
+     */
+    size_t victimLocked(Shard& shard, const int64_t now);
+    // 移除指定位置的数据. 调用方需持有分片写锁
+    void removeLocked(Shard& shard, const size_t slot);
+    // 数据是否已过期
+    static bool expired(const Node& node, const int64_t now);
+    // 当前时间，单位为纳秒
+    static int64_t now();
+    // 将分片数量向上取整为 2 的整数次幂
+    static size_t roundUp(const size_t n);
+
+private:
+    // 分片数组. Shard 中存在锁和原子量，无法移动，因此存放指针
+    std::vector<Shard*> m_shards;
+    // 分片掩码，即分片数量 - 1
+    uint64_t m_mask;
+    // 计算数据字节数的闭包函数
+    weigher m_weigher;
+    // 是否启用准入策略
+    bool m_admission;
+    // 哈希函数
+    Hash m_hash;
+};
+
+/**
+ * 构造函数
+ * 1）每个分片的上限至少为 1，否则上限为 0 的分片会被视为不限制，因此上限过小时减少分片数量
+ * 2）上限按 maxEntries / n 均分，余数依次分配给前 maxEntries % n 个分片，避免向上取整导致总量超出设定值
+ * 频率统计的宽度取单个分片条数上限的 2 倍；仅限制字节数时无法预知条数，取固定值 1024
+ */
+template <class Key, class Value, class Hash>
+Cache<Key,Value,Hash>::Cache(const size_t maxEntries, const size_t maxBytes, weigher w, const int shards, const bool admission):m_weigher(w),m_admission(admission){
+    size_t n = roundUp(shards > 0 ? shards : 1);
+    while (n > 1 && ((maxEntries != 0 && maxEntries < n) || (maxBytes != 0 && maxBytes < n))){
+        n >>= 1;
+    }
+    this->m_mask = n - 1;
+
+    for (size_t i = 0; i < n; i++){
+        size_t entries = maxEntries / n + (i < maxEntries % n ? 1 : 0);
+        size_t bytes = maxBytes / n + (i < maxBytes % n ? 1 : 0);
+        size_t width = entries == 0 ? 1024 : 2 * entries;
+        this->m_shards.push_back(new Shard(entries, bytes, width));
+    }
+}
+
+template <class Key, class Value, class Hash>
+Cache<Key,Value,Hash>::~Cache(){
+    for (size_t i = 0; i < this->m_shards.size(); i++){
+        delete this->m_shards[i];
+    }
+}
+
+/**
+ * @brief: 读取数据
+ * 1）无论是否命中，都记录一次访问频率，使得频繁未命中的 key 后续写入时能够通过准入
+ * 2）读锁下查找数据. 命中且未过期时设置访问标识并拷贝数据
+ * 3）读取到过期数据时，升级为写锁 double check 后移除
+ */
+template <class Key, class Value, class Hash>
+bool Cache<Key,Value,Hash>::load(const Key& key, Value& receiver){
+    uint64_t h = this->hashOf(key);
+    Shard& shard = this->shardOf(h);
+    shard.sketch.increment(h);
+    int64_t t = now();
+
+    {
+        RWLock::readLockGuard guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()){
+            shard.misses++;
+            return false;
+        }
+        Node& node = shard.ring[it->second];
+        if (!expired(node, t)){
+            // 已经置为 true 时不再写入，避免热点数据所在的 cache line 在多核之间反复失效
+            if (!node.referenced.load(std::memory_order_relaxed)){
+                node.referenced.store(true, std::memory_order_relaxed);
+            }
+            receiver = node.value;
+            shard.hits++;
+            return true;
+        }
+    }
+
+    shard.misses++;
+    RWLock::lockGuard guard(shard.lock);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end() && expired(shard.ring[it->second], t)){
+        this->removeLocked(shard, it->second);
+        shard.expirations++;
+    }
+    return false;
+}
+
+/**
+ * @brief: 写入数据
+ * 1）记录一次访问频率
+ * 2）key 已存在时原地更新，必要时淘汰其他数据以满足字节数上限
+ * 3）key 不存在时，若分片已满，通过 CLOCK 指针逐一选出待淘汰数据. 待淘汰数据已过期则直接移除；
+ *    否则启用准入策略时，在淘汰第一条未过期数据之前比较两者的访问频率，新数据频率不高于待淘汰数据时拒绝写入.
+ *    准入判断只进行一次，一旦通过，后续淘汰不再比较，避免淘汰了部分数据后又拒绝写入，使一次被拒绝的写入反而缩小了缓存
+ * 4）将新数据写入空闲位置
+ */
+template <class Key, class Value, class Hash>
+bool Cache<Key,Value,Hash>::store(const Key& key, const Value& value, const ms ttl){
+    uint64_t h = this->hashOf(key);
+    Shard& shard = this->shardOf(h);
+    shard.sketch.increment(h);
+
+    size_t cost = this->m_weigher ? this->m_weigher(key, value) : sizeof(Key) + sizeof(Value);
+    if (shard.maxBytes != 0 && cost > shard.maxBytes){
+        shard.rejections++;
+        return false;
+    }
+    int64_t t = now();
+    int64_t expireAt = ttl.count() > 0 ? t + std::chrono::duration_cast<std::chrono::nanoseconds>(ttl).count() : 0;
+
+    RWLock::lockGuard guard(shard.lock);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()){
+        size_t slot = it->second;
+        Node& node = shard.ring[slot];
+        shard.bytes = shard.bytes - node.bytes + cost;
+        node.value = value;
+        node.bytes = cost;
+        node.expireAt = expireAt;
+        node.referenced.store(true, std::memory_order_relaxed);
+        // 更新后字节数可能超出上限，淘汰其他数据. 不允许淘汰正在更新的数据
+        while (this->overflowLocked(shard, shard.index.size(), 0) && shard.index.size() > 1){
+            size_t victim = this->victimLocked(shard, t);
+            if (victim == slot){
+                continue;
+            }
+            if (expired(shard.ring[victim], t)){
+                shard.expirations++;
+            } else{
+                shard.evictions++;
+            }
+            this->removeLocked(shard, victim);
+        }
+        return true;
+    }
+
+    bool admitted = !this->m_admission;
+    while (!shard.index.empty() && this->overflowLocked(shard, shard.index.size() + 1, cost)){
+        size_t victim = this->victimLocked(shard, t);
+        Node& node = shard.ring[victim];
+        if (expired(node, t)){
+            shard.expirations++;
+        } else{
+            if (!admitted){
+                if (shard.sketch.frequency(h) <= shard.sketch.frequency(this->hashOf(node.key))){
+                    shard.rejections++;
+                    return false;
+                }
+                admitted = true;
+            }
+            shard.evictions++;
+        }
+        this->removeLocked(shard, victim);
+    }
+
+    size_t slot;
+    if (!shard.freeSlots.empty()){
+        slot = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else{
+        slot = shard.ring.size();
+        shard.ring.emplace_back();
+    }
+    Node& node = shard.ring[slot];
+    node.key = key;
+    node.value = value;
+    node.bytes = cost;
+    node.expireAt = expireAt;
+    node.used = true;
+    node.referenced.store(false, std::memory_order_relaxed);
+    shard.index.insert({key, slot});
+    shard.bytes += cost;
+    return true;
+}
+
+template <class Key, class Value, class Hash>
+bool Cache<Key,Value,Hash>::evict(const Key& key){
+    Shard& shard = this->shardOf(this->hashOf(key));
+    RWLock::lockGuard guard(shard.lock);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()){
+        return false;
+    }
+    this->removeLocked(shard, it->second);
+    return true;
+}
+
+template <class Key, class Value, class Hash>
+size_t Cache<Key,Value,Hash>::size(){
+    size_t size = 0;
+    for (size_t i = 0; i < this->m_shards.size(); i++){
+        RWLock::readLockGuard guard(this->m_shards[i]->lock);
+        size += this->m_shards[i]->index.size();
+    }
+    return size;
+}
+
+template <class Key, class Value, class Hash>
+size_t Cache<Key,Value,Hash>::bytes(){
+    size_t bytes = 0;
+    for (size_t i = 0; i < this->m_shards.size(); i++){
+        RWLock::readLockGuard guard(this->m_shards[i]->lock);
+        bytes += this->m_shards[i]->bytes;
+    }
+    return bytes;
+}
+
+template <class Key, class Value, class Hash>
+typename Cache<Key,Value,Hash>::Stats Cache<Key,Value,Hash>::stats(){
+    Stats stats = {0, 0, 0, 0, 0};
+    for (size_t i = 0; i < this->m_shards.size(); i++){
+        Shard* shard = this->m_shards[i];
+        stats.hits += shard->hits.load(std::memory_order_relaxed);
+        stats.misses += shard->misses.load(std::memory_order_relaxed);
+        stats.evictions += shard->evictions.load(std::memory_order_relaxed);
+        stats.expirations += shard->expirations.load(std::memory_order_relaxed);
+        stats.rejections += shard->rejections.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+/**
+ * @brief: 计算 key 的哈希值
+ * std::hash 对整数类型通常是恒等映射，需要通过乘法散列打散高低位. 高位用于选择分片，全部位用于频率统计
+ */
+template <class Key, class Value, class Hash>
+uint64_t Cache<Key,Value,Hash>::hashOf(const Key& key) const{
+    return static_cast<uint64_t>(this->m_hash(key)) * 0x9E3779B97F4A7C15ULL;
+}
+
+template <class Key, class Value, class Hash>
+typename Cache<Key,Value,Hash>::Shard& Cache<Key,Value,Hash>::shardOf(const uint64_t h){
+    return *this->m_shards[(h >> 32) & this->m_mask];
+}
+
+template <class Key, class Value, class Hash>
+bool Cache<Key,Value,Hash>::overflowLocked(const Shard& shard, const size_t entries, const size_t extra) const{
+    if (shard.maxEntries != 0 && entries > shard.maxEntries){
+        return true;
+    }
+    return shard.maxBytes != 0 && shard.bytes + extra > shard.maxBytes;
+}
+
+/**
+ * @brief: CLOCK 淘汰
+ * 指针最多转动两圈：第一圈清除所有访问标识，第二圈必然能选中数据
+ */
+template <class Key, class Value, class Hash>
+size_t Cache<Key,Value,Hash>::victimLocked(Shard& shard, const int64_t t){
+    for (;;){
+        if (shard.hand >= shard.ring.size()){
+            shard.hand = 0;
+        }
+        size_t slot = shard.hand++;
+        Node& node = shard.ring[slot];
+        if (!node.used){
+            continue;
+        }
+        if (expired(node, t)){
+            return slot;
+        }
+        if (node.referenced.load(std::memory_order_relaxed)){
+            node.referenced.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        return slot;
+    }
+}
+
+// 移除数据并归还位置. 析构原有数据，及时释放 value 间接持有的内存
+template <class Key, class Value, class Hash>
+void Cache<Key,Value,Hash>::removeLocked(Shard& shard, const size_t slot){
+    Node& node = shard.ring[slot];
+    shard.index.erase(node.key);
+    shard.bytes -= node.bytes;
+    node.key = Key();
+    node.value = Value();
+    node.bytes = 0;
+    node.expireAt = 0;
+    node.used = false;
+    node.referenced.store(false, std::memory_order_relaxed);
+    shard.freeSlots.push_back(slot);
+}
+
+template <class Key, class Value, class Hash>
+bool Cache<Key,Value,Hash>::expired(const Node& node, const int64_t t){
+    return node.expireAt != 0 && node.expireAt <= t;
+}
+
+template <class Key, class Value, class Hash>
+int64_t Cache<Key,Value,Hash>::now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <class Key, class Value, class Hash>
+size_t Cache<Key,Value,Hash>::roundUp(const size_t n){
+    size_t r = 1;
+    while (r < n){
+        r <<= 1;
+    }
+    return r;
+}
+
+template <class Key, class Value, class Hash>
+Cache<Key,Value,Hash>::Shard::Shard(const size_t maxEntries, const size_t maxBytes, const size_t sketchWidth):maxEntries(maxEntries),maxBytes(maxBytes),hand(0),bytes(0),sketch(sketchWidth),hits(0),misses(0),evictions(0),expirations(0),rejections(0){}
+
+// 每行计数器数量取不小于 width 的 2 的整数次幂，采样上限取其 10 倍
+template <class Key, class Value, class Hash>
+Cache<Key,Value,Hash>::Sketch::Sketch(const size_t width):counters(4 * Cache<Key,Value,Hash>::roundUp(width < 16 ? 16 : width)),additions(0){
+    this->mask = counters.size() / 4 - 1;
+    this->sampleSize = 10 * (this->mask + 1);
+    for (size_t i = 0; i < this->counters.size(); i++){
+        this->counters[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief: 记录一次访问. 各行对应的计数器未达到上限时加一
+ * 累计记录次数达到采样上限的线程负责将所有计数器减半
+ */
+template <class Key, class Value, class Hash>
+void Cache<Key,Value,Hash>::Sketch::increment(const uint64_t h){
+    for (int row = 0; row < 4; row++){
+        std::atomic<uint8_t>& counter = this->counters[this->indexOf(h, row)];
+        uint8_t c = counter.load(std::memory_order_relaxed);
+        if (c < 15){
+            counter.store(c + 1, std::memory_order_relaxed);
+        }
+    }
+
+    if (this->additions.fetch_add(1, std::memory_order_relaxed) + 1 != this->sampleSize){
+        return;
+    }
+    for (size_t i = 0; i < this->counters.size(); i++){
+        this->counters[i].store(this->counters[i].load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+    }
+    this->additions.store(0, std::memory_order_relaxed);
+}
+
+// 估算访问频率，取各行计数器的最小值
+template <class Key, class Value, class Hash>
+int Cache<Key,Value,Hash>::Sketch::frequency(const uint64_t h) const{
+    int freq = 15;
+    for (int row = 0; row < 4; row++){
+        int c = this->counters[this->indexOf(h, row)].load(std::memory_order_relaxed);
+        if (c < freq){
+            freq = c;
+        }
+    }
+    return freq;
+}
+
+// 每行使用不同的种子对哈希值再次散列，取高位作为行内下标
+template <class Key, class Value, class Hash>
+size_t Cache<Key,Value,Hash>::Sketch::indexOf(const uint64_t h, const int row) const{
+    static const uint64_t seeds[4] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+    uint64_t x = (h + seeds[row]) * seeds[(row + 1) & 3];
+    return row * (this->mask + 1) + ((x >> 32) & this->mask);
+}
+
+}}
@@ -1,10 +1,10 @@
 #pragma once 
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <vector>
-#include <chrono>
-#include <thread>
 
 #include "../base/nocopy.h"
 #include "../base/defer.h"
@@ -36,24 +36,51 @@ public:
     // 从 channel 中读取数据. 如果 channel 是空的，则陷入阻塞
     // ret——true 读取数据成功. false 写入数据失败
     bool read(T& receiver, bool nonblock = false);
+    // 批量读取 receivers.size() 条数据. 只有凑满一批时才会读取，优雅关闭流程中残留数据不足一批时返回 false，残留数据保持不变
     bool readN(std::vector<T>& receivers, bool nonblock = false);
+    /**
+     * @brief: 读取至多 receivers.size() 条数据. 只要 channel 中存在数据就立即读取，不等待凑满一批
+     * @return: 实际读取的条数，写入 receivers 的前若干个位置，receivers 的长度保持不变. 0——读取失败
+     * tip：优雅关闭流程中需要消费完所有残留数据的批量 reader 应使用此方法
+     */
+    size_t readSome(std::vector<T>& receivers, bool nonblock = false);
 
     // 内部数据是否为空
     const bool empty();
     const int size();
     const int cap();
 
-    // 主动关闭 channel
+    // 主动关闭 channel. 阻塞中的 writer 和 reader 会被唤醒并返回 false，channel 中残留的数据被丢弃
     void close();
+    /**
+     * @brief: 优雅关闭 channel
+     * 1）立即拒绝新的写入，阻塞中的 writer 被唤醒并返回 false
+     * 2）reader 继续消费 channel 中残留的数据，读空后 reader 直接返回 false. 残留数据不足一批时 readN 同样返回 false，剩余部分需要通过 read 或 readSome 消费
+     * 3）残留数据被消费完毕后，执行 close 流程
+     * @param: idleTimeout——reader 连续 idleTimeout 时长没有消费任何数据时，视为不存在存活的 reader，放弃等待并丢弃残留数据
+     */
+    void drainAndClose(const std::chrono::milliseconds idleTimeout = std::chrono::milliseconds(1000));
 
 private:
     int roundTrip(int index);
+    /**
+     * @brief: 读取数据的公共流程. channel 中的数据不少于 least 条时，读取至多 receivers.size() 条
+     * @param: least——至少需要的数据条数. 数据不足时根据阻塞模式判定是陷入等待还是直接返回 false，优雅关闭流程中直接返回 false
+     * @param: count——实际读取的条数
+     */
+    bool readBatch(std::vector<T>& receivers, const size_t least, bool nonblock, size_t& count);
+    // 关闭 channel [调用此方法时一定处于持有 m_lock 状态]
+    void closeLocked();
 
 private:
     // 并发控制
     Lock m_lock;
     Cond m_readCond;
     Cond m_writeCond;
+    // 用于 close 流程等待所有活跃 writer 和 reader 退出
+    Cond m_closeCond;
+    // 用于 drainAndClose 流程等待残留数据被消费完毕
+    Cond m_drainCond;
     
     int m_front;
     int m_back;
@@ -64,9 +91,11 @@ private:
 
     // channel 是否已关闭
     std::atomic<bool> m_closed{false};
+    // channel 是否处于优雅关闭流程中. 此时拒绝写入，但允许读取残留数据
+    std::atomic<bool> m_draining{false};
 
-    // 记录当前活跃的 reader 和 writer 总数
-    std::atomic<int> m_subscribers{0};
+    // 记录当前活跃的 reader 和 writer 总数 [受 m_lock 保护]
+    int m_subscribers;
 };
 
 // 构造器函数
@@ -80,6 +109,7 @@ Channel<T>::Channel(const int cap){
     this->m_front = -1;
     this->m_back = -1;
     this->m_size = 0;
+    this->m_subscribers = 0;
 }
 
 // 析构函数，需要唤醒所有的 writer 和 reader 之后，再进行退出
@@ -90,28 +120,61 @@ Channel<T>::~Channel(){
 
 template <typename T>
 void Channel<T>::close(){
-    // 1 将 closed 标记为 true，保证不再生成新的 writer 和 reader
     if (this->m_closed.load()){
         return;
     } 
-    
-    // 2 唤醒所有的 writer 和 reader
-    {
-        this->m_lock.lock();
-        cbricks::base::Defer defer([this](){this->m_lock.unlock();});
 
-        if (this->m_closed.load()){
-            return;
-        } 
-        this->m_closed.store(true);
-        
-        this->m_readCond.broadcast();
-        this->m_writeCond.broadcast();
+    Lock::lockGuard guard(this->m_lock);
+    this->closeLocked();
+}
+
+template <typename T>
+void Channel<T>::drainAndClose(const std::chrono::milliseconds idleTimeout){
+    if (this->m_closed.load()){
+        return;
+    }
+
+    Lock::lockGuard guard(this->m_lock);
+    if (this->m_closed.load()){
+        return;
+    }
+
+    // 1 拒绝新的写入，并唤醒所有阻塞中的 writer 和 reader 重新检查状态
+    this->m_draining.store(true);
+    this->m_writeCond.broadcast();
+    this->m_readCond.broadcast();
+
+    // 2 等待 reader 将残留数据消费完毕. 期间若有其他调用方执行了 close，或者 reader 在 idleTimeout 内没有任何进展，则退出等待
+    while (this->m_size > 0 && !this->m_closed.load()){
+        int before = this->m_size;
+        if (!this->m_drainCond.waitUntil(this->m_lock, std::chrono::system_clock::now() + idleTimeout) && this->m_size == before){
+            break;
+        }
+    }
+
+    // 3 执行 close 流程
+    this->closeLocked();
+}
+
+/**
+ * @brief: 关闭 channel [调用此方法时一定处于持有 m_lock 状态]
+ * 1）将 closed 标记为 true，保证不再生成新的 writer 和 reader
+ * 2）唤醒所有的 writer 和 reader
+ * 3）基于条件变量等待，直到最后一个 writer 或 reader 退出时将其唤醒
+ */
+template <typename T>
+void Channel<T>::closeLocked(){
+    if (this->m_closed.load()){
+        return;
     }
+    this->m_closed.store(true);
 
-    // 3 阻塞等待，直到所有 writer 和 reader 都正常退出
-    while (this->m_subscribers){
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    this->m_readCond.broadcast();
+    this->m_writeCond.broadcast();
+    this->m_drainCond.broadcast();
+
+    while (this->m_subscribers > 0){
+        this->m_closeCond.wait(this->m_lock);
     }
 }
 
@@ -134,13 +197,18 @@ bool Channel<T>::writeN(std::vector<T> datas, bool nonblock){
     this->m_lock.lock();
     cbricks::base::Defer lockDefer([this](){this->m_lock.unlock();});
 
-    // 已关闭
-    if (this->m_closed.load()){
+    // 已关闭或处于优雅关闭流程中
+    if (this->m_closed.load() || this->m_draining.load()){
         return false; 
     }
 
+    // 登记为活跃的 writer. 退出时若 channel 已关闭且自身为最后一个 subscriber，则唤醒 close 流程
     this->m_subscribers++;
-    cbricks::base::Defer suscribeDefer([this](){this->m_subscribers--;});
+    cbricks::base::Defer suscribeDefer([this](){
+        if (--this->m_subscribers == 0 && this->m_closed.load()){
+            this->m_closeCond.signal();
+        }
+    });
 
     // 如果容量已满
     while (this->m_size + datas.size() > this->m_array.size()){
@@ -152,8 +220,8 @@ bool Channel<T>::writeN(std::vector<T> datas, bool nonblock){
         // 阻塞模式，则陷入等待
         this->m_writeCond.wait(this->m_lock);
 
-        // 已关闭，直接退出
-        if (this->m_closed.load()){
+        // 已关闭或处于优雅关闭流程中，直接退出
+        if (this->m_closed.load() || this->m_draining.load()){
             return false;
         }
     }
@@ -184,6 +252,21 @@ bool Channel<T>::read(T& receiver, bool nonblock){
 
 template <typename T>
 bool Channel<T>::readN(std::vector<T>& receivers, bool nonblock){
+    size_t count;
+    return this->readBatch(receivers,receivers.size(),nonblock,count);
+}
+
+template <typename T>
+size_t Channel<T>::readSome(std::vector<T>& receivers, bool nonblock){
+    size_t count;
+    if (receivers.empty() || !this->readBatch(receivers,1,nonblock,count)){
+        return 0;
+    }
+    return count;
+}
+
+template <typename T>
+bool Channel<T>::readBatch(std::vector<T>& receivers, const size_t least, bool nonblock, size_t& count){
     if (this->m_closed.load()){
         return false; 
     }
@@ -196,9 +279,19 @@ bool Channel<T>::readN(std::vector<T>& receivers, bool nonblock){
     }
 
     this->m_subscribers++;
-    cbricks::base::Defer subscribeDefer([this](){this->m_subscribers--;});
+    cbricks::base::Defer subscribeDefer([this](){
+        if (--this->m_subscribers == 0 && this->m_closed.load()){
+            this->m_closeCond.signal();
+        }
+    });
+
+    while ((size_t)this->m_size < least){
+        // 处于优雅关闭流程中，不会再有新数据写入，数据不足时直接退出
+        if (this->m_draining.load()){
+            return false;
+        }
 
-    while (this->m_size < receivers.size()){
+        // 非阻塞模式，直接退出
         if (nonblock){
             return false;
         }
@@ -210,12 +303,18 @@ bool Channel<T>::readN(std::vector<T>& receivers, bool nonblock){
     }
 
     // 读取数据
-    for (int i = 0; i < receivers.size(); i++){
+    count = std::min((size_t)this->m_size, receivers.size());
+    for (size_t i = 0; i < count; i++){
         this->m_front = this->roundTrip(this->m_front);
         receivers[i] = this->m_array[this->m_front];
         this->m_size--;
     }
 
+    // 残留数据已消费完毕，唤醒 drainAndClose 流程
+    if (this->m_size == 0 && this->m_draining.load()){
+        this->m_drainCond.signal();
+    }
+
     // 读取成功后需要唤醒 writer 然后解锁
     this->m_writeCond.signal();
     return true;
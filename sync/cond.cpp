@@ -21,6 +21,15 @@ bool Cond::waitFor(Lock& lock, seconds secs){
     return pthread_cond_timedwait(&this->m_cond,lock.rawMutex(),&t) == 0;
 }
 
+bool Cond::waitUntil(Lock& lock, const timePoint& deadline){
+    // pthread_cond_timedwait 默认基于 CLOCK_REALTIME，与 system_clock 一致
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    timespec t;
+    t.tv_sec = ns / 1000000000;
+    t.tv_nsec = ns % 1000000000;
+    return pthread_cond_timedwait(&this->m_cond,lock.rawMutex(),&t) == 0;
+}
+
 bool Cond::signal(){
     return pthread_cond_signal(&this->m_cond) == 0;
 }
@@ -11,6 +11,7 @@ namespace cbricks{ namespace sync{
 class Cond : base::Noncopyable{
 public:
     typedef std::chrono::seconds seconds;
+    typedef std::chrono::system_clock::time_point timePoint;
 
 public:
     // 构造/析构函数
@@ -21,6 +22,8 @@ public:
     // 公有操作函数
     bool wait(Lock& lock);
     bool waitFor(Lock& lock, seconds secs);
+    // 等待直到被唤醒或到达绝对时间 deadline. 被唤醒时返回 true，超时返回 false
+    bool waitUntil(Lock& lock, const timePoint& deadline);
     bool signal();
     bool broadcast();
 
@@ -5,10 +5,12 @@
 #include <ucontext.h>
 
 #include "../base/nocopy.h"
+#include "../memory/slab.h"
 
 namespace cbricks{ namespace sync{
 
-class Coroutine : base::Noncopyable, std::enable_shared_from_this<Coroutine>{
+// 协程实例通过 slab 分配器分配，频繁创建、销毁协程时不必每次都访问 malloc
+class Coroutine : base::Noncopyable, std::enable_shared_from_this<Coroutine>, public memory::SlabObject{
 public:
     // 智能指针类型别名
     typedef std::shared_ptr<Coroutine> ptr;
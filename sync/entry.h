@@ -0,0 +1,658 @@
+#pragma once
+
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+#include "epoch.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * @brief: sync::Map 中存放 value 数据的容器
+ * 容器存在三种状态：
+ * 1）硬删除态 expunged：dirty 中一定没有该 entry，要恢复数据必须对 dirty 执行 insert 操作
+ * 2）软删除态：数据逻辑意义上已被删除，但是 dirty 中还有该数据，还能快速恢复过来
+ * 3）正常态：数据仍存在，未被删除
+ * 根据 Value 类型在编译期选择存储方式：
+ *  - 可平凡拷贝且不超过 8 字节的类型，数据直接存放在 entry 内部的原子变量中，读取无需等待，正常态下的写入与 cas 均只需一次原子操作
+ *  - 其他类型，数据存放在堆上的 WrappedV 中，entry 中仅存放指针. WrappedV 通过 epoch 延迟回收后进入线程本地池复用
+ * 所有方法都需要在 epoch 临界区内调用
+ */
+template <class Value, bool Inline = std::is_trivially_copyable<Value>::value && sizeof(Value) <= sizeof(uint64_t)>
+class MapEntry;
+
+/**
+ * 堆上存储的 entry 实现
+ */
+template <class Value>
+class MapEntry<Value, false>{
+public:
+    // 智能指针 类型别名
+    typedef std::shared_ptr<MapEntry> ptr;
+
+public:
+    // 构造函数，入参为存储数据
+    MapEntry(const Value& v);
+    // 析构函数
+    ~MapEntry();
+
+public:
+    /**
+     * @brief: 从 entry 中读取数据，存储到 receiver 中
+     * @param: 承载读取数据的容器
+     * @return: true——读取成功 false——读取失败（处于删除态）
+     */
+    bool load(Value& receiver) const;
+
+    /**
+     * @brief: 将数据存储在 entry 中 [调用此方法时一定处于持有 dirtyLock 状态，且 entry 不为硬删除态]
+     * @param: v——拟存储的数据
+     */
+    void storeLocked(const Value& v);
+
+    /**
+     * @brief: 尝试将数据存储在 entry 中
+     * @param: v——尝试存储的数据
+     * @return: true——存储成功 false——存储失败（硬删除态 expunged 时存储失败）
+     */
+    bool tryStore(const Value& v);
+
+    // 删除 entry 中存储的数据，置为软删除态
+    void evict();
+
+    /**
+     * @brief: 数据存在时读取数据，否则尝试存储数据
+     * @param: v——尝试存储的数据
+     * @param: actual——接收最终数据的容器. 读取成功时为已有数据，存储成功时为 v
+     * @param: loaded——true 表示读取到已有数据，false 表示存储了 v
+     * @return: true——操作成功 false——处于硬删除态，操作失败
+     */
+    bool tryLoadOrStore(const Value& v, Value& actual, bool& loaded);
+
+    /**
+     * @brief: 删除 entry 中存储的数据，并将被删除的数据存储到 receiver 中
+     * @return: true——删除成功 false——此前已处于删除态
+     */
+    bool loadAndEvict(Value& receiver);
+
+    /**
+     * @brief: 当前数据与 old 相等时，将其替换为 v. 需要 Value 支持 == 运算
+     * @return: true——替换成功 false——数据不相等或处于删除态
+     */
+    bool tryCompareAndSwap(const Value& old, const Value& v);
+
+    /**
+     * @brief: 当前数据与 old 相等时，将其删除. 需要 Value 支持 == 运算
+     * @return: true——删除成功 false——数据不相等或处于删除态
+     */
+    bool tryCompareAndEvict(const Value& old);
+
+    /**
+     * @brief: 将 entry 置为非硬删除态
+     * @return: true——之前处于硬删除态（expunged），更新成功；false——之前处于非硬删除态，无需更新
+     */
+    bool unexpungeLocked();
+
+    /**
+     * @brief: 尝试将 entry 置为硬删除态（expunged）
+     * @return: true——之前就是硬删除态，或者成功将软删除态置为硬删除态； false——更新失败（此前数据未删除）
+     */
+    bool tryExpungeLocked();
+
+private:
+    // 对存储数据使用该类型的指针进行封装
+    struct WrappedV{
+        WrappedV() = default;
+        WrappedV(const Value& v):v(v){}
+
+        Value v;
+    };
+
+    /**
+     * 线程本地的 WrappedV 池
+     * 线程退出时 epoch 记录的析构流程仍可能回收 WrappedV，而线程本地对象的析构顺序不可控，
+     * 因此池本身为平凡类型，在线程整个生命周期内有效；由单独的 LocalPoolCleaner 负责在析构时清空池并将其关闭
+     */
+    struct LocalPool{
+        WrappedV* boxes[64];
+        int size;
+        // 池是否已关闭. 关闭后回收的 WrappedV 直接释放
+        bool closed;
+    };
+
+    struct LocalPoolCleaner{
+        ~LocalPoolCleaner();
+    };
+
+private:
+    // 获取一个 WrappedV 并写入数据，优先从线程本地池中复用
+    static WrappedV* allocBox(const Value& v);
+    // [epoch 回收函数] 重置 WrappedV 中的数据后放回线程本地池，池已满时直接释放
+    static void recycleBox(void* box);
+    // 获取线程本地的 WrappedV 池
+    static LocalPool& localPool();
+
+private:
+    // 全局静态变量，标记硬删除状态
+    static WrappedV* s_expunged;
+    // 线程本地的 WrappedV 池
+    static thread_local LocalPool t_pool;
+
+private:
+    /**
+     * 存放数据的 atomic 容器
+     * 1）s_expunged：硬删除态
+     * 2）nullptr：软删除态
+     * 3）其他：正常态
+    */
+    std::atomic<WrappedV*> m_container;
+};
+
+template <class Value>
+typename MapEntry<Value,false>::WrappedV* MapEntry<Value,false>::s_expunged = new typename MapEntry<Value,false>::WrappedV();
+
+template <class Value>
+thread_local typename MapEntry<Value,false>::LocalPool MapEntry<Value,false>::t_pool;
+
+template <class Value>
+MapEntry<Value,false>::MapEntry(const Value& v):m_container(MapEntry::allocBox(v)){}
+
+// 析构时 entry 已不可能被无锁读取方访问，WrappedV 可直接回收
+template <class Value>
+MapEntry<Value,false>::~MapEntry(){
+    WrappedV* wv = this->m_container.load();
+    if (wv == nullptr || wv == s_expunged){
+        return;
+    }
+    MapEntry::recycleBox(wv);
+}
+
+template <class Value>
+bool MapEntry<Value,false>::load(Value& receiver) const{
+    WrappedV* wv = this->m_container.load(std::memory_order_acquire);
+    if (wv == nullptr || wv == s_expunged){
+        return false;
+    }
+
+    receiver = wv->v;
+    return true;
+}
+
+template <class Value>
+void MapEntry<Value,false>::storeLocked(const Value& v){
+    WrappedV* old = this->m_container.exchange(MapEntry::allocBox(v));
+    // 无锁读取方可能仍在访问 old，通过 epoch 延迟回收
+    if (old != nullptr){
+        Epoch::Retire(old, &MapEntry::recycleBox);
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,false>::tryStore(const Value& v){
+    WrappedV* _new = MapEntry::allocBox(v);
+    WrappedV* old = this->m_container.load();
+    while (true){
+        // 若此前已处于硬删除（expunged），则更新失败. _new 尚未发布，可直接回收
+        if (old == s_expunged){
+            MapEntry::recycleBox(_new);
+            return false;
+        }
+
+        // cas 失败时 old 会被更新为最新值
+        if (this->m_container.compare_exchange_weak(old,_new)){
+            if (old != nullptr){
+                Epoch::Retire(old, &MapEntry::recycleBox);
+            }
+            return true;
+        }
+    }
+}
+
+template <class Value>
+void MapEntry<Value,false>::evict(){
+    WrappedV* old = this->m_container.load();
+    while (true){
+        if (old == nullptr || old == s_expunged){
+            return;
+        }
+        if (this->m_container.compare_exchange_weak(old,nullptr)){
+            Epoch::Retire(old, &MapEntry::recycleBox);
+            return;
+        }
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,false>::tryLoadOrStore(const Value& v, Value& actual, bool& loaded){
+    WrappedV* old = this->m_container.load(std::memory_order_acquire);
+    if (old == s_expunged){
+        return false;
+    }
+    if (old != nullptr){
+        actual = old->v;
+        loaded = true;
+        return true;
+    }
+
+    // 处于软删除态，尝试存储. 过程中可能与其他写入方并发，需要根据 cas 失败后的最新值重新判断
+    WrappedV* _new = MapEntry::allocBox(v);
+    while (true){
+        if (this->m_container.compare_exchange_weak(old,_new)){
+            actual = v;
+            loaded = false;
+            return true;
+        }
+        if (old == s_expunged){
+            MapEntry::recycleBox(_new);
+            return false;
+        }
+        if (old != nullptr){
+            MapEntry::recycleBox(_new);
+            actual = old->v;
+            loaded = true;
+            return true;
+        }
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,false>::loadAndEvict(Value& receiver){
+    WrappedV* old = this->m_container.load();
+    while (true){
+        if (old == nullptr || old == s_expunged){
+            return false;
+        }
+        if (this->m_container.compare_exchange_weak(old,nullptr)){
+            receiver = old->v;
+            Epoch::Retire(old, &MapEntry::recycleBox);
+            return true;
+        }
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,false>::tryCompareAndSwap(const Value& old, const Value& v){
+    WrappedV* cur = this->m_container.load(std::memory_order_acquire);
+    if (cur == nullptr || cur == s_expunged || !(cur->v == old)){
+        return false;
+    }
+
+    WrappedV* _new = MapEntry::allocBox(v);
+    while (true){
+        if (this->m_container.compare_exchange_weak(cur,_new)){
+            Epoch::Retire(cur, &MapEntry::recycleBox);
+            return true;
+        }
+        if (cur == nullptr || cur == s_expunged || !(cur->v == old)){
+            MapEntry::recycleBox(_new);
+            return false;
+        }
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,false>::tryCompareAndEvict(const Value& old){
+    WrappedV* cur = this->m_container.load(std::memory_order_acquire);
+    while (true){
+        if (cur == nullptr || cur == s_expunged || !(cur->v == old)){
+            return false;
+        }
+        if (this->m_container.compare_exchange_weak(cur,nullptr)){
+            Epoch::Retire(cur, &MapEntry::recycleBox);
+            return true;
+        }
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,false>::unexpungeLocked(){
+    // cas 失败时会将当前值回写到 expected 中，因此不能直接传入 s_expunged，否则会篡改全局的硬删除标记
+    WrappedV* expected = s_expunged;
+    return this->m_container.compare_exchange_strong(expected,nullptr);
+}
+
+template <class Value>
+bool MapEntry<Value,false>::tryExpungeLocked(){
+    WrappedV* wv = this->m_container.load();
+    while (wv == nullptr){
+        if (this->m_container.compare_exchange_strong(wv, s_expunged)){
+            return true;
+        }
+    }
+
+    return wv == s_expunged;
+}
+
+template <class Value>
+typename MapEntry<Value,false>::WrappedV* MapEntry<Value,false>::allocBox(const Value& v){
+    LocalPool& pool = MapEntry::localPool();
+    if (pool.size == 0){
+        return new WrappedV(v);
+    }
+
+    WrappedV* box = pool.boxes[--pool.size];
+    box->v = v;
+    return box;
+}
+
+template <class Value>
+void MapEntry<Value,false>::recycleBox(void* ptr){
+    WrappedV* box = static_cast<WrappedV*>(ptr);
+    LocalPool& pool = MapEntry::localPool();
+    if (pool.closed || pool.size >= sizeof(pool.boxes) / sizeof(pool.boxes[0])){
+        delete box;
+        return;
+    }
+
+    // 释放残留数据持有的资源
+    box->v = Value();
+    pool.boxes[pool.size++] = box;
+}
+
+// 首次访问时构造 cleaner，保证线程退出时池中的 WrappedV 能被释放
+template <class Value>
+typename MapEntry<Value,false>::LocalPool& MapEntry<Value,false>::localPool(){
+    static thread_local LocalPoolCleaner cleaner;
+    (void)cleaner;
+    return t_pool;
+}
+
+template <class Value>
+MapEntry<Value,false>::LocalPoolCleaner::~LocalPoolCleaner(){
+    for (int i = 0; i < t_pool.size; i++){
+        delete t_pool.boxes[i];
+    }
+    t_pool.size = 0;
+    t_pool.closed = true;
+}
+
+/**
+ * 内联存储的 entry 实现
+ * 数据按位存放在原子变量 m_value 中，状态存放在独立的状态字 m_state 中. 状态字低 2 位为状态，其余位为版本号，每次状态变化时递增
+ * - 读取：依次读取状态字、数据、状态字，不存在重试与等待. 两次读到的状态字不一致，说明读取期间数据被删除，视为不存在
+ * - 正常态下的写入与 cas 均只需对 m_value 执行一次原子操作，不修改状态字
+ * - 删除：对状态字执行一次 cas，由正常态置为软删除态
+ * - 恢复：软删除态下写入时，先通过 cas 将状态置为恢复中，写入数据后再置为正常态. 恢复中对读取方而言等同于删除态，
+ *   其他写入方需要等待恢复完成，同一 key 上的写入方之间才可能发生等待，读取方永远不会等待
+ * 写入与删除并发时，若写入发生在删除方读取数据之后，写入视为发生在删除之前，随删除一并丢弃
+ */
+template <class Value>
+class MapEntry<Value, true>{
+public:
+    // 智能指针 类型别名
+    typedef std::shared_ptr<MapEntry> ptr;
+
+public:
+    // 构造函数，入参为存储数据
+    MapEntry(const Value& v);
+
+public:
+    // 读取数据. 处于删除态时返回 false
+    bool load(Value& receiver) const;
+    // 存储数据 [调用此方法时一定处于持有 dirtyLock 状态，且 entry 不为硬删除态]
+    void storeLocked(const Value& v);
+    // 尝试存储数据. 处于硬删除态时返回 false
+    bool tryStore(const Value& v);
+    // 删除数据，置为软删除态
+    void evict();
+    // 数据存在时读取到 actual 中（loaded 为 true），否则尝试存储 v（loaded 为 false）. 处于硬删除态时返回 false
+    bool tryLoadOrStore(const Value& v, Value& actual, bool& loaded);
+    // 删除数据并将被删除的数据存储到 receiver 中. 此前已处于删除态时返回 false
+    bool loadAndEvict(Value& receiver);
+    // 当前数据与 old 相等时替换为 v. 需要 Value 支持 == 运算
+    bool tryCompareAndSwap(const Value& old, const Value& v);
+    // 当前数据与 old 相等时将其删除. 需要 Value 支持 == 运算
+    bool tryCompareAndEvict(const Value& old);
+    // 将 entry 由硬删除态置为软删除态. 此前处于硬删除态时返回 true
+    bool unexpungeLocked();
+    // 尝试将 entry 由软删除态置为硬删除态. 此前处于或成功置为硬删除态时返回 true
+    bool tryExpungeLocked();
+
+private:
+    // 状态字各字段
+    enum{
+        // 正常态
+        PRESENT = 0,
+        // 软删除态
+        DELETED = 1,
+        // 硬删除态
+        EXPUNGED = 2,
+        // 恢复中：由软删除态恢复为正常态的过程中
+        REVIVING = 3,
+        // 状态掩码
+        STATE_MASK = 3,
+        // 版本号递增步长
+        VERSION = 4
+    };
+
+private:
+    // [写入方] 等待正在进行的恢复完成，返回最新的状态字
+    uint64_t settledState() const;
+    // 读取状态字为 seq 时的数据. 读取期间状态字发生变化时返回 false
+    bool loadAt(const uint64_t seq, Value& receiver) const;
+    // 软删除态下写入数据，将 entry 恢复为正常态. 状态字不为 seq 时返回 false
+    bool revive(uint64_t seq, const Value& v);
+    // 将 seq 中的状态替换为 state，并递增版本号
+    static uint64_t next(const uint64_t seq, const uint64_t state);
+    // 数据与 uint64_t 之间的按位转换
+    static uint64_t toBits(const Value& v);
+    static Value fromBits(const uint64_t bits);
+
+private:
+    // 状态字
+    std::atomic<uint64_t> m_state;
+    // 数据
+    std::atomic<uint64_t> m_value;
+};
+
+template <class Value>
+MapEntry<Value,true>::MapEntry(const Value& v):m_state(PRESENT),m_value(MapEntry::toBits(v)){}
+
+template <class Value>
+bool MapEntry<Value,true>::load(Value& receiver) const{
+    uint64_t seq = this->m_state.load(std::memory_order_acquire);
+    if ((seq & STATE_MASK) != PRESENT){
+        return false;
+    }
+    return this->loadAt(seq, receiver);
+}
+
+template <class Value>
+void MapEntry<Value,true>::storeLocked(const Value& v){
+    this->tryStore(v);
+}
+
+/**
+ * @brief: 尝试存储数据
+ * 1）正常态下直接写入 m_value
+ * 2）软删除态下执行恢复流程
+ * 3）恢复中时等待恢复完成后重试
+ */
+template <class Value>
+bool MapEntry<Value,true>::tryStore(const Value& v){
+    while (true){
+        uint64_t seq = this->settledState();
+        switch (seq & STATE_MASK){
+        case EXPUNGED:
+            return false;
+        case PRESENT:
+            this->m_value.store(MapEntry::toBits(v), std::memory_order_release);
+            return true;
+        default:
+            if (this->revive(seq, v)){
+                return true;
+            }
+        }
+    }
+}
+
+template <class Value>
+void MapEntry<Value,true>::evict(){
+    uint64_t seq = this->m_state.load(std::memory_order_acquire);
+    while ((seq & STATE_MASK) == PRESENT){
+        if (this->m_state.compare_exchange_weak(seq, MapEntry::next(seq, DELETED))){
+            return;
+        }
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,true>::tryLoadOrStore(const Value& v, Value& actual, bool& loaded){
+    while (true){
+        uint64_t seq = this->settledState();
+        switch (seq & STATE_MASK){
+        case EXPUNGED:
+            return false;
+        case PRESENT:
+            if (this->loadAt(seq, actual)){
+                loaded = true;
+                return true;
+            }
+            break;
+        default:
+            if (this->revive(seq, v)){
+                actual = v;
+                loaded = false;
+                return true;
+            }
+        }
+    }
+}
+
+// 先读取数据，再通过 cas 将状态字置为软删除态. cas 成功说明期间不存在恢复流程，被删除的正是读取到的数据
+template <class Value>
+bool MapEntry<Value,true>::loadAndEvict(Value& receiver){
+    uint64_t seq = this->m_state.load(std::memory_order_acquire);
+    while ((seq & STATE_MASK) == PRESENT){
+        uint64_t bits = this->m_value.load(std::memory_order_acquire);
+        if (this->m_state.compare_exchange_weak(seq, MapEntry::next(seq, DELETED))){
+            receiver = MapEntry::fromBits(bits);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 比较通过后对 m_value 执行一次 cas. 期间数据被其他写入方修改时 cas 失败，重新读取后比较
+template <class Value>
+bool MapEntry<Value,true>::tryCompareAndSwap(const Value& old, const Value& v){
+    uint64_t bits = this->m_value.load(std::memory_order_acquire);
+    while (true){
+        if ((this->m_state.load(std::memory_order_acquire) & STATE_MASK) != PRESENT){
+            return false;
+        }
+        if (!(MapEntry::fromBits(bits) == old)){
+            return false;
+        }
+        if (this->m_value.compare_exchange_weak(bits, MapEntry::toBits(v), std::memory_order_acq_rel, std::memory_order_acquire)){
+            return true;
+        }
+    }
+}
+
+template <class Value>
+bool MapEntry<Value,true>::tryCompareAndEvict(const Value& old){
+    uint64_t seq = this->m_state.load(std::memory_order_acquire);
+    while ((seq & STATE_MASK) == PRESENT){
+        if (!(MapEntry::fromBits(this->m_value.load(std::memory_order_acquire)) == old)){
+            return false;
+        }
+        if (this->m_state.compare_exchange_weak(seq, MapEntry::next(seq, DELETED))){
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Value>
+bool MapEntry<Value,true>::unexpungeLocked(){
+    uint64_t seq = this->m_state.load(std::memory_order_acquire);
+    while ((seq & STATE_MASK) == EXPUNGED){
+        if (this->m_state.compare_exchange_weak(seq, MapEntry::next(seq, DELETED))){
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Value>
+bool MapEntry<Value,true>::tryExpungeLocked(){
+    while (true){
+        uint64_t seq = this->settledState();
+        if ((seq & STATE_MASK) != DELETED){
+            return (seq & STATE_MASK) == EXPUNGED;
+        }
+        if (this->m_state.compare_exchange_weak(seq, MapEntry::next(seq, EXPUNGED))){
+            return true;
+        }
+    }
+}
+
+template <class Value>
+uint64_t MapEntry<Value,true>::settledState() const{
+    uint64_t seq = this->m_state.load(std::memory_order_acquire);
+    while ((seq & STATE_MASK) == REVIVING){
+        sched_yield();
+        seq = this->m_state.load(std::memory_order_acquire);
+    }
+    return seq;
+}
+
+/**
+ * @brief: 读取状态字为 seq 时的数据
+ * 状态字由正常态变化只可能是被删除. 二次读取到的状态字与 seq 不一致时，读取期间存在某一时刻数据处于删除态，
+ * 读取视为发生在该时刻，返回 false；否则读取期间始终处于正常态，读到的数据有效
+ */
+template <class Value>
+bool MapEntry<Value,true>::loadAt(const uint64_t seq, Value& receiver) const{
+    uint64_t bits = this->m_value.load(std::memory_order_acquire);
+    // 保证数据的读取先于状态字的二次读取
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (this->m_state.load(std::memory_order_relaxed) != seq){
+        return false;
+    }
+    receiver = MapEntry::fromBits(bits);
+    return true;
+}
+
+/**
+ * @brief: 软删除态下写入数据
+ * 1）通过 cas 将状态置为恢复中，同一时刻只有一个写入方执行恢复
+ * 2）写入数据. release 语义保证读取方一旦读到新数据，二次读取状态字时必然能看到状态变化
+ * 3）将状态置为正常态
+ */
+template <class Value>
+bool MapEntry<Value,true>::revive(uint64_t seq, const Value& v){
+    uint64_t reviving = MapEntry::next(seq, REVIVING);
+    if (!this->m_state.compare_exchange_strong(seq, reviving)){
+        return false;
+    }
+    this->m_value.store(MapEntry::toBits(v), std::memory_order_release);
+    this->m_state.store(MapEntry::next(reviving, PRESENT), std::memory_order_release);
+    return true;
+}
+
+template <class Value>
+uint64_t MapEntry<Value,true>::next(const uint64_t seq, const uint64_t state){
+    return ((seq & ~uint64_t(STATE_MASK)) + VERSION) | state;
+}
+
+template <class Value>
+uint64_t MapEntry<Value,true>::toBits(const Value& v){
+    uint64_t bits = 0;
+    memcpy(&bits, &v, sizeof(Value));
+    return bits;
+}
+
+template <class Value>
+Value MapEntry<Value,true>::fromBits(const uint64_t bits){
+    Value v;
+    memcpy(&v, &bits, sizeof(Value));
+    return v;
+}
+
+}}
@@ -0,0 +1,301 @@
+#include <utility>
+#include <vector>
+
+#include "epoch.h"
+#include "lock.h"
+
+namespace cbricks{namespace sync{
+
+// 全局 epoch，单调递增
+static std::atomic<uint64_t> s_epoch{0};
+
+/**
+ * 线程持有的 epoch 记录
+ * 退休列表共三组，按照退休时的 epoch % 3 轮转使用：
+ * 全局 epoch 为 e 时，e-1 组中的数据可能仍被临界区中的线程访问，e-2 组（即 e+1 组）中的数据已可安全回收
+ */
+struct EpochRecord{
+    // 退休数据 类型别名
+    typedef std::pair<void*, Epoch::deleter> retired;
+
+    /**
+     * 线程状态
+     * 最低位为 1 表示处于临界区中，其余位为进入临界区时观察到的全局 epoch
+     */
+    std::atomic<uint64_t> state;
+    // 记录是否被某个线程占用
+    std::atomic<bool> active;
+    // 全局记录链表中的后继记录
+    EpochRecord* next;
+
+    // 临界区嵌套层数，仅由持有记录的线程访问
+    int nest;
+    // 按 epoch 轮转的退休列表
+    std::vector<retired> limbo[3];
+    // 各组退休列表对应的 epoch
+    uint64_t limboEpoch[3];
+    // 退休列表中的数据总量
+    int retiredCnt;
+    // 是否正处于回收流程中，防止回收函数中的嵌套调用重复触发回收
+    bool reclaiming;
+
+    EpochRecord():state(0),active(true),next(nullptr),nest(0),retiredCnt(0),reclaiming(false){
+        for (int i = 0; i < 3; i++){
+            this->limboEpoch[i] = 0;
+        }
+    }
+};
+
+// 全局记录链表头. 只增不减
+static std::atomic<EpochRecord*> s_records{nullptr};
+
+/**
+ * 已退出线程遗留的退休数据，由任意线程在回收流程中接管
+ * 与退休时的 epoch 一并存放，满足回收条件后才会被回收
+ */
+struct EpochOrphans{
+    Lock lock;
+    std::vector<std::pair<uint64_t, EpochRecord::retired>> list;
+};
+// 进程退出时仍可能有线程在退出流程中访问，因此不随静态变量析构
+static EpochOrphans* s_orphans = new EpochOrphans;
+// 遗留数据的数量，用于在无遗留数据时跳过加锁
+static std::atomic<int> s_orphanCnt{0};
+
+// 从全局记录链表中获取一条空闲记录，不存在时新建记录并插入链表头部
+static EpochRecord* acquireRecord(){
+    for (EpochRecord* move = s_records.load(); move; move = move->next){
+        bool expected = false;
+        if (!move->active.load() && move->active.compare_exchange_strong(expected, true)){
+            return move;
+        }
+    }
+
+    EpochRecord* record = new EpochRecord;
+    EpochRecord* head = s_records.load();
+    do{
+        record->next = head;
+    } while (!s_records.compare_exchange_weak(head, record));
+    return record;
+}
+
+/**
+ * @brief: 释放记录的占用. 调用方需保证记录已退出临界区
+ * 尚不满足回收条件的数据移交给全局遗留列表，避免在记录被复用前一直滞留
+ */
+static void releaseRecord(EpochRecord* record){
+    Lock::lockGuard guard(s_orphans->lock);
+    for (int i = 0; i < 3; i++){
+        std::vector<EpochRecord::retired>& limbo = record->limbo[i];
+        for (size_t j = 0; j < limbo.size(); j++){
+            s_orphans->list.push_back({record->limboEpoch[i], limbo[j]});
+        }
+        s_orphanCnt += limbo.size();
+        limbo.clear();
+    }
+    record->retiredCnt = 0;
+    record->active.store(false);
+}
+
+// 当前线程记录的缓存，避免每次访问都经过 thread_local 对象的构造检查
+static thread_local EpochRecord* t_cachedRecord = nullptr;
+/**
+ * 当前线程的 t_record 是否已经析构
+ * 线程退出时，晚于 t_record 析构的其他 thread_local 对象仍可能在析构函数中使用 epoch，此时不能再访问 t_record
+ */
+static thread_local bool t_recordReleased = false;
+
+/**
+ * 线程本地的记录持有者
+ * 线程首次使用 epoch 时获取记录，线程退出时执行一次回收并释放占用，残留的退休数据移交给全局遗留列表
+ */
+struct LocalEpochRecord{
+    EpochRecord* record;
+
+    LocalEpochRecord():record(acquireRecord()){}
+
+    /**
+     * 释放占用后记录可能立即被其他线程获取，因此同时清空缓存，
+     * 此后当前线程再使用 epoch 时走 getRecord 中的线程退出路径，不会继续访问已被他人持有的记录
+     */
+    ~LocalEpochRecord(){
+        this->record->nest = 0;
+        this->record->state.store(0);
+        Epoch::Reclaim();
+        releaseRecord(this->record);
+        t_cachedRecord = nullptr;
+        t_recordReleased = true;
+    }
+};
+
+static thread_local LocalEpochRecord t_record;
+
+/**
+ * @brief: 获取当前线程的记录
+ * 线程退出流程中 t_record 已析构时，临时获取一条记录，在离开临界区或完成本次调用后由 releaseExited 释放
+ */
+static EpochRecord* getRecord(){
+    if (!t_cachedRecord){
+        t_cachedRecord = t_recordReleased ? acquireRecord() : t_record.record;
+    }
+    return t_cachedRecord;
+}
+
+// 线程退出流程中临时获取的记录，在不处于临界区及回收流程中时立即释放
+static void releaseExited(EpochRecord* record){
+    if (!t_recordReleased || t_cachedRecord != record || record->nest > 0 || record->reclaiming){
+        return;
+    }
+    t_cachedRecord = nullptr;
+    releaseRecord(record);
+}
+
+/**
+ * @brief: 回收指定组的退休列表
+ * 先将列表转移到局部容器中再逐一回收，回收函数中再次退休数据时不会影响遍历. 列表未被再次写入时归还其容量，避免反复分配
+ */
+static void freeLimbo(EpochRecord* record, const int index){
+    std::vector<EpochRecord::retired> pending;
+    pending.swap(record->limbo[index]);
+    record->retiredCnt -= pending.size();
+    for (size_t i = 0; i < pending.size(); i++){
+        pending[i].second(pending[i].first);
+    }
+
+    if (record->limbo[index].empty()){
+        pending.clear();
+        record->limbo[index].swap(pending);
+    }
+}
+
+// 回收全局遗留列表中满足条件的数据
+static void freeOrphans(const uint64_t epoch){
+    if (s_orphanCnt.load() == 0){
+        return;
+    }
+
+    std::vector<EpochRecord::retired> pending;
+    {
+        Lock::lockGuard guard(s_orphans->lock);
+        size_t kept = 0;
+        for (size_t i = 0; i < s_orphans->list.size(); i++){
+            if (s_orphans->list[i].first + 2 <= epoch){
+                pending.push_back(s_orphans->list[i].second);
+                continue;
+            }
+            s_orphans->list[kept++] = s_orphans->list[i];
+        }
+        s_orphans->list.resize(kept);
+        s_orphanCnt -= pending.size();
+    }
+
+    // 在锁外执行回收函数，避免回收函数中再次退休数据时发生死锁
+    for (size_t i = 0; i < pending.size(); i++){
+        pending[i].second(pending[i].first);
+    }
+}
+
+/**
+ * @brief: 尝试推进全局 epoch
+ * 仅当所有处于临界区中的线程都已观察到当前 epoch 时，才允许推进
+ * @return: true——推进成功（或已被其他线程推进） false——存在停留在旧 epoch 的线程
+ */
+static bool tryAdvance(){
+    uint64_t epoch = s_epoch.load();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (EpochRecord* move = s_records.load(); move; move = move->next){
+        uint64_t state = move->state.load();
+        if ((state & 1) && (state >> 1) != epoch){
+            return false;
+        }
+    }
+    s_epoch.compare_exchange_strong(epoch, epoch + 1);
+    return true;
+}
+
+Epoch::Guard::Guard(){
+    Epoch::Pin();
+}
+
+Epoch::Guard::~Guard(){
+    Epoch::Unpin();
+}
+
+/**
+ * @brief: 进入临界区
+ * 声明观察到的 epoch 后需要一次全屏障，保证该声明先于临界区内对共享数据的读取被其他线程看到
+ */
+void Epoch::Pin(){
+    EpochRecord* record = getRecord();
+    if (record->nest++ > 0){
+        return;
+    }
+    record->state.store((s_epoch.load() << 1) | 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Epoch::Unpin(){
+    EpochRecord* record = getRecord();
+    if (--record->nest > 0){
+        return;
+    }
+    record->state.store(0, std::memory_order_release);
+    releaseExited(record);
+}
+
+bool Epoch::Pinned(){
+    // 线程退出流程中未持有临时记录，说明不处于临界区，无需为此获取记录
+    if (t_recordReleased && !t_cachedRecord){
+        return false;
+    }
+    return getRecord()->nest > 0;
+}
+
+/**
+ * @brief: 退休数据
+ * 1）根据当前全局 epoch 定位退休列表. 若该列表中残留的是三轮之前的数据，说明已可安全回收，先行回收
+ * 2）追加到退休列表
+ * 3）退休数据积累到阈值时，尝试推进 epoch 并回收
+ */
+void Epoch::Retire(void* ptr, deleter d){
+    EpochRecord* record = getRecord();
+    uint64_t epoch = s_epoch.load();
+    int index = epoch % 3;
+    if (record->limboEpoch[index] != epoch){
+        if (!record->limbo[index].empty()){
+            freeLimbo(record, index);
+        }
+        record->limboEpoch[index] = epoch;
+    }
+
+    record->limbo[index].push_back({ptr, d});
+    if (++record->retiredCnt >= RECLAIM_THRESHOLD){
+        Epoch::Reclaim();
+    }
+    releaseExited(record);
+}
+
+/**
+ * @brief: 尝试推进全局 epoch，然后回收当前线程以及已退出线程遗留的、退休时间早于当前 epoch 两轮及以上的数据
+ */
+void Epoch::Reclaim(){
+    EpochRecord* record = getRecord();
+    if (record->reclaiming){
+        return;
+    }
+    record->reclaiming = true;
+
+    tryAdvance();
+    uint64_t epoch = s_epoch.load();
+    for (int i = 0; i < 3; i++){
+        if (!record->limbo[i].empty() && record->limboEpoch[i] + 2 <= epoch){
+            freeLimbo(record, i);
+        }
+    }
+    freeOrphans(epoch);
+
+    record->reclaiming = false;
+    releaseExited(record);
+}
+
+}}
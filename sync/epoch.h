@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+
+#include "../base/nocopy.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * @brief: 基于 epoch 实现的内存安全回收工具（EBR, epoch based reclamation）
+ * 核心思路：
+ *  - 全局维护一个单调递增的 epoch. 线程访问共享数据前通过 Guard 进入临界区（pin），并声明自己观察到的 epoch
+ *  - 数据从共享结构中摘除后，退休（retire）到当前线程对应 epoch 的退休列表中
+ *  - 当所有处于临界区的线程都已观察到最新的 epoch 时，全局 epoch 才能向前推进
+ *  - 全局 epoch 相比退休时推进了两次以上，说明退休时仍在临界区内的线程均已离开，此时可以安全回收
+ * 相比 hazard pointer，读路径只需在进出临界区时各执行一次写操作，与访问的节点数量无关
+ */
+class Epoch : base::Noncopyable{
+public:
+    // 退休列表积累到该数量时，尝试推进全局 epoch 并回收
+    static const int RECLAIM_THRESHOLD = 64;
+    // 数据回收函数 类型别名
+    typedef void (*deleter)(void*);
+
+public:
+    /**
+     * 临界区守卫. 构造时进入临界区，析构时离开临界区
+     * 支持嵌套使用，仅最外层的 Guard 会真正执行 pin/unpin
+     */
+    class Guard : base::Noncopyable{
+    public:
+        Guard();
+        ~Guard();
+    };
+
+public:
+    // 当前线程进入临界区
+    static void Pin();
+    // 当前线程离开临界区
+    static void Unpin();
+    // 当前线程是否处于临界区中
+    static bool Pinned();
+
+    /**
+     * @brief: 退休一份已从共享结构中摘除的数据，待所有可能访问到它的线程离开临界区后，通过 d 完成回收
+     * @param: ptr——退休的数据
+     * @param: d——数据回收函数
+     */
+    static void Retire(void* ptr, deleter d);
+    // 退休一个通过 new 创建的对象，回收时执行 delete
+    template <class T>
+    static void Retire(T* ptr);
+
+    // 尝试推进全局 epoch，并回收当前线程退休列表以及已退出线程遗留的数据中已满足条件的部分
+    static void Reclaim();
+
+private:
+    // 通过 delete 回收对象
+    template <class T>
+    static void deleteObject(void* ptr);
+};
+
+template <class T>
+void Epoch::Retire(T* ptr){
+    Epoch::Retire(ptr, &Epoch::deleteObject<T>);
+}
+
+template <class T>
+void Epoch::deleteObject(void* ptr){
+    delete static_cast<T*>(ptr);
+}
+
+}}
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "hazard.h"
+#include "lock.h"
+#include "../trace/assert.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * 线程持有的 hazard pointer 记录
+ * 记录一经创建就不再释放，线程退出后由后续新建的线程复用
+ */
+struct HazardRecord{
+    // 退休节点 类型别名
+    typedef std::pair<void*, HazardPointer::deleter> retired;
+
+    // hazard pointer 槽位
+    std::atomic<void*> hazards[HazardPointer::SLOTS];
+    // 记录是否被某个线程占用
+    std::atomic<bool> active;
+    // 全局记录链表中的后继记录
+    HazardRecord* next;
+    // 退休列表. 线程退出时残留的节点移交给全局遗留列表
+    std::vector<retired> retiredList;
+    // 动态槽位的占用位图，仅由持有记录的线程访问
+    unsigned guardMask;
+
+    // 扫描过程中复用的容器，避免每轮扫描都发生内存分配
+    std::vector<void*> scanHazards;
+    std::vector<retired> scanPending;
+    // 是否正处于扫描流程中. 回收函数中再次退休节点时，不允许嵌套触发扫描
+    bool scanning;
+
+    HazardRecord():active(true),next(nullptr),guardMask(0),scanning(false){
+        for (int i = 0; i < HazardPointer::SLOTS; i++){
+            this->hazards[i].store(nullptr);
+        }
+    }
+};
+
+// 全局记录链表头. 只增不减
+static std::atomic<HazardRecord*> s_records{nullptr};
+// 全局记录数量，用于计算扫描阈值
+static std::atomic<int> s_recordCnt{0};
+
+// 已退出线程遗留的退休节点，由后续执行扫描的线程接管
+struct HazardOrphans{
+    Lock lock;
+    std::vector<HazardRecord::retired> list;
+};
+// 进程退出时仍可能有线程在退出流程中访问，因此不随静态变量析构
+static HazardOrphans* s_orphans = new HazardOrphans;
+// 遗留节点的数量，用于在无遗留节点时跳过加锁
+static std::atomic<int> s_orphanCnt{0};
+
+// 获取一条记录. 优先复用已释放的记录，没有可复用的记录时新建一条并通过 cas 插入到链表头部
+static HazardRecord* acquireRecord(){
+    for (HazardRecord* move = s_records.load(); move; move = move->next){
+        bool expected = false;
+        if (!move->active.load() && move->active.compare_exchange_strong(expected, true)){
+            return move;
+        }
+    }
+
+    HazardRecord* record = new HazardRecord;
+    s_recordCnt++;
+    HazardRecord* head = s_records.load();
+    do{
+        record->next = head;
+    } while (!s_records.compare_exchange_weak(head, record));
+    return record;
+}
+
+/**
+ * @brief: 清空槽位并释放记录的占用
+ * 仍被其他线程引用的节点移交给全局遗留列表，避免在记录被复用前一直滞留
+ */
+static void releaseRecord(HazardRecord* record){
+    for (int i = 0; i < HazardPointer::SLOTS; i++){
+        record->hazards[i].store(nullptr);
+    }
+    record->guardMask = 0;
+
+    std::vector<HazardRecord::retired>& retiredList = record->retiredList;
+    if (!retiredList.empty()){
+        Lock::lockGuard guard(s_orphans->lock);
+        s_orphans->list.insert(s_orphans->list.end(), retiredList.begin(), retiredList.end());
+        s_orphanCnt += retiredList.size();
+        retiredList.clear();
+    }
+    record->active.store(false);
+}
+
+// 当前线程记录的缓存. 普通指针类型的 thread_local 无需构造检查，访问成本更低
+static thread_local HazardRecord* t_cachedRecord = nullptr;
+/**
+ * 当前线程的 t_record 是否已经析构
+ * 线程退出时，晚于 t_record 析构的其他 thread_local 对象仍可能在析构函数中访问或退休节点，此时不能再访问 t_record
+ */
+static thread_local bool t_recordReleased = false;
+
+/**
+ * 线程本地的记录持有者
+ * 构造时获取一条记录，线程退出析构时清空槽位、执行一次扫描并释放记录的占用
+ */
+struct LocalHazardRecord{
+    HazardRecord* record;
+
+    LocalHazardRecord():record(acquireRecord()){}
+
+    // 释放占用后记录可能立即被其他线程复用，因此同时清空缓存，此后当前线程再使用 hazard pointer 时走 getRecord 中的线程退出路径
+    ~LocalHazardRecord(){
+        for (int i = 0; i < HazardPointer::SLOTS; i++){
+            this->record->hazards[i].store(nullptr);
+        }
+        this->record->guardMask = 0;
+        HazardPointer::Scan();
+        releaseRecord(this->record);
+        t_cachedRecord = nullptr;
+        t_recordReleased = true;
+    }
+};
+
+static thread_local LocalHazardRecord t_record;
+
+/**
+ * @brief: 获取当前线程持有的记录，首次访问时完成记录的获取
+ * 线程退出流程中 t_record 已析构时，临时获取一条记录，在槽位全部清空后由 releaseExited 释放
+ */
+static HazardRecord* getRecord(){
+    if (!t_cachedRecord){
+        t_cachedRecord = t_recordReleased ? acquireRecord() : t_record.record;
+    }
+    return t_cachedRecord;
+}
+
+// 线程退出流程中临时获取的记录，在不再发布任何指针、且不处于扫描流程中时立即释放
+static void releaseExited(HazardRecord* record){
+    if (!t_recordReleased || t_cachedRecord != record || record->scanning || record->guardMask){
+        return;
+    }
+    for (int i = 0; i < HazardPointer::SLOTS; i++){
+        if (record->hazards[i].load(std::memory_order_relaxed)){
+            return;
+        }
+    }
+    t_cachedRecord = nullptr;
+    releaseRecord(record);
+}
+
+/**
+ * @brief: 计算扫描阈值
+ * 阈值不低于全局槽位总数的两倍，保证每轮扫描至少有一半的退休节点可被回收
+ */
+static size_t scanThreshold(){
+    size_t threshold = 2 * s_recordCnt.load(std::memory_order_relaxed) * HazardPointer::SLOTS;
+    return std::max<size_t>(threshold, HazardPointer::SCAN_THRESHOLD);
+}
+
+HazardPointer::Guard::Guard():m_slot(HazardPointer::acquireSlot()){}
+
+HazardPointer::Guard::~Guard(){
+    HazardPointer::Clear(this->m_slot);
+    HazardPointer::releaseSlot(this->m_slot);
+}
+
+void HazardPointer::Guard::reset(){
+    HazardPointer::Clear(this->m_slot);
+}
+
+int HazardPointer::acquireSlot(){
+    HazardRecord* record = getRecord();
+    for (int i = RESERVED_SLOTS; i < SLOTS; i++){
+        if (!(record->guardMask & (1u << i))){
+            record->guardMask |= 1u << i;
+            return i;
+        }
+    }
+    CBRICKS_ASSERT(false, "hazard pointer guard slots exhausted");
+    return -1;
+}
+
+void HazardPointer::releaseSlot(const int slot){
+    HazardRecord* record = getRecord();
+    record->guardMask &= ~(1u << slot);
+    releaseExited(record);
+}
+
+void HazardPointer::Set(const int slot, void* ptr){
+    CBRICKS_ASSERT(slot >= 0 && slot < SLOTS, "hazard pointer slot out of range");
+    getRecord()->hazards[slot].store(ptr);
+}
+
+void HazardPointer::Clear(const int slot){
+    CBRICKS_ASSERT(slot >= 0 && slot < SLOTS, "hazard pointer slot out of range");
+    HazardRecord* record = getRecord();
+    record->hazards[slot].store(nullptr, std::memory_order_release);
+    releaseExited(record);
+}
+
+/**
+ * @brief: 退休节点
+ * 线程退出流程中退休的节点不再等待积累到阈值：立即扫描一次，仍被引用的节点随临时记录的释放移交给全局遗留列表
+ */
+void HazardPointer::Retire(void* ptr, deleter d){
+    HazardRecord* record = getRecord();
+    std::vector<HazardRecord::retired>& retiredList = record->retiredList;
+    retiredList.push_back({ptr, d});
+    if ((t_recordReleased || retiredList.size() >= scanThreshold()) && !record->scanning){
+        HazardPointer::Scan();
+    }
+}
+
+/**
+ * @brief: 扫描当前线程的退休列表
+ * 1）接管已退出线程遗留的退休节点
+ * 2）收集所有线程槽位中发布的指针，排序后用于二分查找
+ * 3）遍历退休列表，未被任何槽位引用的节点执行回收，其余节点保留到下一轮扫描
+ */
+void HazardPointer::Scan(){
+    HazardRecord* record = getRecord();
+    std::vector<HazardRecord::retired>& retiredList = record->retiredList;
+    if (record->scanning){
+        return;
+    }
+
+    if (s_orphanCnt.load() > 0){
+        Lock::lockGuard guard(s_orphans->lock);
+        retiredList.insert(retiredList.end(), s_orphans->list.begin(), s_orphans->list.end());
+        s_orphanCnt -= s_orphans->list.size();
+        s_orphans->list.clear();
+    }
+    if (retiredList.empty()){
+        releaseExited(record);
+        return;
+    }
+    record->scanning = true;
+
+    std::vector<void*>& hazards = record->scanHazards;
+    std::vector<HazardRecord::retired>& pending = record->scanPending;
+    hazards.clear();
+    for (HazardRecord* move = s_records.load(); move; move = move->next){
+        for (int i = 0; i < SLOTS; i++){
+            void* ptr = move->hazards[i].load();
+            if (ptr){
+                hazards.push_back(ptr);
+            }
+        }
+    }
+    std::sort(hazards.begin(), hazards.end());
+
+    // 先将退休列表转移出来，避免回收函数中再次退休节点时修改正在遍历的列表
+    pending.clear();
+    pending.swap(retiredList);
+    for (size_t i = 0; i < pending.size(); i++){
+        if (std::binary_search(hazards.begin(), hazards.end(), pending[i].first)){
+            retiredList.push_back(pending[i]);
+            continue;
+        }
+        pending[i].second(pending[i].first);
+    }
+    record->scanning = false;
+    releaseExited(record);
+}
+
+}}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+
+#include "../base/nocopy.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * @brief: 基于 hazard pointer 实现的内存安全回收工具，服务于无锁数据结构
+ * 核心思路：
+ *  - 每个线程持有一组 hazard pointer 槽位. 线程访问共享节点前，先将节点地址发布到自己的槽位中，声明“该节点正在被我访问”
+ *  - 节点从数据结构中摘除后不会立即释放，而是退休（retire）到当前线程的退休列表中
+ *  - 退休列表积累到一定数量后执行一次扫描（scan），仅回收未被任何线程槽位引用的节点
+ * 扫描阈值与全局槽位总数成正比，每轮扫描至少回收一半的退休节点，单次退休的均摊成本为 O(1)；
+ * 同时每个线程滞留的退休节点数量不超过槽位总数的常数倍，即便存在长期持有指针的读者，内存占用依然有界
+ * 槽位分为两部分：
+ *  - [0, RESERVED_SLOTS) 由数据结构内部通过编号直接使用，如 sync::Queue
+ *  - [RESERVED_SLOTS, SLOTS) 由 Guard 按需动态分配，供业务代码或上层结构使用，不会与内部编号冲突
+ */
+class HazardPointer : base::Noncopyable{
+public:
+    // 每个线程持有的 hazard pointer 槽位数量
+    static const int SLOTS = 8;
+    // 通过编号直接使用的槽位数量，其余槽位由 Guard 动态分配
+    static const int RESERVED_SLOTS = 4;
+    // 扫描阈值的下限. 实际阈值为 max(SCAN_THRESHOLD, 2 * 全局槽位总数)
+    static const int SCAN_THRESHOLD = 64;
+    // 节点回收函数 类型别名
+    typedef void (*deleter)(void*);
+
+public:
+    /**
+     * 槽位守卫. 构造时从当前线程的动态槽位中分配一个，析构时清空并归还
+     * 同一线程至多同时持有 SLOTS - RESERVED_SLOTS 个 Guard
+     */
+    class Guard : base::Noncopyable{
+    public:
+        Guard();
+        ~Guard();
+
+    public:
+        // 通过守卫持有的槽位保护 src 中的指针，此前保护的指针随之失效
+        template <class T>
+        T* protect(const std::atomic<T*>& src);
+        // 清空槽位，放弃对此前指针的保护
+        void reset();
+
+    private:
+        // 持有的槽位编号
+        int m_slot;
+    };
+
+public:
+    /**
+     * @brief: 将 src 中的指针发布到当前线程的指定槽位，并循环校验直至发布的值与 src 中的最新值一致
+     * @param: slot——槽位编号
+     * @param: src——存放共享指针的 atomic 容器
+     * @return: 受保护的指针. 在调用 Clear 之前，该指针指向的节点都不会被回收
+     */
+    template <class T>
+    static T* Protect(const int slot, const std::atomic<T*>& src);
+
+    // 将指针发布到当前线程的指定槽位
+    static void Set(const int slot, void* ptr);
+    // 清空当前线程的指定槽位
+    static void Clear(const int slot);
+
+    /**
+     * @brief: 退休一个已从数据结构中摘除的节点. 当其不再被任何线程的槽位引用时，通过 d 完成回收
+     * @param: ptr——退休的节点
+     * @param: d——节点回收函数
+     */
+    static void Retire(void* ptr, deleter d);
+
+    // 扫描当前线程的退休列表（包括接管的已退出线程遗留节点），回收所有未被引用的节点
+    static void Scan();
+
+private:
+    // 为 Guard 分配 / 归还动态槽位
+    static int acquireSlot();
+    static void releaseSlot(const int slot);
+};
+
+template <class T>
+T* HazardPointer::Protect(const int slot, const std::atomic<T*>& src){
+    T* ptr = src.load();
+    while (true){
+        HazardPointer::Set(slot, ptr);
+        // 发布后再次校验. 若 src 未发生变化，说明发布时节点仍可达，此后不会被回收
+        T* cur = src.load();
+        if (cur == ptr){
+            return ptr;
+        }
+        ptr = cur;
+    }
+}
+
+template <class T>
+T* HazardPointer::Guard::protect(const std::atomic<T*>& src){
+    return HazardPointer::Protect(this->m_slot, src);
+}
+
+}}
@@ -1,3 +1,5 @@
+#include <sched.h>
+
 #include "lock.h"
 
 namespace cbricks{namespace sync{
@@ -37,7 +39,7 @@ void RWLock::lock(){
 
 // 加读锁
 void RWLock::rlock(){
-    pthread_rwlock_wrlock(&this->m_rwMutex);
+    pthread_rwlock_rdlock(&this->m_rwMutex);
 }
 
 // 解锁
@@ -47,8 +49,20 @@ void RWLock::unlock(){
 
 SpinLock::SpinLock():m_locked(ATOMIC_FLAG_INIT){}
 
+/**
+ * 自旋一定次数仍未获取到锁时，说明持有者可能已被调度出 CPU，此时让出时间片，
+ * 避免与持有者位于同一 CPU 上的等待者空转整个时间片
+ */
 void SpinLock::lock(){
-    while(this->m_locked.test_and_set(std::memory_order_acquire)){}
+    int spins = 0;
+    while (this->m_locked.test_and_set(std::memory_order_acquire)){
+        // 达到上限后不再计数，避免长时间等待时计数溢出
+        if (spins < SPIN_LIMIT){
+            spins++;
+        } else{
+            sched_yield();
+        }
+    }
 }
 
 void SpinLock::unlock(){
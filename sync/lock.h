@@ -55,6 +55,8 @@ private:
 class SpinLock :base::Noncopyable{
 public:
     typedef ScopedLock<SpinLock> lockGuard;
+    // 让出 CPU 前的自旋次数
+    static const int SPIN_LIMIT = 64;
 
 public:
     SpinLock();
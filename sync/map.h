@@ -1,12 +1,22 @@
 #pragma once 
 
 #include <atomic>
+#include <chrono>
+#include <iterator>
 #include <memory>
+#include <new>
 #include <unordered_map>
 #include <functional>
+#include <vector>
 
 #include "../base/nocopy.h"
+#include "../datastruct/flatmap.h"
+#include "../memory/slab.h"
 #include "lock.h"
+#include "sem.h"
+#include "epoch.h"
+#include "entry.h"
+#include "timewheel.h"
 
 namespace cbricks{namespace sync{
 
@@ -16,6 +26,13 @@ namespace cbricks{namespace sync{
  * 功能点：底层基于以空间换时间的思路，建立 read dirty 两份 map
  *        - read：应用于读、更新、删除场景，实现无锁化
  *        - dirty：包含全量数据，访问时需要加锁
+ * 内存回收：被替换的 readonly 实例以及 entry 中被覆盖的堆上数据均通过 Epoch 延迟回收，
+ *          所有公有方法都在 epoch 临界区内执行，保证无锁读取期间访问的数据不会被提前释放
+ * 读路径：readonly 实例与 entry 均通过裸指针访问，不发生共享指针的拷贝，因此不会争抢同一个引用计数.
+ *        entry 由 readonly 中的 map 持有，readonly 在临界区内不会被回收，entry 也就始终有效
+ * 存储结构：dirty 为 std::unordered_map，便于频繁插入删除；readonly 一经构建便不再修改，
+ *          因此采用开放寻址的 datastruct::FlatMap，命中时只需访问控制字节与槽位，无需经过链表节点
+ * 过期：store 时可以为 key 指定过期时间，由进程级的 TimeWheel 在到期时删除，过期处理的成本只与到期的 key 数量相关
  */
 template <class Key, class Value>
 class Map : base::Noncopyable{
@@ -25,6 +42,14 @@ public:
      */
     // 构造函数. 初始化 readonly 实例
     Map();
+    /**
+     * @brief: 批量构建的构造函数. 基于 [begin, end) 范围内的 kv 对直接构建 readonly，dirty 为空
+     * 构建完成后所有数据都位于 readonly 中，读取全部命中无锁路径，也不存在逐条 store 的加锁开销. 适用于启动时的数据加载
+     * 所有 entry 在一块连续内存中批量构造，详见 buildTable
+     * @param: begin、end——元素为 kv 对（通过 first、second 访问）的前向迭代器. 重复的 key 以最后一次出现为准
+     */
+    template <class Iter>
+    Map(Iter begin, Iter end);
     // 析构函数. 回收 readonly 实例
     ~Map();
 
@@ -32,120 +57,49 @@ private:
     /**
      * map 中依赖的内置私有类型
      */
-    // 底层存放 value 数据的容器
-    struct Entry{
-    public:
-        // 智能指针 类型别名
-        typedef std::shared_ptr<Entry> ptr;
-
-    public:
-        /**
-         * 构造 析构函数
-         */
-        // 构造函数，入参为存储数据
-        Entry(Value v);
-        // 析构函数
-        ~Entry();
-    
-    public:
-        /**
-         * entry 内置类
-         */
-        // 对存储数据使用该类型的指针进行封装
-        struct WrappedV{
-        public:
-            WrappedV() = default;
-            WrappedV(Value v);
-        public:
-            Value v;
-        };
-
-    public:
-        /**
-         * 读操作相关方法
-         */
-        /**
-         * @brief: 从 entry 中读取数据，存储到 receiver 中
-         * @param: 承载读取数据的容器
-         * @return: true——读取成功 false——读取失败
-         */
-        bool load(Value& receiver);
-
-    public:
-        /**
-         * 写操作相关
-         */
-        /**
-         * @brief: 将数据存储在 entry 的原子容器中 [调用此方法时一定处于持有 dirtyLock 状态]
-         * @param: v——拟存储的数据
-         */
-        void storeLocked(Value v);
-
-        /**
-         * @brief: 尝试将数据存储在 entry 的原子容器中
-         * @param: v——尝试存储的数据
-         * @return: true——存储成功 false——存储失败（硬删除态 expunged 时存储失败）
-         */
-        bool tryStore(Value v);
-
-        // 删除 entry 中存储的数据，将 container 中内容置为 nullptr（软删除态）
-        void evict();
-
-    public:
-        /**
-         * entry 状态更新操作相关方法
-         */
-        /**
-         * @brief: 将 entry 置为非硬删除态
-         * @return: true——之前处于硬删除态（expunged），更新成功；false——之前处于非硬删除态，无需更新
-         */
-        bool unexpungeLocked();
-        /**
-         * @brief: 尝试将 entry 置为硬删除态（expunged）
-         * @return: true——之前就是硬删除态，或者成功将 nil （软删除态）置为硬删除态； false——更新失败（此前数据未删除）
-         */
-        bool tryExpungeLocked();
-
-    public:
-        /** 
-         * 存放数据的 atomic 容器 
-         * WrappedV 分为三种可能：
-         * 1）s_expunged：硬删除态，表示 dirty 中一定没有该 entry，要恢复数据必须对 dirty 执行 insert 操作
-         * 2）nullptr：软删除态. 数据逻辑意义上已被删除，但是 dirty 中还有该数据，还能快速恢复过来
-         * 3）其他：数据仍存在，未被删除
-        */
-        std::atomic<WrappedV*> container;
-    };
+    // 底层存放 value 数据的容器. 根据 Value 类型在编译期选择内联存储或堆上存储，详见 entry.h
+    typedef MapEntry<Value> Entry;
 
 public:
     // 智能指针 类型别名
     typedef std::shared_ptr<Map<Key,Value>> ptr;
+    // 毫秒 类型别名
+    typedef std::chrono::milliseconds ms;
     // 存储 key-entry 的 map 类型别名
     typedef std::unordered_map<Key, typename Entry::ptr> map;
+    // readonly 中存储 key-entry 的只读哈希表类型别名
+    typedef datastruct::FlatMap<Key, typename Entry::ptr> table;
 
 private:
     /**
      * map 中依赖的内置私有类型
-     * 由于内部仅有一个 bool 及共享指针字段，所以发生值拷贝的成本可忽略不计
+     * readonly 实例一经发布便不再修改，读取方直接通过 m_readonly 中的指针访问，无需拷贝
      */
     // 只读 map 数据类型
-    struct ReadOnly{
+    struct ReadOnly : base::Noncopyable{
         // 构造函数
         ReadOnly();
-        // 拷贝构造函数
-        ReadOnly(const ReadOnly& other);
-        // 赋值函数
-        ReadOnly& operator=(const ReadOnly& other);
+        // 构造函数，基于已有的只读哈希表构造
+        ReadOnly(std::shared_ptr<table> m, const bool amended);
         /**
          * 标识 readonly 相比 dirty 是否存在数据缺失
          * 1）true——存在缺失，则操作 readonly 时若发现数据 miss，还需要读取 dirty 兜底
          * 2）false——不存在缺少. 则操作 readonly 时若发现数据 miss，无需额外操作 dirty
          */
-        volatile bool amended;
-        // 存储 readonly 中 kv 数据的 map. value 为 entry 共享指针类型，可供多个 readonly 实例共享
-        std::shared_ptr<map> m;
+        const bool amended;
+        /**
+         * 存储 readonly 中 kv 数据的只读哈希表. 仅在 amended 切换时由新旧两个 readonly 实例共享，
+         * 读路径只解引用该指针，不会修改其引用计数
+         */
+        std::shared_ptr<table> m;
     };
 
+    /**
+     * @brief: 从 readonly 中查找 key 对应的 entry
+     * @return: entry 裸指针，不存在时返回 nullptr. 仅在 epoch 临界区内有效
+     */
+    static Entry* lookup(const ReadOnly* readonly, const Key& key);
+
 public:
     /**
      * 公有方法
@@ -165,6 +119,40 @@ public:
      */
     void store(Key key, Value value);
 
+    /**
+     * @brief: 写入数据，并在 ttl 之后自动删除
+     * 1）同一个 key 再次带 ttl 写入时，以最后一次写入的 ttl 为准
+     * 2）不带 ttl 的 store、evict、loadAndDelete 以及成功的 compareAndDelete 会取消 key 的过期时间
+     * 3）compareAndSwap 原地更新数据，保留 key 原有的过期时间
+     * 4）与不带 ttl 的 store 并发写入同一个 key 时，最终是否保留过期时间不做保证
+     * @param: key——数据键
+     * @param: value——拟写入的数据
+     * @param: ttl——过期时间. 不为正数时等同于不带 ttl 的 store
+     */
+    void store(Key key, Value value, const ms ttl);
+
+    /**
+     * @brief: 批量写入数据，语义等同于逐条 store
+     * 1）readonly 中已存在的 key 无锁更新
+     * 2）其余 key 在一次加锁中完成写入
+     * 3）待加锁处理的 key 数量不少于现有数据量的一半时，将现有数据与本批数据合并后直接构建新的 readonly，
+     *    不经过 dirty，后续读取也无需逐一 miss 后才触发提升
+     * 4）map 为空时，与批量构建的构造函数一样直接构建 readonly，不再逐个 key 查找
+     * @param: begin、end——元素为 kv 对（通过 first、second 访问）的前向迭代器
+     */
+    template <class Iter>
+    void storeBatch(Iter begin, Iter end);
+
+    /**
+     * @brief: 批量读取数据，语义等同于逐条 load
+     * readonly 中未命中的 key 在一次加锁中从 dirty 读取，miss 次数一次性累计
+     * @param: keys——数据键
+     * @param: values——接收数据的容器，与 keys 一一对应. 数据不存在的位置保持默认值
+     * @param: found——与 keys 一一对应，标识数据是否存在
+     * @return: 存在的数据数量
+     */
+    size_t loadBatch(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found);
+
     /**
      * @brief: 删除数据
      * @param: key——数据键
@@ -178,6 +166,71 @@ public:
      */
     void range(std::function<bool(const Key& key, const Value& value)> f);
 
+    /**
+     * @brief: 基于一致性快照遍历 map，不触发 dirty -> readonly 的提升
+     * 与 range 不同，该方法不会重置 dirty，因此不会导致后续插入操作重新执行 O(N) 的 dirtyLocked 流程，适用于指标采集等周期性的全量遍历
+     * 快照中的 key 集合为某一时刻的全量数据，value 在遍历到时读取，期间被删除的数据会被跳过
+     * 遍历期间当前线程处于 epoch 临界区中，f 执行耗时过长会推迟其他线程退休数据的回收
+     * @param：f——用于接收 key-value 对的闭包函数. 返回 false 时终止遍历
+     */
+    void rangeSnapshot(std::function<bool(const Key& key, const Value& value)> f);
+
+    /**
+     * @brief: 基于一致性快照并行遍历 map. 快照的槽位被切分为 partitions 个区间，分别通过 submit 提交执行，全部完成后返回
+     * 1）f 会在多个线程中并发执行，需要保证并发安全
+     * 2）任一区间中 f 返回 false 时，其余区间会尽快终止遍历
+     * 3）调用方会阻塞等待所有区间执行完成，因此不允许在 submit 所对应的执行线程中调用
+     * @param: submit——任务提交函数，形如 bool(std::function<void()>)，返回 false 时任务在当前线程中执行.
+     *         map 不依赖具体的执行器，例如可以传入向 pool::WorkerPool 提交任务的闭包
+     * @param：f——用于接收 key-value 对的闭包函数
+     * @param: partitions——切分的区间数量
+     */
+    template <class Submit>
+    void parallelRange(Submit submit, std::function<bool(const Key& key, const Value& value)> f, size_t partitions = 8);
+
+    /**
+     * 原子性的读改写操作. 均只遍历一次 readonly/dirty，仅在插入新 key 或 readonly 数据缺失时加锁
+     */
+    /**
+     * @brief: 数据存在时读取数据，否则写入 value
+     * @param: key——数据键
+     * @param: value——数据不存在时拟写入的数据
+     * @param: actual——接收最终数据的容器. 数据存在时为已有数据，否则为 value
+     * @return: true——读取到已有数据 false——写入了 value
+     */
+    bool loadOrStore(Key key, Value value, Value& actual);
+
+    /**
+     * @brief: 删除数据，并将被删除的数据存储到 receiver 中
+     * @param: key——数据键
+     * @param: receiver——接收被删除数据的容器
+     * @return: true——数据存在且已删除 false——数据不存在
+     */
+    bool loadAndDelete(Key key, Value& receiver);
+
+    /**
+     * @brief: 当数据存在且与 old 相等时，将其替换为 value. 需要 Value 支持 == 运算
+     * @return: true——替换成功 false——数据不存在或与 old 不相等
+     */
+    bool compareAndSwap(Key key, Value old, Value value);
+
+    /**
+     * @brief: 当数据存在且与 old 相等时，将其删除. 需要 Value 支持 == 运算
+     * @return: true——删除成功 false——数据不存在或与 old 不相等
+     */
+    bool compareAndDelete(Key key, Value old);
+
+    /**
+     * @brief: 数据存在时读取数据，否则通过 factory 构造数据并写入
+     * 数据不存在时 factory 在持有 dirtyLock 的情况下执行，因此同一时刻至多有一个 factory 在执行，且 factory 中不允许访问当前 map
+     * 与无锁写入并发时，factory 构造的数据可能被丢弃，actual 中为最终生效的数据
+     * @param: key——数据键
+     * @param: factory——构造数据的闭包函数
+     * @param: actual——接收最终数据的容器
+     * @return: true——读取到已有数据 false——写入了 factory 构造的数据
+     */
+    bool computeIfAbsent(Key key, std::function<Value()> factory, Value& actual);
+
 private:
     /**
      * @brief: 累计 readonly 数据 miss 次数
@@ -191,18 +244,105 @@ private:
      */
     void readonlyLocked();
 
+    /**
+     * @brief: 使用新的 readonly 实例替换原实例，原实例通过 Epoch 延迟回收
+     * readonly 实例一经发布便不再修改，无锁读取方拷贝到的始终是完整一致的内容
+     */
+    void swapReadonlyLocked(typename Map<Key,Value>::ReadOnly* readonly);
+
+    /**
+     * @brief: 向 dirty 中插入新的 key. 调用前需确认 readonly 和 dirty 中均不存在该 key
+     * 若 readonly.amended 为 false，需要先将其置为 true，并通过 dirtyLocked 流程补全 dirty
+     */
+    void insertLocked(const Key& key, const Value& value);
+
     /**
      * @brief: 倘若 dirty 为空，需要遍历 readonly 将未删除的数据转移到 dirty 中
      * 遍历 readonly 时间复杂度 O(N)，同时过滤掉所有处于删除态（expunged or nullptr）的数据
      */
     void dirtyLocked();
 
-private:
     /**
-     * 使用全局静态变量标记特殊的硬删除状态 expunged
-     * 当一个 key 于 dirty 中已不存在时，对应 entry 的 container 中会存储该实例，用于标记该项数据处于硬删除态（expunged）
-    */ 
-    static typename Map<Key,Value>::Entry::WrappedV* s_expunged;
+     * @brief: 获取全量数据的只读哈希表快照，不修改 readonly 和 dirty
+     * 1）readonly.amended 为 false 时，readonly 中的只读哈希表即为全量数据，直接返回
+     * 2）否则加锁，基于 dirty 构建一份临时的只读哈希表. entry 与 map 共享，因此快照中读取到的是 entry 的最新数据
+     * 需要在 epoch 临界区内调用
+     */
+    std::shared_ptr<const table> snapshot();
+
+    // 写入数据，不处理过期时间
+    void storeEntry(const Key& key, const Value& value);
+    // 删除数据，不处理过期时间
+    void evictEntry(const Key& key);
+    // 删除数据并读取被删除的数据，不处理过期时间
+    bool loadAndDeleteEntry(const Key& key, Value& receiver);
+    // 数据与 old 相等时将其删除，不处理过期时间
+    bool compareAndDeleteEntry(const Key& key, const Value& old);
+    // 批量写入数据，不处理过期时间
+    template <class Iter>
+    void storeBatchEntries(Iter begin, Iter end);
+    /**
+     * @brief: 基于 [begin, end) 范围内的 kv 对直接构建只读哈希表
+     * 所有 entry 在一块连续内存中批量构造，表中的 entry 指针与该内存块共享同一个控制块，不存在每个 key 一次的内存分配与回收.
+     * 内存块在所有 entry 都不再被引用后整体回收，因此被删除的 key 所占用的 entry 会延迟到此时才回收
+     */
+    template <class Iter>
+    static std::shared_ptr<table> buildTable(Iter begin, Iter end);
+    /**
+     * @brief: 将一批 kv 对与现有全量数据合并，直接构建新的 readonly 并清空 dirty
+     * @param: pending——指向待写入 kv 对的迭代器
+     */
+    template <class Iter>
+    void rebuildLocked(const std::vector<Iter>& pending);
+    /**
+     * @brief: 取消 key 的过期时间. 不存在带过期时间的 key 时只需一次原子读
+     * @param: f——取消后在过期锁内执行的写操作，保证与到期删除之间的先后顺序. 使用模板参数，避免热路径上构造 std::function
+     */
+    template <class F>
+    void clearExpiry(const Key& key, F f);
+    /**
+     * @brief: 在过期锁内执行写操作，写操作成功时取消 key 的过期时间. 用于可能失败的删除操作
+     * @param: f——在过期锁内执行的写操作，返回值表示是否成功
+     * @return: f 的返回值
+     */
+    template <class F>
+    bool clearExpiryIf(const Key& key, F f);
+
+    /**
+     * @brief: 遍历快照中槽位下标位于 [begin, end) 范围内的数据，跳过已删除的数据
+     * @return: true——区间遍历完成 false——被 f 终止
+     */
+    static bool rangeTable(const table& t, const size_t begin, const size_t end, const std::function<bool(const Key& key, const Value& value)>& f);
+
+    /**
+     * 过期时间相关的状态
+     * 定时任务持有其共享指针，map 析构后到期的定时任务通过 owner 为空感知，不会访问已析构的 map
+     */
+    struct Expiry{
+        // 保护过期状态的互斥锁. 到期删除与写入、取消操作在锁内串行执行
+        Lock lock;
+        // 所属 map，map 析构时置空
+        Map<Key,Value>* owner;
+        // 序号生成器. 每次带 ttl 的写入分配一个序号，到期时序号不一致说明已被后续写入覆盖
+        uint64_t seq;
+        // key 到 {序号，TimeWheel 任务 id} 的映射
+        std::unordered_map<Key, std::pair<uint64_t, uint64_t>> timers;
+
+        Expiry(Map<Key,Value>* owner):owner(owner),seq(0){}
+    };
+
+    // 定时任务到期时执行：序号一致时删除数据
+    static void expire(std::shared_ptr<Expiry> expiry, const Key& key, const uint64_t seq);
+
+    // 批量构造的 entry 所在的连续内存块
+    struct EntryBlock : base::Noncopyable{
+        EntryBlock(const size_t capacity):entries(static_cast<Entry*>(::operator new(capacity * sizeof(Entry)))),size(0){}
+        ~EntryBlock();
+
+        Entry* entries;
+        // 已构造的 entry 数量
+        size_t size;
+    };
 
 private:
     /**
@@ -211,7 +351,7 @@ private:
     
     /**
      * 只读 map，全程无锁访问
-     * 使用 atomic 容器承载，由于内部仅有一个 bool 及共享指针字段，所以发生值拷贝的成本可忽略不计
+     * 使用 atomic 容器承载，读取方在 epoch 临界区内直接访问指针指向的实例
      */
     std::atomic<typename Map<Key,Value>::ReadOnly*> m_readonly;
     // 记录 readonly miss 次数，与 missLocked 流程紧密相关
@@ -221,21 +361,73 @@ private:
     Lock m_dirtyLock;
     // dirty map，包含全量数据
     map m_dirty;
-};
+    /**
+     * 基于 dirty 构建的只读哈希表快照 [受 m_dirtyLock 保护]
+     * 快照中的 entry 在遍历时才读取 value，因此只有 dirty 的 key 集合变化时才需要置空，此后首次调用 snapshot 时重新构建
+     */
+    std::shared_ptr<const table> m_snapshot;
 
-// 全局静态变量，标记硬删除状态.
-template <class Key, class Value>
-typename Map<Key, Value>::Entry::WrappedV* Map<Key,Value>::s_expunged = new typename Map<Key,Value>::Entry::WrappedV();
+    // 过期状态
+    std::shared_ptr<Expiry> m_expiry;
+    // 带过期时间的 key 数量，为 0 时写入、删除操作无需访问过期状态
+    std::atomic<size_t> m_expiring{0};
+};
 
 // 构造函数，初始化 readonly 实例
 template <class Key, class Value>
-Map<Key,Value>::Map(){
+Map<Key,Value>::Map():m_expiry(std::make_shared<Expiry>(this)){
     this->m_readonly.store(new typename Map<Key,Value>::ReadOnly);
 }
 
+// 批量构建的构造函数. 直接以 buildTable 构建的只读哈希表作为 readonly
+template <class Key, class Value>
+template <class Iter>
+Map<Key,Value>::Map(Iter begin, Iter end):m_expiry(std::make_shared<Expiry>(this)){
+    this->m_readonly.store(new ReadOnly(Map<Key,Value>::buildTable(begin, end), false));
+}
+
+/**
+ * @brief: 基于 [begin, end) 范围内的 kv 对直接构建只读哈希表
+ * 1）一次性分配容纳所有 entry 的内存块，依次原地构造 entry
+ * 2）通过 shared_ptr 的别名构造，使 entry 指针共享内存块的控制块，拷贝时只需递增引用计数
+ * 3）kv 对预留空间后一次性移动到只读哈希表中. 重复 key 对应的 entry 在构建时被覆盖，仍随内存块整体回收
+ */
+template <class Key, class Value>
+template <class Iter>
+std::shared_ptr<typename Map<Key,Value>::table> Map<Key,Value>::buildTable(Iter begin, Iter end){
+    size_t n = std::distance(begin, end);
+    std::shared_ptr<EntryBlock> block = std::make_shared<EntryBlock>(n);
+    std::vector<std::pair<Key, typename Map<Key,Value>::Entry::ptr>> entries;
+    entries.reserve(n);
+    for (Iter it = begin; it != end; it++){
+        Entry* e = new (block->entries + block->size) Entry(it->second);
+        block->size++;
+        entries.push_back({it->first, typename Map<Key,Value>::Entry::ptr(block, e)});
+    }
+    return std::make_shared<table>(std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()), n);
+}
+
+template <class Key, class Value>
+Map<Key,Value>::EntryBlock::~EntryBlock(){
+    for (size_t i = 0; i < this->size; i++){
+        this->entries[i].~Entry();
+    }
+    ::operator delete(this->entries);
+}
+
 // 析构函数，回收 readonly 实例
 template <class Key, class Value>
 Map<Key,Value>::~Map(){
+    // 取消所有定时任务. 正在执行的定时任务会在锁内看到 owner 为空后直接退出
+    {
+        Lock::lockGuard guard(this->m_expiry->lock);
+        this->m_expiry->owner = nullptr;
+        for (auto it = this->m_expiry->timers.begin(); it != this->m_expiry->timers.end(); it++){
+            TimeWheel::Default()->cancel(it->second.second);
+        }
+        this->m_expiry->timers.clear();
+    }
+
     typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load();
     delete readonly;
 }
@@ -257,22 +449,19 @@ bool Map<Key,Value>::load(Key key, Value& receiver){
      * 5）从 dirty 中读取数据，并且执行 missLocked 流程
      */
 
-    // 尝试从 readonly 中读取数据，若存在直接返回
-    typename Map<Key,Value>::Entry::ptr e = nullptr;
-
-    // 从 atomic 容器中读取 readonly 实例指针，并执行拷贝构造函数，生成 readonly 实例
-    typename Map<Key,Value>::ReadOnly readonly = *this->m_readonly.load();
-    auto it = readonly.m->find(key);
-    if (it != readonly.m->end()){
-        e = it->second;
-    }
+    // 进入 epoch 临界区，保证期间读取到的 readonly 实例和 entry 中的数据不会被回收
+    Epoch::Guard epochGuard;
 
+    // 尝试从 readonly 中读取数据，若存在直接返回
+    // 直接访问 atomic 容器中的 readonly 实例，不发生任何引用计数操作
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
     if (e != nullptr){
         return e->load(receiver);
     }
     
     // readonly.amended 为 false，表示 readonly 已包含全量数据，无需再读 dirty 了
-    if (!readonly.amended){
+    if (!readonly->amended){
         return false;
     }
 
@@ -281,25 +470,20 @@ bool Map<Key,Value>::load(Key key, Value& receiver){
     Lock::lockGuard guard(this->m_dirtyLock);
 
     // 加锁后对 readonly double check
-    // 此处执行的是 readonly 赋值操作函数
-    readonly = *this->m_readonly.load();
-    it = readonly.m->find(key);
-    if (it != readonly.m->end()){
-        e = it->second;
-    }
-
+    readonly = this->m_readonly.load();
+    e = Map<Key,Value>::lookup(readonly, key);
     if (e != nullptr){
         return e->load(receiver);
     }
 
-    if (!readonly.amended){
+    if (!readonly->amended){
         return false;
     }  
 
     // readonly 中数据不存在且 amended 为 true，读 dirty
-    it = this->m_dirty.find(key);
+    auto it = this->m_dirty.find(key);
     if (it != this->m_dirty.end()){
-        e = it->second;
+        e = it->second.get();
     }
 
     // 执行 missLocked 流程. 其中可能因为 miss 次数过多，而发生 dirty->readonly 的更新
@@ -321,6 +505,250 @@ bool Map<Key,Value>::load(Key key, Value& receiver){
  */
 template <class Key, class Value>
 void Map<Key,Value>::store(Key key, Value value){
+    this->clearExpiry(key, [this, &key, &value](){
+        this->storeEntry(key, value);
+    });
+}
+
+/**
+ * @brief: 写入数据，并在 ttl 之后自动删除
+ * 1）在过期锁内分配新的序号，取消 key 原有的定时任务，然后写入数据
+ * 2）向 TimeWheel 注册定时任务，任务中捕获过期状态的共享指针与序号
+ */
+template <class Key, class Value>
+void Map<Key,Value>::store(Key key, Value value, const ms ttl){
+    if (ttl.count() <= 0){
+        this->store(key, value);
+        return;
+    }
+
+    std::shared_ptr<Expiry> expiry = this->m_expiry;
+    Lock::lockGuard guard(expiry->lock);
+    uint64_t seq = ++expiry->seq;
+    auto it = expiry->timers.find(key);
+    if (it != expiry->timers.end()){
+        TimeWheel::Default()->cancel(it->second.second);
+    } else{
+        this->m_expiring++;
+    }
+    this->storeEntry(key, value);
+    uint64_t id = TimeWheel::Default()->schedule(ttl, [expiry, key, seq](){
+        Map<Key,Value>::expire(expiry, key, seq);
+    });
+    expiry->timers[key] = {seq, id};
+}
+
+/**
+ * @brief: 批量写入数据
+ * 不存在带过期时间的 key 时直接写入；否则持有过期锁，取消批次中 key 的过期时间后再完成整批写入
+ */
+template <class Key, class Value>
+template <class Iter>
+void Map<Key,Value>::storeBatch(Iter begin, Iter end){
+    if (this->m_expiring.load() == 0){
+        this->storeBatchEntries(begin, end);
+        return;
+    }
+
+    Lock::lockGuard guard(this->m_expiry->lock);
+    for (Iter it = begin; it != end; it++){
+        auto timer = this->m_expiry->timers.find(it->first);
+        if (timer != this->m_expiry->timers.end()){
+            TimeWheel::Default()->cancel(timer->second.second);
+            this->m_expiry->timers.erase(timer);
+            this->m_expiring--;
+        }
+    }
+    this->storeBatchEntries(begin, end);
+}
+
+/**
+ * @brief: 批量写入数据，不处理过期时间
+ * 0）map 为空时，通过 buildTable 直接构建 readonly
+ * 1）尝试在 readonly 中无锁更新，失败的 kv 对留待加锁后处理
+ * 2）加锁后，待处理的 kv 对数量不少于现有数据量的一半时，通过 rebuildLocked 直接构建新的 readonly
+ * 3）否则逐一执行与 store 相同的加锁流程
+ */
+template <class Key, class Value>
+template <class Iter>
+void Map<Key,Value>::storeBatchEntries(Iter begin, Iter end){
+    Epoch::Guard epochGuard;
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    // map 为空时直接构建 readonly. readonly.amended 为 false 时 dirty 中不存在额外数据
+    if (!readonly->amended && readonly->m->size() == 0){
+        Lock::lockGuard guard(this->m_dirtyLock);
+        readonly = this->m_readonly.load();
+        if (!readonly->amended && readonly->m->size() == 0){
+            this->swapReadonlyLocked(new ReadOnly(Map<Key,Value>::buildTable(begin, end), false));
+            this->m_misses.store(0);
+            this->m_dirty = map();
+            this->m_snapshot.reset();
+            return;
+        }
+    }
+    std::vector<Iter> pending;
+    for (Iter it = begin; it != end; it++){
+        typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, it->first);
+        if (e == nullptr || !e->tryStore(it->second)){
+            pending.push_back(it);
+        }
+    }
+    if (pending.empty()){
+        return;
+    }
+
+    Lock::lockGuard guard(this->m_dirtyLock);
+    readonly = this->m_readonly.load();
+    if (pending.size() * 2 >= (readonly->amended ? this->m_dirty.size() : readonly->m->size())){
+        this->rebuildLocked(pending);
+        return;
+    }
+
+    for (size_t i = 0; i < pending.size(); i++){
+        const Key& key = pending[i]->first;
+        const Value& value = pending[i]->second;
+        readonly = this->m_readonly.load();
+        const typename Map<Key,Value>::Entry::ptr* found = readonly->m->find(key);
+        if (found != nullptr){
+            if ((*found)->unexpungeLocked()){
+                this->m_dirty.insert({key,*found});
+                this->m_snapshot.reset();
+            }
+            (*found)->storeLocked(value);
+            continue;
+        }
+
+        auto it = this->m_dirty.find(key);
+        if (it != this->m_dirty.end()){
+            it->second->storeLocked(value);
+            continue;
+        }
+
+        this->insertLocked(key, value);
+    }
+}
+
+/**
+ * @brief: 将一批 kv 对与现有全量数据合并，直接构建新的 readonly
+ * 1）现有全量数据：readonly.amended 为 true 时为 dirty，否则为 readonly
+ * 2）已存在的 key 在原 entry 上更新，保证并发的无锁写入不会落在被丢弃的 entry 上；新 key 创建 entry
+ * 3）基于合并结果构建只读哈希表，发布为 amended 为 false 的 readonly，并清空 dirty
+ * 相比逐条插入 dirty 后再提升，省去了 dirty 中每个 key 一次的节点分配以及随后的 O(N) 拷贝
+ */
+template <class Key, class Value>
+template <class Iter>
+void Map<Key,Value>::rebuildLocked(const std::vector<Iter>& pending){
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load();
+    std::vector<std::pair<Key, typename Map<Key,Value>::Entry::ptr>> entries;
+    if (readonly->amended){
+        entries.reserve(this->m_dirty.size() + pending.size());
+        entries.assign(this->m_dirty.begin(), this->m_dirty.end());
+    } else{
+        entries.reserve(readonly->m->size() + pending.size());
+        readonly->m->range([&entries](const Key& key, const typename Map<Key,Value>::Entry::ptr& e)->bool{
+            entries.push_back({key, e});
+            return true;
+        });
+    }
+
+    for (size_t i = 0; i < pending.size(); i++){
+        const Key& key = pending[i]->first;
+        const typename Map<Key,Value>::Entry::ptr* found = nullptr;
+        if (readonly->amended){
+            auto it = this->m_dirty.find(key);
+            if (it != this->m_dirty.end()){
+                found = &it->second;
+            }
+        } else{
+            found = readonly->m->find(key);
+        }
+
+        // dirty 中以及 amended 为 false 的 readonly 中不存在硬删除态的 entry，可以直接更新
+        if (found != nullptr){
+            (*found)->storeLocked(pending[i]->second);
+            continue;
+        }
+        entries.push_back({key, std::allocate_shared<Entry>(memory::SlabAllocator<Entry>(), pending[i]->second)});
+    }
+
+    this->swapReadonlyLocked(new ReadOnly(std::make_shared<table>(std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()), entries.size()), false));
+    this->m_misses.store(0);
+    this->m_dirty = map();
+    this->m_snapshot.reset();
+}
+
+/**
+ * @brief: 批量读取数据
+ * 1）依次从 readonly 中读取，未命中且 readonly.amended 为 true 的 key 留待加锁后处理
+ * 2）加锁后逐一 double check readonly 并读取 dirty
+ * 3）一次性累计 miss 次数，达到 dirty 规模时执行提升
+ */
+template <class Key, class Value>
+size_t Map<Key,Value>::loadBatch(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found){
+    values.assign(keys.size(), Value());
+    found.assign(keys.size(), false);
+
+    Epoch::Guard epochGuard;
+    size_t hits = 0;
+    std::vector<size_t> pending;
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    for (size_t i = 0; i < keys.size(); i++){
+        typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, keys[i]);
+        if (e != nullptr){
+            Value v;
+            if (e->load(v)){
+                values[i] = v;
+                found[i] = true;
+                hits++;
+            }
+            continue;
+        }
+        if (readonly->amended){
+            pending.push_back(i);
+        }
+    }
+    if (pending.empty()){
+        return hits;
+    }
+
+    Lock::lockGuard guard(this->m_dirtyLock);
+    readonly = this->m_readonly.load();
+    size_t misses = 0;
+    for (size_t i = 0; i < pending.size(); i++){
+        const Key& key = keys[pending[i]];
+        typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
+        if (e == nullptr && readonly->amended){
+            auto it = this->m_dirty.find(key);
+            if (it != this->m_dirty.end()){
+                e = it->second.get();
+            }
+            misses++;
+        }
+
+        Value v;
+        if (e != nullptr && e->load(v)){
+            values[pending[i]] = v;
+            found[pending[i]] = true;
+            hits++;
+        }
+    }
+
+    if (misses > 0){
+        this->m_misses += misses;
+        if (this->m_misses.load() >= this->m_dirty.size()){
+            this->readonlyLocked();
+        }
+    }
+    return hits;
+}
+
+/**
+ * @brief: 写入数据，不处理过期时间
+ * @param: key——数据键
+ * @param: value——拟写入的数据
+ */
+template <class Key, class Value>
+void Map<Key,Value>::storeEntry(const Key& key, const Value& value){
     /**
      * 1）尝试从 readonly 中读取 key 对应 entry
      * 2）若 readonly 中存在该 entry，则尝试通过 cas 操作更新 entry 为新值，前提是 entry 不为硬删除态（expunged）
@@ -335,14 +763,12 @@ void Map<Key,Value>::store(Key key, Value value){
      * 11）往 dirty 中插入新的 entry 并返回
      */
 
+    // 进入 epoch 临界区
+    Epoch::Guard epochGuard;
+
     // 尝试从 readonly 中读取 key 对应 entry
-    typename Map<Key,Value>::Entry::ptr e = nullptr;
-    // 从 atomic 容器中读取 readonly 实例指针，并执行拷贝构造函数，生成 readonly 实例
-    typename Map<Key,Value>::ReadOnly readonly = *this->m_readonly.load();
-    auto it = readonly.m->find(key);
-    if (it != readonly.m->end()){
-        e = it->second;
-    }
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
 
     // 尝试通过 cas 操作完成 value 的更新，前提是 entry 不为 expunged 状态
     if (e != nullptr && e->tryStore(value)){
@@ -353,19 +779,17 @@ void Map<Key,Value>::store(Key key, Value value){
     Lock::lockGuard guard(this->m_dirtyLock);
 
     // 加锁后对 readonly double check
-    // 执行 readonly 赋值函数
-    readonly = *this->m_readonly.load();
-    it = readonly.m->find(key);
-    if (it != readonly.m->end()){
-        e = it->second;
-    }
+    readonly = this->m_readonly.load();
+    const typename Map<Key,Value>::Entry::ptr* found = readonly->m->find(key);
 
     // 若 entry 在 readonly 中存在，直接更新 value
-    if (e != nullptr){
+    if (found != nullptr){
+        e = found->get();
         // 尝试将 e 由硬删除态（expunuged）置为非硬删除态（nullptr）
         if (e->unexpungeLocked()){
-            // 若返回 true 表示此前为硬删除态，需要在 dirty 中补充该数据
-            this->m_dirty.insert({key,e});
+            // 若返回 true 表示此前为硬删除态，需要在 dirty 中补充该数据（与 readonly 共享同一 entry）
+            this->m_dirty.insert({key,*found});
+            this->m_snapshot.reset();
         }
         // 将 entry 中的内容更新为 value 并返回
         e->storeLocked(value);
@@ -376,30 +800,18 @@ void Map<Key,Value>::store(Key key, Value value){
      * 至此，已确定 readonly 中不存在数据
      */
     // 尝试从 dirty 中读取数据
-    it = this->m_dirty.find(key);
-    if (it != this->m_dirty.end()){
-        e = it->second;
-    }
+    auto it = this->m_dirty.find(key);
 
     // 若 dirty 中存在该 entry, 直接更新即可（dirty 中存在 entry 时，不可能为硬删除态（expunged））
-    if (e != nullptr){
+    // 注意不能复用加锁前从 readonly 中获取的 e，该 entry 可能已被更新后的 readonly 剔除
+    if (it != this->m_dirty.end()){
+        e = it->second.get();
         e->storeLocked(value);
         return;
     }
 
-    /**
-     * 至此已明确 readonly 和 dirty 中均不存在该 key，需要向 dirty 中插入新数据，此前需要执行一些准备工作
-     * 1）若 readonly.amended 为 false，需要将其更新为 true
-     * 2）若此前 dirty 为空，需要将 readonly 中所有非硬删除态的数据拷贝到 dirty（dirtyLocked 流程）
-     */
-    if (!readonly.amended){
-        // atomic 容器中，readonly 实例的 amended 更新为 true
-        this->m_readonly.load()->amended = true;
-        this->dirtyLocked();
-    }
-
-    // 向 dirty 中插入新数据对应的 entry
-    this->m_dirty.insert({key, typename Map<Key,Value>::Entry::ptr(new Entry(value))});
+    // 至此已明确 readonly 和 dirty 中均不存在该 key，需要向 dirty 中插入新数据
+    this->insertLocked(key, value);
 }
 
 /**
@@ -408,6 +820,14 @@ void Map<Key,Value>::store(Key key, Value value){
  */
 template<class Key, class Value>
 void Map<Key,Value>::evict(Key key){
+    this->clearExpiry(key, [this, &key](){
+        this->evictEntry(key);
+    });
+}
+
+// 删除数据，不处理过期时间
+template<class Key, class Value>
+void Map<Key,Value>::evictEntry(const Key& key){
     /**
      * 1）尝试从 readonly 中获取 key 对应 entry，若存在，则直接将 entry 中的内容置为 nullptr（软删除态）
      * 2）若 readonly 中 key 不存在，且 readonly.amended 为 false，则直接返回
@@ -416,14 +836,12 @@ void Map<Key,Value>::evict(Key key){
      * 5）若确定 readonly 中 key 不存在，从 dirty 中删除 key，并且执行 missLocked 流程
      */
 
+    // 进入 epoch 临界区
+    Epoch::Guard epochGuard;
+
     // 尝试从 readonly 中获取 key 对应 entry
-    typename Map<Key,Value>::Entry::ptr e = nullptr;
-    // 获取 readonly 引用，执行拷贝构造函数
-    typename Map<Key,Value>::ReadOnly readonly = *this->m_readonly.load();
-    auto it = readonly.m->find(key);
-    if (it != readonly.m->end()){
-        e = it->second;
-    }
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
 
     // 如果 readonly 中 entry 存在，直接将 entry 中内容置为 nullptr 软删除态，并返回
     if (e != nullptr){
@@ -432,7 +850,7 @@ void Map<Key,Value>::evict(Key key){
     }
 
     // 若 readonly.amended 为 false，说明 dirty 中也不可能存在数据，直接返回
-    if (!readonly.amended){
+    if (!readonly->amended){
         return;
     }
 
@@ -440,24 +858,20 @@ void Map<Key,Value>::evict(Key key){
     Lock::lockGuard guard(this->m_dirtyLock);
 
     // 针对 readonly 进行 double check
-    // 获取 readonly 引用，执行赋值函数
-    readonly = *this->m_readonly.load();
-    it = readonly.m->find(key);
-    if (it != readonly.m->end()){
-        e = it->second;
-    }
-    
+    readonly = this->m_readonly.load();
+    e = Map<Key,Value>::lookup(readonly, key);
     if (e != nullptr){
         e->evict();
         return;
     }
 
-    if (!readonly.amended){
+    if (!readonly->amended){
         return;
     }
 
     //  readonly 数据 miss，并且 amended 为 false，则需要从 dirty 中删除数据
     this->m_dirty.erase(key);
+    this->m_snapshot.reset();
     // 执行 missLocked 流程
     this->missLocked();
 }
@@ -475,27 +889,287 @@ void Map<Key,Value>::range(std::function<bool(const Key& key, const Value& value
      * 2）若 readonly.amended 为 true，加锁，然后将 dirty 中所有数据转移到 readonly 中
      * 3）遍历 readonly，依次执行闭包函数
      */
-    typename Map<Key,Value>::ReadOnly readonly = *this->m_readonly.load();
-    if (readonly.amended){
+    Epoch::Guard epochGuard;
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    if (readonly->amended){
         Lock::lockGuard guard(this->m_dirtyLock);
-        readonly = *this->m_readonly.load();
-        if (readonly.amended){
+        readonly = this->m_readonly.load();
+        if (readonly->amended){
             this->readonlyLocked();
         }
     }
 
     // 遍历 readonly
-    readonly = *this->m_readonly.load();
-    typename Map<Key,Value>::map& m = *readonly.m;
-    for (auto it : m){
+    readonly = this->m_readonly.load(std::memory_order_acquire);
+    readonly->m->range([&f](const Key& key, const typename Map<Key,Value>::Entry::ptr& e)->bool{
         Value v;
-        if (!it.second->load(v)){
-            continue;
+        if (!e->load(v)){
+            return true;
         }
-        if (!f(it.first,v)){
-            break;
+        return f(key,v);
+    });
+}
+
+/**
+ * @brief: 基于一致性快照遍历 map，不触发 dirty -> readonly 的提升
+ * 1）获取全量数据的只读哈希表快照
+ * 2）遍历快照，依次执行闭包函数
+ */
+template <class Key, class Value>
+void Map<Key,Value>::rangeSnapshot(std::function<bool(const Key& key, const Value& value)> f){
+    Epoch::Guard epochGuard;
+    std::shared_ptr<const typename Map<Key,Value>::table> t = this->snapshot();
+    Map<Key,Value>::rangeTable(*t, 0, t->capacity(), f);
+}
+
+/**
+ * @brief: 基于一致性快照并行遍历 map
+ * 1）获取全量数据的只读哈希表快照，将槽位切分为 partitions 个区间
+ * 2）每个区间作为一个任务通过 submit 提交，任务完成后通过信号量通知调用方. 提交失败时在当前线程中执行
+ * 3）等待所有任务完成
+ * 调用方在等待期间始终处于 epoch 临界区中，因此各任务访问的 entry 及其中的数据不会被回收，任务本身无需再进入临界区
+ */
+template <class Key, class Value>
+template <class Submit>
+void Map<Key,Value>::parallelRange(Submit submit, std::function<bool(const Key& key, const Value& value)> f, size_t partitions){
+    Epoch::Guard epochGuard;
+    std::shared_ptr<const typename Map<Key,Value>::table> t = this->snapshot();
+
+    size_t capacity = t->capacity();
+    if (partitions == 0){
+        partitions = 1;
+    }
+    if (partitions > capacity){
+        partitions = capacity;
+    }
+
+    // 任一区间被 f 终止时置为 true，其余区间据此提前退出
+    std::atomic<bool> stopped{false};
+    Semaphore done;
+    for (size_t i = 0; i < partitions; i++){
+        size_t begin = capacity * i / partitions, end = capacity * (i + 1) / partitions;
+        std::function<void()> task = [&t, &f, &stopped, &done, begin, end](){
+            if (!Map<Key,Value>::rangeTable(*t, begin, end, [&f, &stopped](const Key& key, const Value& value)->bool{
+                return !stopped.load(std::memory_order_relaxed) && f(key, value);
+            })){
+                stopped.store(true, std::memory_order_relaxed);
+            }
+            done.notify();
+        };
+        if (!submit(task)){
+            task();
         }
     }
+
+    for (size_t i = 0; i < partitions; i++){
+        done.wait();
+    }
+}
+
+/**
+ * @brief: 数据存在时读取数据，否则写入 value
+ * 1）readonly 中存在 entry 且不为硬删除态时，直接在 entry 上原子地完成读取或写入
+ * 2）加锁后 double check readonly. 若 entry 处于硬删除态，先恢复为软删除态并补充到 dirty 中
+ * 3）readonly 中不存在时，在 dirty 的 entry 上完成操作，并执行 missLocked 流程
+ * 4）两者均不存在，插入新数据
+ */
+template <class Key, class Value>
+bool Map<Key,Value>::loadOrStore(Key key, Value value, Value& actual){
+    Epoch::Guard epochGuard;
+
+    bool loaded = false;
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
+    if (e != nullptr && e->tryLoadOrStore(value, actual, loaded)){
+        return loaded;
+    }
+
+    Lock::lockGuard guard(this->m_dirtyLock);
+    readonly = this->m_readonly.load();
+    const typename Map<Key,Value>::Entry::ptr* found = readonly->m->find(key);
+    if (found != nullptr){
+        e = found->get();
+        if (e->unexpungeLocked()){
+            this->m_dirty.insert({key,*found});
+            this->m_snapshot.reset();
+        }
+        e->tryLoadOrStore(value, actual, loaded);
+        return loaded;
+    }
+
+    auto it = this->m_dirty.find(key);
+    if (it != this->m_dirty.end()){
+        it->second->tryLoadOrStore(value, actual, loaded);
+        this->missLocked();
+        return loaded;
+    }
+
+    this->insertLocked(key, value);
+    actual = value;
+    return false;
+}
+
+/**
+ * @brief: 删除数据，并将被删除的数据存储到 receiver 中
+ * 从 dirty 中获取 entry 时，entry 会随即从 dirty 中移除，因此需要持有其共享指针，保证后续删除数据时 entry 仍然有效
+ */
+template <class Key, class Value>
+bool Map<Key,Value>::loadAndDelete(Key key, Value& receiver){
+    bool deleted = false;
+    this->clearExpiry(key, [this, &key, &receiver, &deleted](){
+        deleted = this->loadAndDeleteEntry(key, receiver);
+    });
+    return deleted;
+}
+
+// 删除数据并读取被删除的数据 [在过期锁内执行]
+template <class Key, class Value>
+bool Map<Key,Value>::loadAndDeleteEntry(const Key& key, Value& receiver){
+    Epoch::Guard epochGuard;
+
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
+    typename Map<Key,Value>::Entry::ptr holder;
+    if (e == nullptr && readonly->amended){
+        Lock::lockGuard guard(this->m_dirtyLock);
+        readonly = this->m_readonly.load();
+        e = Map<Key,Value>::lookup(readonly, key);
+        if (e == nullptr && readonly->amended){
+            auto it = this->m_dirty.find(key);
+            if (it != this->m_dirty.end()){
+                holder = it->second;
+                e = holder.get();
+                this->m_dirty.erase(it);
+                this->m_snapshot.reset();
+            }
+            this->missLocked();
+        }
+    }
+
+    if (e == nullptr){
+        return false;
+    }
+    return e->loadAndEvict(receiver);
+}
+
+template <class Key, class Value>
+bool Map<Key,Value>::compareAndSwap(Key key, Value old, Value value){
+    Epoch::Guard epochGuard;
+
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
+    if (e != nullptr){
+        return e->tryCompareAndSwap(old, value);
+    }
+    if (!readonly->amended){
+        return false;
+    }
+
+    Lock::lockGuard guard(this->m_dirtyLock);
+    readonly = this->m_readonly.load();
+    e = Map<Key,Value>::lookup(readonly, key);
+    if (e != nullptr){
+        return e->tryCompareAndSwap(old, value);
+    }
+
+    bool swapped = false;
+    auto it = this->m_dirty.find(key);
+    if (it != this->m_dirty.end()){
+        swapped = it->second->tryCompareAndSwap(old, value);
+        this->missLocked();
+    }
+    return swapped;
+}
+
+/**
+ * @brief: 当数据存在且与 old 相等时，将其删除
+ * 与 loadAndDelete 不同，数据不相等时不应从 dirty 中移除 entry，因此在 dirty 中的 entry 上同样执行软删除
+ */
+template <class Key, class Value>
+bool Map<Key,Value>::compareAndDelete(Key key, Value old){
+    // 删除与取消过期时间在同一把过期锁内完成，避免两者之间插入的带 ttl 写入被取消过期时间
+    return this->clearExpiryIf(key, [this, &key, &old]()->bool{
+        return this->compareAndDeleteEntry(key, old);
+    });
+}
+
+// 数据与 old 相等时将其删除 [在过期锁内执行]
+template <class Key, class Value>
+bool Map<Key,Value>::compareAndDeleteEntry(const Key& key, const Value& old){
+    Epoch::Guard epochGuard;
+
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
+    bool deleted = false;
+    if (e != nullptr){
+        deleted = e->tryCompareAndEvict(old);
+    } else if (readonly->amended){
+        Lock::lockGuard guard(this->m_dirtyLock);
+        readonly = this->m_readonly.load();
+        e = Map<Key,Value>::lookup(readonly, key);
+        if (e != nullptr){
+            deleted = e->tryCompareAndEvict(old);
+        } else{
+            auto it = this->m_dirty.find(key);
+            if (it != this->m_dirty.end()){
+                deleted = it->second->tryCompareAndEvict(old);
+                this->missLocked();
+            }
+        }
+    }
+
+    return deleted;
+}
+
+/**
+ * @brief: 数据存在时读取数据，否则通过 factory 构造数据并写入
+ * 1）readonly 中存在数据时直接读取返回
+ * 2）加锁后 double check readonly，存在 entry 时（必要时先恢复硬删除态）在 entry 上完成读取或写入
+ * 3）dirty 中存在 entry 时，在 entry 上完成读取或写入，并执行 missLocked 流程
+ * 4）两者均不存在，构造数据并插入
+ */
+template <class Key, class Value>
+bool Map<Key,Value>::computeIfAbsent(Key key, std::function<Value()> factory, Value& actual){
+    Epoch::Guard epochGuard;
+
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    typename Map<Key,Value>::Entry* e = Map<Key,Value>::lookup(readonly, key);
+    if (e != nullptr && e->load(actual)){
+        return true;
+    }
+
+    bool loaded = false;
+    Lock::lockGuard guard(this->m_dirtyLock);
+    readonly = this->m_readonly.load();
+    const typename Map<Key,Value>::Entry::ptr* found = readonly->m->find(key);
+    if (found != nullptr){
+        e = found->get();
+        if (e->unexpungeLocked()){
+            this->m_dirty.insert({key,*found});
+            this->m_snapshot.reset();
+        }
+        if (e->load(actual)){
+            return true;
+        }
+        e->tryLoadOrStore(factory(), actual, loaded);
+        return loaded;
+    }
+
+    auto it = this->m_dirty.find(key);
+    if (it != this->m_dirty.end()){
+        e = it->second.get();
+        if (e->load(actual)){
+            loaded = true;
+        } else{
+            e->tryLoadOrStore(factory(), actual, loaded);
+        }
+        this->missLocked();
+        return loaded;
+    }
+
+    actual = factory();
+    this->insertLocked(key, actual);
+    return false;
 }
 
 /**
@@ -519,17 +1193,41 @@ void Map<Key,Value>::missLocked(){
  */
 template <class Key, class Value>
 void Map<Key,Value>::readonlyLocked(){
-    // 从原子容器中获取 readonly 实例指针
-    typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load();
-    // 将 dirty 通过移动函数填充到 readonly 中（通过 std::move 操作避免发生拷贝）
-    readonly->m = std::make_shared<map>(std::move(this->m_dirty));
-    // amended 标识置为 false
-    readonly->amended = false;
+    // 基于 dirty 构建只读哈希表，填充到新的 readonly 中，amended 标识置为 false
+    // 构建成本为 O(N)，与 miss 次数达到 dirty 规模后才触发的频率相抵，均摊到每次 miss 上为 O(1)
+    this->swapReadonlyLocked(new ReadOnly(std::make_shared<table>(this->m_dirty.begin(), this->m_dirty.end(), this->m_dirty.size()), false));
 
     // 清空 readonly miss 计数器
     this->m_misses.store(0);
     // 构造新的 dirty 实例
     this->m_dirty = map();
+    this->m_snapshot.reset();
+}
+
+// 使用新的 readonly 实例替换原实例，原实例待所有临界区中的读取方离开后再回收
+template <class Key, class Value>
+void Map<Key,Value>::swapReadonlyLocked(typename Map<Key,Value>::ReadOnly* readonly){
+    typename Map<Key,Value>::ReadOnly* old = this->m_readonly.exchange(readonly);
+    Epoch::Retire(old);
+}
+
+/**
+ * @brief: 向 dirty 中插入新的 key
+ * 1）若 readonly.amended 为 false，需要将其更新为 true
+ * 2）若此前 dirty 为空，需要将 readonly 中所有非硬删除态的数据拷贝到 dirty（dirtyLocked 流程）
+ * 3）向 dirty 中插入新数据对应的 entry
+ */
+template <class Key, class Value>
+void Map<Key,Value>::insertLocked(const Key& key, const Value& value){
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load();
+    if (!readonly->amended){
+        // 发布 amended 为 true 的新 readonly 实例，map 部分与原实例共享
+        this->swapReadonlyLocked(new ReadOnly(readonly->m, true));
+        this->dirtyLocked();
+    }
+
+    this->m_dirty.insert({key, std::allocate_shared<Entry>(memory::SlabAllocator<Entry>(), value)});
+    this->m_snapshot.reset();
 }
 
 /**
@@ -542,181 +1240,147 @@ void Map<Key,Value>::dirtyLocked(){
         return;
     }
 
-    // 获取 readonly 引用
-    // 从 atomic 中获取 readonly 实例，并通过拷贝构造函数生成副本
-    typename Map<Key,Value>::ReadOnly readonly = *this->m_readonly.load();
-    // 获取 map 引用，不发生拷贝行为
-    typename Map<Key,Value>::map& m = *readonly.m;
-    this->m_dirty.reserve(m.size());
+    // 获取 readonly 实例，不发生拷贝行为
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load();
+    this->m_dirty.reserve(readonly->m->size());
     /**
      * 遍历 map O(N)
      * 1）将软删除态 nullptr -> 硬删除态 expunged
      * 2）非删除态数据拷贝到 dirty 中
      */
-    for (auto it : m){
+    readonly->m->range([this](const Key& key, const typename Map<Key,Value>::Entry::ptr& e)->bool{
         // 其中会将 readonly 中，原本为软删除态 nullptr 的 entry 置为硬删除态 expunged
         // 无论此前是软删除态还是硬删除态，都需要过滤该 entry，不添加到 dirty 中
-        if (it.second->tryExpungeLocked()){
-            continue;
+        if (e->tryExpungeLocked()){
+            return true;
         }
         // 对于 readonly 中未删除的数据，插入到 dirty 中
-        this->m_dirty.insert({it.first,it.second});
-    }
+        this->m_dirty.insert({key,e});
+        return true;
+    });
 }
 
-// entry 构造函数，入参为存储数据对应智能指针
-template<class Key, class Value>
-Map<Key,Value>::Entry::Entry(Value v){
-    typename Map<Key,Value>::Entry::WrappedV* wv = new WrappedV(v);
-    this->container.store(wv);
-}
-
-// entry 析构函数
-template<class Key, class Value>
-Map<Key,Value>::Entry::~Entry(){
-    typename Map<Key,Value>::Entry::WrappedV* wv = this->container.load();
-    if (wv == nullptr || wv == Map::s_expunged){
-        return;
-    }
-    delete wv;
-}
-
-/**
- * 读操作相关
- */
 /**
- * @brief: 从 entry 中读取数据，存储到 receiver 中
- * @param: 承载读取数据的容器
- * @return: true——读取成功 false——读取失败
+ * @brief: 获取全量数据的只读哈希表快照
+ * dirty 中的数据在锁内拷贝到临时哈希表中，锁的持有时间与 dirty 规模成正比，但不会修改 dirty，
+ * 后续的插入操作无需重新执行 dirtyLocked 流程. 构建出的快照被缓存，直到 dirty 的 key 集合发生变化，
+ * 期间重复调用只需在锁内拷贝一次 shared_ptr
  */
-template<class Key, class Value>
-bool Map<Key,Value>::Entry::load(Value& receiver){
-    typename Map<Key,Value>::Entry::WrappedV* wv = this->container.load();
-    if (wv == nullptr || wv == Map::s_expunged){
-        return false;
+template <class Key, class Value>
+std::shared_ptr<const typename Map<Key,Value>::table> Map<Key,Value>::snapshot(){
+    const typename Map<Key,Value>::ReadOnly* readonly = this->m_readonly.load(std::memory_order_acquire);
+    if (!readonly->amended){
+        return readonly->m;
     }
 
-    receiver = wv->v;
-    return true;
+    Lock::lockGuard guard(this->m_dirtyLock);
+    readonly = this->m_readonly.load();
+    if (!readonly->amended){
+        return readonly->m;
+    }
+    if (!this->m_snapshot){
+        this->m_snapshot = std::make_shared<table>(this->m_dirty.begin(), this->m_dirty.end(), this->m_dirty.size());
+    }
+    return this->m_snapshot;
 }
 
 /**
- * entry 写操作相关
+ * @brief: 取消 key 的过期时间，然后执行写操作
+ * 写操作在过期锁内执行，到期删除要么发生在取消之前（随后被写操作覆盖），要么发现任务已取消而放弃删除
  */
-/**
- * @brief: 存储数据 [调用此方法时一定处于持有锁状态]
- * @param: v——存储数据的智能指针
- * 进入该方法时，container 中的 old value 不可能为 expunged 态
- */
-template<class Key, class Value>
-void Map<Key,Value>::Entry::storeLocked(Value v){
-    typename Map<Key,Value>::Entry::WrappedV* _new = new WrappedV(v);
-    while(true){
-        typename Map<Key,Value>::Entry::WrappedV* old = this->container.load();
-        if (this->container.compare_exchange_strong(old,_new)){
-            if (old != nullptr){
-                delete old;
-            }
-            return;
-        }
+template <class Key, class Value>
+template <class F>
+void Map<Key,Value>::clearExpiry(const Key& key, F f){
+    if (this->m_expiring.load() == 0){
+        f();
+        return;
+    }
+
+    Lock::lockGuard guard(this->m_expiry->lock);
+    auto it = this->m_expiry->timers.find(key);
+    if (it != this->m_expiry->timers.end()){
+        TimeWheel::Default()->cancel(it->second.second);
+        this->m_expiry->timers.erase(it);
+        this->m_expiring--;
     }
+    f();
 }
 
 /**
- * @brief: 尝试存储数据
- * @param: v——尝试存储数据的智能指针
- * @return: true——存储成功 false——存储失败（仅当处于硬删除态时失败）
+ * @brief: 在过期锁内执行写操作，成功时取消 key 的过期时间
+ * 写操作失败时 key 的数据保持不变，其过期时间同样保留
  */
-template<class Key, class Value>
-bool Map<Key,Value>::Entry::tryStore(Value v){
-    typename Map<Key,Value>::Entry::WrappedV* _new = new WrappedV(v);
-    while (true){
-        typename Map<Key,Value>::Entry::WrappedV* old = this->container.load();
-        // 若此前已处于硬删除（expunged），则更新失败
-        if (old == Map::s_expunged){
-            delete _new;
-            return false;
-        }
-
-        if (this->container.compare_exchange_strong(old,_new)){
-            // 更新成功，需要删除原本的 wrappedV 实例
-            if (old != nullptr){
-                delete old;
-            }
-            return true;
-        }
+template <class Key, class Value>
+template <class F>
+bool Map<Key,Value>::clearExpiryIf(const Key& key, F f){
+    if (this->m_expiring.load() == 0){
+        return f();
     }
-}
 
-// 删除 entry 中存储的数据
-template<class Key, class Value>
-void Map<Key,Value>::Entry::evict(){
-    while (true){
-        typename Map<Key,Value>::Entry::WrappedV* old = this->container.load();
-        if ( old == nullptr || old == Map::s_expunged ){
-            return;
-        }
-        if (this->container.compare_exchange_strong(old,nullptr)){
-            delete old;
-            return;
-        }
+    Lock::lockGuard guard(this->m_expiry->lock);
+    if (!f()){
+        return false;
+    }
+    auto it = this->m_expiry->timers.find(key);
+    if (it != this->m_expiry->timers.end()){
+        TimeWheel::Default()->cancel(it->second.second);
+        this->m_expiry->timers.erase(it);
+        this->m_expiring--;
     }
+    return true;
 }
 
 /**
- * entry 状态更新操作相关方法
+ * @brief: 定时任务到期时执行
+ * 1）map 已析构时直接返回
+ * 2）key 的过期状态已被取消或被后续带 ttl 的写入覆盖（序号不一致）时直接返回
+ * 3）移除过期状态并删除数据
  */
-/**
- * @brief: 将 entry 置为非硬删除态
- * @return: true——之前处于硬删除态（expunged），更新成功；false——之前处于非硬删除态，无需更新
- */
-template<class Key, class Value>
-bool Map<Key,Value>::Entry::unexpungeLocked(){
-    return this->container.compare_exchange_strong(Map::s_expunged,nullptr);
+template <class Key, class Value>
+void Map<Key,Value>::expire(std::shared_ptr<Expiry> expiry, const Key& key, const uint64_t seq){
+    Lock::lockGuard guard(expiry->lock);
+    if (!expiry->owner){
+        return;
+    }
+    auto it = expiry->timers.find(key);
+    if (it == expiry->timers.end() || it->second.first != seq){
+        return;
+    }
+    expiry->timers.erase(it);
+    expiry->owner->m_expiring--;
+    expiry->owner->evictEntry(key);
 }
 
-/**
- * @brief: 尝试将 entry 置为硬删除态（expunged）
- * @return: true——之前就是硬删除态，或者成功将 nil （软删除态）置为硬删除态； false——更新失败
- */
-template<class Key, class Value>
-bool Map<Key,Value>::Entry::tryExpungeLocked(){
-    typename Map<Key,Value>::Entry::WrappedV* wv = this->container.load();
-    while (wv == nullptr){
-        if (this->container.compare_exchange_strong(wv, Map::s_expunged)){
+// 遍历快照中指定槽位区间内的数据，跳过处于删除态的 entry
+template <class Key, class Value>
+bool Map<Key,Value>::rangeTable(const table& t, const size_t begin, const size_t end, const std::function<bool(const Key& key, const Value& value)>& f){
+    return t.range(begin, end, [&f](const Key& key, const typename Map<Key,Value>::Entry::ptr& e)->bool{
+        Value v;
+        if (!e->load(v)){
             return true;
         }
-        wv = this->container.load();
-    }
-
-    return wv == Map::s_expunged;
+        return f(key, v);
+    });
 }
 
-template<class Key, class Value>
-Map<Key,Value>::Entry::WrappedV::WrappedV(Value v):v(v){}
-
 // readonly 默认构造函数
 template<class Key, class Value>
 Map<Key,Value>::ReadOnly::ReadOnly():amended(false){
-    this->m.reset(new map);
+    this->m.reset(new table);
 }
 
-// readonly 拷贝构造函数重载
+// readonly 构造函数，基于已有的只读哈希表构造
 template<class Key, class Value>
-Map<Key,Value>::ReadOnly::ReadOnly(const ReadOnly& other){
-    this->amended = other.amended;
-    this->m = other.m;
-}
+Map<Key,Value>::ReadOnly::ReadOnly(std::shared_ptr<table> m, const bool amended):amended(amended),m(m){}
 
-// readonly 赋值函数重载
+// 从 readonly 中查找 entry，返回 map 持有的 entry 裸指针，避免共享指针拷贝带来的引用计数竞争
 template<class Key, class Value>
-typename Map<Key,Value>::ReadOnly& Map<Key,Value>::ReadOnly::operator=(const ReadOnly& other){
-    if (this == &other){
-        return *this;
+typename Map<Key,Value>::Entry* Map<Key,Value>::lookup(const ReadOnly* readonly, const Key& key){
+    const typename Entry::ptr* e = readonly->m->find(key);
+    if (e == nullptr){
+        return nullptr;
     }
-    this->amended = other.amended;
-    this->m = other.m;
-    return *this;
+    return e->get();
 }
 
 
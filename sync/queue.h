@@ -1,129 +1,300 @@
-#pragma once 
+#pragma once
 
 #include <memory>
 #include <atomic>
 
 #include "../base/nocopy.h"
-#include "../base/defer.h"
+#include "hazard.h"
 
 namespace cbricks{namespace sync{
 
-// 并发安全的双向链表结构，只支持按照队列模式，从对头插入元素，从队尾弹出元素
+/**
+ * @brief: 并发安全的无界 MPMC 无锁队列——基于 Michael-Scott 算法实现
+ * 功能点：
+ *  - 单向链表 + 哨兵节点. push 通过 cas 挂载到 tail 之后，pop 通过 cas 推进 head
+ *  - 基于 hazard pointer 保证被摘除的节点在仍被其他线程访问时不会被回收
+ *  - 回收的节点优先进入线程本地缓存，溢出部分进入全局空闲链表，减少 push 时的内存分配
+ *  - 节点中存放元素的指针. 弹出方 cas 成功后独占该元素并将其移出，成为新哨兵的节点不会残留对元素的引用
+ * 性能说明：无锁队列的收益在于进度保证——持有者被抢占不会阻塞其他线程，而非吞吐量. 在核数较少、争抢激烈的场景下，
+ * 互斥锁 + std::queue 通常更快（见 testQueueBenchmark），仅在需要避免锁持有者被抢占带来的长尾时选用
+ */
 template <typename T>
 class Queue : base::Noncopyable{
-public: 
+public:
     typedef std::shared_ptr<Queue<T>> ptr;
 
 public:
+    // 构造函数. 初始化哨兵节点
     Queue();
+    // 析构函数. 调用时需保证不存在并发访问
     ~Queue();
 
 public:
+    // 从队尾插入元素
     void push(T data);
+    /**
+     * @brief: 从队头弹出元素
+     * @param: data——接收元素的容器
+     * @return: true——弹出成功 false——队列为空
+     */
     bool pop(T& data);
+    // 队列是否为空
+    const bool empty() const;
 
 private:
-    class ListNode{   
-    public:
+    // hazard pointer 槽位分配
+    enum HazardSlot{
+        // 保护 head 或 tail 节点
+        CUR = 0,
+        // 保护 head 的后继节点
+        NEXT = 1,
+        // 保护空闲链表的栈顶节点
+        FREE = 2
+    };
+
+    struct ListNode{
         ListNode() = default;
-        ListNode(T data);
 
-        sync::SpinLock lock;
-        
-        T data;
+        /**
+         * 元素指针. push 时写入，弹出方 cas 成功后取走元素并置空.
+         * cas 失败的弹出方也可能读到该指针，但只有 cas 成功的一方会解引用，因此使用原子变量承载
+         */
+        std::atomic<T*> data{nullptr};
+        // 后继节点
+        std::atomic<ListNode*> next{nullptr};
+    };
+
+    /**
+     * 线程本地的节点缓存
+     * 线程退出时 hazard pointer 记录的析构流程仍可能回收节点，而线程本地对象的析构顺序不可控，
+     * 因此缓存本身为平凡类型，由单独的 LocalCacheCleaner 在析构时将缓存的节点归还到全局空闲链表并关闭缓存
+     */
+    struct LocalCache{
+        ListNode* nodes[64];
+        size_t size;
+        // 缓存是否已关闭. 关闭后回收的节点直接进入全局空闲链表
+        bool closed;
+    };
 
-        // 相邻节点
-        std::shared_ptr<ListNode> prev;
-        std::shared_ptr<ListNode> next;
+    struct LocalCacheCleaner{
+        ~LocalCacheCleaner();
     };
 
-    // 头结点
-    std::shared_ptr<ListNode> m_head; 
+private:
+    // 获取一个节点，优先从空闲链表中复用
+    static ListNode* allocNode();
+    // [hazard pointer 回收函数] 将节点重置后放回线程本地缓存或全局空闲链表，两者均已满时直接释放
+    static void recycleNode(void* node);
+    // 将节点放回全局空闲链表，空闲链表已满时直接释放
+    static void freeNode(ListNode* node);
+    // 获取线程本地的节点缓存
+    static LocalCache& localCache();
+
+private:
+    // 空闲链表中至多缓存的节点数量
+    static const int MAX_FREE_NODES = 4096;
+    // 全局空闲链表（无锁栈），同一元素类型的队列共享
+    static std::atomic<ListNode*> s_free;
+    // 空闲链表中的节点数量，仅用于近似限流
+    static std::atomic<int> s_freeCnt;
+    // 线程本地的节点缓存
+    static thread_local LocalCache t_cache;
+
+private:
+    // 头节点，始终指向哨兵节点
+    std::atomic<ListNode*> m_head;
+    // 填充字节，保证 head 与 tail 位于不同的 cache line，避免 push 和 pop 之间发生伪共享
+    char m_padding[64];
     // 尾节点
-    std::shared_ptr<ListNode> m_tail;
+    std::atomic<ListNode*> m_tail;
 };
 
+template<typename T>
+std::atomic<typename Queue<T>::ListNode*> Queue<T>::s_free{nullptr};
+
+template<typename T>
+std::atomic<int> Queue<T>::s_freeCnt{0};
+
+template<typename T>
+thread_local typename Queue<T>::LocalCache Queue<T>::t_cache;
+
 // 构造函数
 template<typename T>
 Queue<T>::Queue(){
-    this->m_head.reset(new ListNode);
-    this->m_tail.reset(new ListNode);
-    
-    this->m_head->next = this->m_tail;
-    this->m_head->prev = nullptr;
-    this->m_tail->prev = this->m_head;
-    this->m_tail->next = nullptr;
+    ListNode* dummy = new ListNode;
+    this->m_head.store(dummy);
+    this->m_tail.store(dummy);
 }
 
-// 析构时将各节点之间的引用指针删除即可
+// 析构时释放链表中的所有节点
 template<typename T>
 Queue<T>::~Queue(){
-    // 遍历所有节点，删除对应的指针
-    std::shared_ptr<ListNode> move = this->m_head;
-
+    ListNode* move = this->m_head.load();
     while (move){
-        std::shared_ptr<ListNode> next = move->next;
-        move->next = nullptr;
-        move->prev = nullptr;
+        ListNode* next = move->next.load();
+        // 哨兵节点中的元素已被取走，为 nullptr
+        delete move->data.load();
+        delete move;
         move = next;
     }
 }
 
+/**
+ * @brief: 从队尾插入元素
+ * 1）获取 tail 并通过 hazard pointer 保护
+ * 2）若 tail 之后已挂载有节点，说明 tail 落后，帮助推进 tail 后重试
+ * 3）通过 cas 将新节点挂载到 tail 之后，然后尝试推进 tail（失败说明已被其他线程推进）
+ */
 template<typename T>
 void Queue<T>::push(T data){
-    // 对 head 加锁，完成节点插入
-    this->m_head->lock.lock();
-    base::Defer headDefer([this](){
-        this->m_head->lock.unlock();
-    });
+    ListNode* node = Queue<T>::allocNode();
+    node->data.store(new T(std::move(data)), std::memory_order_relaxed);
 
+    while (true){
+        ListNode* tail = HazardPointer::Protect(CUR, this->m_tail);
+        ListNode* next = tail->next.load();
+        if (tail != this->m_tail.load()){
+            continue;
+        }
 
-    std::shared_ptr<ListNode> cur(new ListNode(data));
-    // 节点的 next 
-    cur->next = this->m_head->next;
-    cur->prev = this->m_head;
+        if (next != nullptr){
+            this->m_tail.compare_exchange_strong(tail, next);
+            continue;
+        }
 
-    this->m_head->next->prev = cur;
-    this->m_head->next = cur;
+        if (tail->next.compare_exchange_strong(next, node)){
+            this->m_tail.compare_exchange_strong(tail, node);
+            HazardPointer::Clear(CUR);
+            return;
+        }
+    }
 }
 
+/**
+ * @brief: 从队头弹出元素
+ * 1）依次通过 hazard pointer 保护 head 及其后继节点 next
+ * 2）next 为空，说明队列为空
+ * 3）head 与 tail 重合但 next 不为空，说明 tail 落后，帮助推进 tail 后重试
+ * 4）读取 next 中的元素指针，然后通过 cas 将 head 推进到 next，next 成为新的哨兵节点
+ * 5）cas 成功后独占该元素：将其移出并释放，同时置空 next 中的指针，新哨兵节点不再持有元素
+ * 6）退休原哨兵节点，待其不再被引用时回收
+ */
 template<typename T>
 bool Queue<T>::pop(T& data){
-    // 先针对尾节点加锁
-    this->m_tail->lock.lock();
-    base::Defer tailDefer([this](){
-        this->m_tail->lock.unlock();
-    });
-
-    // 再针对拟删除节点的前驱节点加锁
-    std::shared_ptr<ListNode> lockTarget = this->m_tail->prev->prev;
-    if (!lockTarget){
-        return false;
+    while (true){
+        ListNode* head = HazardPointer::Protect(CUR, this->m_head);
+        ListNode* tail = this->m_tail.load();
+        ListNode* next = HazardPointer::Protect(NEXT, head->next);
+        if (head != this->m_head.load()){
+            continue;
+        }
+
+        if (next == nullptr){
+            HazardPointer::Clear(CUR);
+            HazardPointer::Clear(NEXT);
+            return false;
+        }
+
+        if (head == tail){
+            this->m_tail.compare_exchange_strong(tail, next);
+            continue;
+        }
+
+        // 需要在 cas 之前读取元素指针，cas 成功后 next 作为新哨兵可能被其他线程退休. 元素只有 cas 成功的一方可以访问
+        T* value = next->data.load(std::memory_order_relaxed);
+        if (this->m_head.compare_exchange_strong(head, next)){
+            next->data.store(nullptr, std::memory_order_relaxed);
+            data = std::move(*value);
+            delete value;
+            HazardPointer::Clear(CUR);
+            HazardPointer::Clear(NEXT);
+            HazardPointer::Retire(head, &Queue<T>::recycleNode);
+            return true;
+        }
+    }
+}
+
+template<typename T>
+const bool Queue<T>::empty() const{
+    ListNode* head = HazardPointer::Protect(CUR, this->m_head);
+    bool empty = head->next.load() == nullptr;
+    HazardPointer::Clear(CUR);
+    return empty;
+}
+
+/**
+ * @brief: 获取一个节点. 优先级为 线程本地缓存 -> 全局空闲链表 -> 新建节点
+ * 全局空闲链表的栈顶节点通过 hazard pointer 保护：被保护的节点不会被回收，也就不会再次入栈，从而规避了 ABA 问题
+ */
+template<typename T>
+typename Queue<T>::ListNode* Queue<T>::allocNode(){
+    LocalCache& cache = Queue<T>::localCache();
+    if (cache.size > 0){
+        return cache.nodes[--cache.size];
+    }
+
+    while (true){
+        ListNode* top = HazardPointer::Protect(FREE, Queue<T>::s_free);
+        if (top == nullptr){
+            HazardPointer::Clear(FREE);
+            return new ListNode;
+        }
+
+        ListNode* next = top->next.load();
+        if (Queue<T>::s_free.compare_exchange_strong(top, next)){
+            HazardPointer::Clear(FREE);
+            Queue<T>::s_freeCnt--;
+            top->next.store(nullptr);
+            return top;
+        }
     }
+}
 
-    lockTarget->lock.lock();
-    base::Defer targetDefer([this](){
-        this->m_tail->prev->prev->lock.unlock();
-    });
+// 将节点重置后放回线程本地缓存，本地缓存已满时放回全局空闲链表
+template<typename T>
+void Queue<T>::recycleNode(void* ptr){
+    ListNode* node = static_cast<ListNode*>(ptr);
+    // 元素已在弹出时取走，节点中不存在残留数据
+    node->next.store(nullptr, std::memory_order_relaxed);
 
-    std::shared_ptr<ListNode> targetPrev = lockTarget;
-    while (targetPrev->next->next != this->m_tail){
-        targetPrev = targetPrev->next;
+    LocalCache& cache = Queue<T>::localCache();
+    if (!cache.closed && cache.size < sizeof(cache.nodes) / sizeof(cache.nodes[0])){
+        cache.nodes[cache.size++] = node;
+        return;
     }
+    Queue<T>::freeNode(node);
+}
 
-    std::shared_ptr<ListNode> target = targetPrev->next;
-    data = target->data;
+// 将节点放回全局空闲链表. 空闲链表已满时直接释放
+template<typename T>
+void Queue<T>::freeNode(ListNode* node){
+    if (Queue<T>::s_freeCnt.load() >= MAX_FREE_NODES){
+        delete node;
+        return;
+    }
 
-    this->m_tail->prev = targetPrev;
-    targetPrev->next = this->m_tail;
+    ListNode* top = Queue<T>::s_free.load();
+    do{
+        node->next.store(top);
+    } while (!Queue<T>::s_free.compare_exchange_weak(top, node));
+    Queue<T>::s_freeCnt++;
+}
 
-    target->prev = nullptr;
-    target->next = nullptr;
-    
-    return true;
+// 首次访问时构造 cleaner，保证线程退出时缓存的节点能被归还
+template<typename T>
+typename Queue<T>::LocalCache& Queue<T>::localCache(){
+    static thread_local LocalCacheCleaner cleaner;
+    (void)cleaner;
+    return t_cache;
 }
 
 template<typename T>
-Queue<T>::ListNode::ListNode(T data):data(data),prev(nullptr),next(nullptr){}
+Queue<T>::LocalCacheCleaner::~LocalCacheCleaner(){
+    for (size_t i = 0; i < t_cache.size; i++){
+        Queue<T>::freeNode(t_cache.nodes[i]);
+    }
+    t_cache.size = 0;
+    t_cache.closed = true;
+}
 
-}}
\ No newline at end of file
+}}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#include "../base/nocopy.h"
+#include "lock.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * @brief: 并发安全的分片 map 工具
+ * 适用场景：写操作（尤其是插入新 key）频繁的场景. 读多写少、key 集合稳定的场景优先使用 sync::Map
+ * 功能点：
+ *  - 数据按 key 的哈希值分散到 2 的整数次幂个分片中，每个分片由独立的读写锁保护，不同分片的读写互不干扰
+ *  - 分片之间通过填充字节隔开，保证相邻分片的锁不会落在同一个 cache line 上，避免伪共享
+ *  - 插入新 key 的成本与 map 规模无关，不存在 sync::Map 中 dirty 重建的 O(N) 开销
+ */
+template <class Key, class Value, class Hash = std::hash<Key>>
+class ShardedMap : base::Noncopyable{
+public:
+    // 默认分片数量
+    static const int DEFAULT_SHARDS = 64;
+
+public:
+    /**
+     * @brief: 构造函数
+     * @param: shards——分片数量，会向上取整为 2 的整数次幂
+     */
+    ShardedMap(const int shards = DEFAULT_SHARDS);
+
+public:
+    /**
+     * @brief：读取数据，存储到 receiver 中
+     * @param: key——数据键
+     * @param: receiver——接收数据的容器
+     * @return: true——数据存在，false——数据不存在
+     */
+    bool load(const Key& key, Value& receiver);
+
+    /**
+     * @brief: 写入数据
+     * @param: key——数据键
+     * @param: value——拟写入的数据
+     */
+    void store(const Key& key, Value value);
+
+    /**
+     * @brief: 删除数据
+     * @param: key——数据键
+     */
+    void evict(const Key& key);
+
+    /**
+     * @brief: 遍历 map. 逐个分片在读锁保护下拷贝出数据，然后在锁外执行闭包函数，因此闭包中允许读写 map
+     * 遍历结果在单个分片内一致，分片之间不保证是同一时刻的快照
+     * @param：f——用于接收 key-value 对的闭包函数. 返回 false 时终止遍历
+     */
+    void range(std::function<bool(const Key& key, const Value& value)> f);
+
+private:
+    // 分片
+    struct Shard{
+        // 保护分片数据的读写锁
+        RWLock lock;
+        // 分片中的数据
+        std::unordered_map<Key, Value, Hash> m;
+        // 填充字节，保证相邻分片的锁位于不同的 cache line
+        char padding[64];
+    };
+
+    // 获取 key 所属的分片
+    Shard& shardOf(const Key& key);
+    // 将分片数量向上取整为 2 的整数次幂
+    static int roundUp(const int shards);
+
+private:
+    // 分片数组
+    std::vector<Shard> m_shards;
+    // 分片掩码，即分片数量 - 1
+    uint64_t m_mask;
+    // 哈希函数
+    Hash m_hash;
+};
+
+template <class Key, class Value, class Hash>
+ShardedMap<Key,Value,Hash>::ShardedMap(const int shards):m_shards(roundUp(shards)){
+    this->m_mask = this->m_shards.size() - 1;
+}
+
+template <class Key, class Value, class Hash>
+bool ShardedMap<Key,Value,Hash>::load(const Key& key, Value& receiver){
+    Shard& shard = this->shardOf(key);
+    RWLock::readLockGuard guard(shard.lock);
+    auto it = shard.m.find(key);
+    if (it == shard.m.end()){
+        return false;
+    }
+    receiver = it->second;
+    return true;
+}
+
+template <class Key, class Value, class Hash>
+void ShardedMap<Key,Value,Hash>::store(const Key& key, Value value){
+    Shard& shard = this->shardOf(key);
+    RWLock::lockGuard guard(shard.lock);
+    shard.m[key] = std::move(value);
+}
+
+template <class Key, class Value, class Hash>
+void ShardedMap<Key,Value,Hash>::evict(const Key& key){
+    Shard& shard = this->shardOf(key);
+    RWLock::lockGuard guard(shard.lock);
+    shard.m.erase(key);
+}
+
+template <class Key, class Value, class Hash>
+void ShardedMap<Key,Value,Hash>::range(std::function<bool(const Key& key, const Value& value)> f){
+    std::vector<std::pair<Key, Value>> snapshot;
+    for (int i = 0; i < this->m_shards.size(); i++){
+        Shard& shard = this->m_shards[i];
+        snapshot.clear();
+        {
+            RWLock::readLockGuard guard(shard.lock);
+            snapshot.assign(shard.m.begin(), shard.m.end());
+        }
+
+        for (int j = 0; j < snapshot.size(); j++){
+            if (!f(snapshot[j].first, snapshot[j].second)){
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief: 获取 key 所属的分片
+ * std::hash 对整数类型通常是恒等映射，直接取低位会导致规律性的 key 集中到少数分片，因此先通过乘法散列打散高低位
+ */
+template <class Key, class Value, class Hash>
+typename ShardedMap<Key,Value,Hash>::Shard& ShardedMap<Key,Value,Hash>::shardOf(const Key& key){
+    uint64_t h = static_cast<uint64_t>(this->m_hash(key)) * 0x9E3779B97F4A7C15ULL;
+    return this->m_shards[(h >> 32) & this->m_mask];
+}
+
+template <class Key, class Value, class Hash>
+int ShardedMap<Key,Value,Hash>::roundUp(const int shards){
+    int n = 1;
+    while (n < shards){
+        n <<= 1;
+    }
+    return n;
+}
+
+}}
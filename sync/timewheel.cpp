@@ -0,0 +1,186 @@
+#include <thread>
+
+#include "timewheel.h"
+#include "thread.h"
+
+namespace cbricks{namespace sync{
+
+TimeWheel::TimeWheel(const ms tick):m_tick(tick.count() > 0 ? tick : ms(1)),m_start(std::chrono::steady_clock::now()),m_current(0),m_nextId(0){
+    for (int i = 0; i < LEVELS; i++){
+        for (int j = 0; j < SLOTS; j++){
+            this->m_slots[i][j] = nullptr;
+        }
+    }
+
+    // 异步启动推进时间轮的后台线程
+    Thread thr(std::bind(&TimeWheel::run, this));
+}
+
+TimeWheel::~TimeWheel(){
+    // 将关闭标识置为 true，后台线程感知到后退出，退出前执行 m_sem.notify
+    this->m_closed.store(true);
+    this->m_sem.wait();
+
+    for (auto it = this->m_timers.begin(); it != this->m_timers.end(); it++){
+        delete it->second;
+    }
+}
+
+/**
+ * @brief: 添加定时任务
+ * 到期 tick 向上取整，保证任务不会早于指定时间执行
+ */
+uint64_t TimeWheel::schedule(const ms delay, task cb){
+    Timer* timer = new Timer;
+    timer->cb = cb;
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->m_start).count();
+    uint64_t tick = std::chrono::duration_cast<std::chrono::nanoseconds>(this->m_tick).count();
+    uint64_t d = delay.count() > 0 ? std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count() : 0;
+    timer->expires = (elapsed + d + tick - 1) / tick;
+
+    Lock::lockGuard guard(this->m_lock);
+    timer->id = ++this->m_nextId;
+    this->m_timers.insert({timer->id, timer});
+    this->addLocked(timer);
+    return timer->id;
+}
+
+bool TimeWheel::cancel(const uint64_t id){
+    Timer* timer;
+    {
+        Lock::lockGuard guard(this->m_lock);
+        auto it = this->m_timers.find(id);
+        if (it == this->m_timers.end()){
+            return false;
+        }
+        timer = it->second;
+        this->m_timers.erase(it);
+        this->unlinkLocked(timer);
+    }
+    // 在锁外析构任务，任务闭包中捕获的对象析构时可能再次访问时间轮
+    delete timer;
+    return true;
+}
+
+size_t TimeWheel::size(){
+    Lock::lockGuard guard(this->m_lock);
+    return this->m_timers.size();
+}
+
+// 进程级的默认时间轮. 后台线程在进程退出前一直运行，因此不随静态变量析构
+TimeWheel* TimeWheel::Default(){
+    static TimeWheel* wheel = new TimeWheel;
+    return wheel;
+}
+
+/**
+ * @brief: 后台线程主函数
+ * 1）每隔一个 tick 唤醒一次，根据实际流逝的时间计算应当处理到的 tick，休眠延迟导致的积压在同一轮中追平
+ * 2）时间轮中没有任务时直接跳到目标 tick
+ * 3）到期任务在锁外执行
+ */
+void TimeWheel::run(){
+    std::vector<Timer*> expired;
+    while (!this->m_closed.load()){
+        std::this_thread::sleep_for(this->m_tick);
+        uint64_t target = this->nowTick();
+
+        {
+            Lock::lockGuard guard(this->m_lock);
+            while (this->m_current <= target){
+                if (this->m_timers.empty()){
+                    this->m_current = target + 1;
+                    break;
+                }
+                this->tickLocked(expired);
+            }
+            for (size_t i = 0; i < expired.size(); i++){
+                this->m_timers.erase(expired[i]->id);
+            }
+        }
+
+        for (size_t i = 0; i < expired.size(); i++){
+            expired[i]->cb();
+            delete expired[i];
+        }
+        expired.clear();
+    }
+    this->m_sem.notify();
+}
+
+uint64_t TimeWheel::nowTick() const{
+    return (std::chrono::steady_clock::now() - this->m_start) / this->m_tick;
+}
+
+/**
+ * @brief: 根据到期 tick 将任务放入对应级别的槽位中
+ * 1）已经过期的任务放入下一个待处理的 tick
+ * 2）距离不足 SLOTS^(i+1) 个 tick 的任务放入第 i 级，槽位由到期 tick 的第 i 组 SLOT_BITS 位决定
+ * 3）超出时间轮范围的任务暂时放入最高级中最远的槽位，到期处理时再重新分配
+ */
+void TimeWheel::addLocked(Timer* timer){
+    uint64_t expires = timer->expires < this->m_current ? this->m_current : timer->expires;
+    uint64_t delta = expires - this->m_current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))){
+        level++;
+    }
+    if (delta >= (1ULL << (SLOT_BITS * LEVELS))){
+        expires = this->m_current + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+    }
+
+    timer->level = level;
+    timer->slot = (expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+    Timer*& head = this->m_slots[level][timer->slot];
+    timer->prev = nullptr;
+    timer->next = head;
+    if (head){
+        head->prev = timer;
+    }
+    head = timer;
+}
+
+void TimeWheel::unlinkLocked(Timer* timer){
+    if (timer->prev){
+        timer->prev->next = timer->next;
+    } else{
+        this->m_slots[timer->level][timer->slot] = timer->next;
+    }
+    if (timer->next){
+        timer->next->prev = timer->prev;
+    }
+}
+
+void TimeWheel::tickLocked(std::vector<Timer*>& expired){
+    uint64_t current = this->m_current;
+    // 低一级时间轮转满一圈时，将当前级别对应槽位中的任务重新分配
+    for (int level = 1; level < LEVELS; level++){
+        if ((current >> (SLOT_BITS * (level - 1))) & (SLOTS - 1)){
+            break;
+        }
+        int slot = (current >> (SLOT_BITS * level)) & (SLOTS - 1);
+        Timer* timer = this->m_slots[level][slot];
+        this->m_slots[level][slot] = nullptr;
+        while (timer){
+            Timer* next = timer->next;
+            this->addLocked(timer);
+            timer = next;
+        }
+    }
+
+    int slot = current & (SLOTS - 1);
+    Timer* timer = this->m_slots[0][slot];
+    this->m_slots[0][slot] = nullptr;
+    this->m_current++;
+    while (timer){
+        Timer* next = timer->next;
+        if (timer->expires > current){
+            this->addLocked(timer);
+        } else{
+            expired.push_back(timer);
+        }
+        timer = next;
+    }
+}
+
+}}
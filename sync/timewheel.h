@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "../base/nocopy.h"
+#include "lock.h"
+#include "sem.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * @brief: 多级时间轮定时器
+ * 核心思路：
+ *  - 时间按照固定的 tick 划分，共 LEVELS 级时间轮，每级 SLOTS 个槽位. 第 i 级的一个槽位覆盖 SLOTS^i 个 tick
+ *  - 定时任务根据到期 tick 与当前 tick 的距离放入对应级别的槽位，每个 tick 只需处理第 0 级的一个槽位
+ *  - 第 0 级转满一圈时，将上一级当前槽位中的任务重新分配到下级时间轮中（cascade）
+ * 每个任务在到期前至多被重新分配 LEVELS - 1 次，因此推进时间轮的成本只与到期（以及被重新分配）的任务数量相关，与任务总量无关
+ * 任务由后台线程在锁外执行，执行过程中不允许阻塞过久，否则会推迟其他任务
+ */
+class TimeWheel : base::Noncopyable{
+public:
+    // 毫秒 类型别名
+    typedef std::chrono::milliseconds ms;
+    // 定时任务 类型别名
+    typedef std::function<void()> task;
+
+    // 时间轮级数
+    static const int LEVELS = 4;
+    // 每级时间轮槽位数量的位数
+    static const int SLOT_BITS = 6;
+    // 每级时间轮的槽位数量
+    static const int SLOTS = 1 << SLOT_BITS;
+
+public:
+    /**
+     * @brief: 构造函数. 启动推进时间轮的后台线程
+     * @param: tick——时间轮精度. 任务的实际执行时间不早于指定时间，至多延后一个 tick
+     */
+    TimeWheel(const ms tick = ms(10));
+    // 析构函数. 等待后台线程退出，未执行的任务直接丢弃
+    ~TimeWheel();
+
+public:
+    /**
+     * @brief: 添加定时任务
+     * @param: delay——延迟执行的时间
+     * @param: cb——定时任务
+     * @return: 任务 id，用于取消任务
+     */
+    uint64_t schedule(const ms delay, task cb);
+
+    /**
+     * @brief: 取消定时任务
+     * @return: true——取消成功 false——任务不存在，或已经到期（可能正在执行）
+     */
+    bool cancel(const uint64_t id);
+
+    // 尚未到期的任务数量
+    size_t size();
+
+    // 进程级的默认时间轮，首次使用时启动，此后不再回收
+    static TimeWheel* Default();
+
+private:
+    // 定时任务节点. 同一个槽位中的节点构成双向链表，以便在取消时 O(1) 摘除
+    struct Timer{
+        uint64_t id;
+        // 到期 tick
+        uint64_t expires;
+        task cb;
+        // 所在的时间轮级别与槽位
+        int level;
+        int slot;
+        Timer* prev;
+        Timer* next;
+    };
+
+private:
+    // 后台线程主函数. 按照 tick 间隔推进时间轮，并执行到期任务
+    void run();
+    // 当前时间对应的 tick
+    uint64_t nowTick() const;
+    // 根据到期 tick 将任务放入对应级别的槽位中
+    void addLocked(Timer* timer);
+    // 将任务从所在槽位中摘除
+    void unlinkLocked(Timer* timer);
+    /**
+     * @brief: 处理 m_current 对应的 tick
+     * 1）第 0 级转满一圈时，逐级将上一级当前槽位中的任务重新分配
+     * 2）取出第 0 级当前槽位中的任务. 超出时间轮范围而提前放入的任务重新分配，其余追加到 expired 中
+     */
+    void tickLocked(std::vector<Timer*>& expired);
+
+private:
+    // 时间轮精度
+    ms m_tick;
+    // 时间轮启动时间点
+    std::chrono::steady_clock::time_point m_start;
+
+    // 保护时间轮数据的互斥锁
+    Lock m_lock;
+    // 各级时间轮的槽位，存放任务链表头
+    Timer* m_slots[LEVELS][SLOTS];
+    // 下一个待处理的 tick. 小于该值的 tick 均已处理完成
+    uint64_t m_current;
+    // 任务 id 生成器
+    uint64_t m_nextId;
+    // 任务 id 到任务节点的映射，用于取消任务
+    std::unordered_map<uint64_t, Timer*> m_timers;
+
+    // 时间轮是否已关闭
+    std::atomic<bool> m_closed{false};
+    // 后台线程退出时通知析构函数
+    Semaphore m_sem;
+};
+
+}}
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "../base/nocopy.h"
+#include "../base/defer.h"
+#include "lock.h"
+#include "cond.h"
+
+namespace cbricks{namespace sync{
+
+/**
+ * @brief: 无界并发通道. 与 Channel 的接口风格保持一致，区别在于写入永不因容量不足而阻塞或丢弃
+ * 底层结构：由固定大小的 segment 串联而成的单向链表
+ *  - writer 往尾部 segment 追加数据，尾部 segment 写满时再挂载一个新的 segment
+ *  - reader 从头部 segment 读取数据，头部 segment 读空后将其回收到 free list 中复用
+ *  - free list 中缓存的 segment 数量存在上限，超过上限的部分直接释放，保证内存占用能在流量回落后收缩
+ * 通过 highWatermark 暴露历史最大积压量，供上层作背压决策
+ */
+template <typename T>
+class UnboundedChannel : base::Noncopyable{
+public:
+    // 共享智能指针类型别名
+    typedef std::shared_ptr<UnboundedChannel<T>> ptr;
+
+public:
+    /**
+     * @brief: 构造函数
+     * @param: segmentSize——单个 segment 可容纳的数据条数
+     * @param: maxFreeSegments——free list 中至多缓存的空闲 segment 数量
+     */
+    UnboundedChannel(const int segmentSize = 256, const int maxFreeSegments = 8);
+    // 析构函数. 关闭 channel 并释放所有 segment
+    ~UnboundedChannel();
+
+public:
+    /**
+     * @brief: 往 channel 中推送数据. 由于 channel 无界，写入操作不会阻塞
+     * @return: true——写入成功 false——channel 已关闭
+     */
+    bool write(const T data);
+    bool writeN(std::vector<T> datas);
+
+    /**
+     * @brief: 从 channel 中读取数据. 如果 channel 中数据不足，则根据阻塞模式判定是陷入阻塞还是直接返回 false
+     * @return: true——读取成功 false——读取失败
+     */
+    bool read(T& receiver, bool nonblock = false);
+    // 批量读取 receivers.size() 条数据. 只有凑满一批时才会读取，优雅关闭流程中残留数据不足一批时返回 false，残留数据保持不变
+    bool readN(std::vector<T>& receivers, bool nonblock = false);
+    /**
+     * @brief: 读取至多 receivers.size() 条数据. 只要 channel 中存在数据就立即读取，不等待凑满一批
+     * @return: 实际读取的条数，写入 receivers 的前若干个位置，receivers 的长度保持不变. 0——读取失败
+     * tip：优雅关闭流程中需要消费完所有残留数据的批量 reader 应使用此方法
+     */
+    size_t readSome(std::vector<T>& receivers, bool nonblock = false);
+
+    // 内部数据是否为空
+    const bool empty();
+    // 当前积压的数据量
+    const int size();
+    // 历史最大积压数据量（高水位），无锁读取
+    const int highWatermark() const;
+    // 将高水位重置为当前积压数据量，便于按周期统计
+    void resetHighWatermark();
+
+    // 主动关闭 channel. 阻塞中的 reader 会被唤醒并返回 false，channel 中残留的数据被丢弃
+    void close();
+    /**
+     * @brief: 优雅关闭 channel. 立即拒绝新的写入，待 reader 消费完残留数据后再执行 close 流程.
+     * 残留数据不足一批时 readN 返回 false，剩余部分需要通过 read 或 readSome 消费
+     * @param: idleTimeout——reader 连续 idleTimeout 时长没有消费任何数据时，视为不存在存活的 reader，放弃等待并丢弃残留数据
+     */
+    void drainAndClose(const std::chrono::milliseconds idleTimeout = std::chrono::milliseconds(1000));
+
+private:
+    // 关闭 channel [调用此方法时一定处于持有 m_lock 状态]
+    void closeLocked();
+    /**
+     * @brief: 读取数据的公共流程. channel 中的数据不少于 least 条时，读取至多 receivers.size() 条
+     * @param: least——至少需要的数据条数. 数据不足时根据阻塞模式判定是陷入等待还是直接返回 false，优雅关闭流程中直接返回 false
+     * @param: count——实际读取的条数
+     */
+    bool readBatch(std::vector<T>& receivers, const size_t least, bool nonblock, size_t& count);
+
+    // 由固定大小线性表组成的数据段
+    struct Segment{
+        // 构造函数. cap——数据段容量
+        Segment(const int cap);
+        // 复用前重置读写游标
+        void reset();
+
+        // 存储数据的线性表
+        std::vector<T> array;
+        // 下一个待读取的位置
+        int front;
+        // 下一个待写入的位置
+        int back;
+        // 链表中的后继数据段
+        Segment* next;
+    };
+
+private:
+    // 获取一个空闲 segment，优先从 free list 中复用 [调用时需持有 m_lock]
+    Segment* allocSegmentLocked();
+    // 回收一个已读空的 segment 到 free list [调用时需持有 m_lock]
+    void freeSegmentLocked(Segment* segment);
+
+private:
+    // 并发控制
+    Lock m_lock;
+    Cond m_readCond;
+    // 用于 close 流程等待所有活跃 reader 退出
+    Cond m_closeCond;
+    // 用于 drainAndClose 流程等待残留数据被消费完毕
+    Cond m_drainCond;
+
+    // 单个 segment 的容量
+    int m_segmentSize;
+    // free list 中至多缓存的 segment 数量
+    int m_maxFreeSegments;
+
+    // 读取端所在的头部 segment
+    Segment* m_head;
+    // 写入端所在的尾部 segment
+    Segment* m_tail;
+    // 空闲 segment 链表
+    Segment* m_free;
+    // 空闲 segment 数量
+    int m_freeCnt;
+
+    // 当前积压的数据总量
+    int m_size;
+    // 历史最大积压数据量
+    std::atomic<int> m_highWatermark{0};
+
+    // channel 是否已关闭
+    std::atomic<bool> m_closed{false};
+    // channel 是否处于优雅关闭流程中. 此时拒绝写入，但允许读取残留数据
+    std::atomic<bool> m_draining{false};
+
+    // 记录当前阻塞中的 reader 总数 [受 m_lock 保护]
+    int m_subscribers;
+};
+
+// 构造函数
+template <typename T>
+UnboundedChannel<T>::UnboundedChannel(const int segmentSize, const int maxFreeSegments){
+    if (segmentSize <= 0 || maxFreeSegments < 0){
+        throw std::exception();
+    }
+
+    this->m_segmentSize = segmentSize;
+    this->m_maxFreeSegments = maxFreeSegments;
+    this->m_free = nullptr;
+    this->m_freeCnt = 0;
+    this->m_size = 0;
+    this->m_subscribers = 0;
+    this->m_head = this->m_tail = new Segment(segmentSize);
+}
+
+// 析构函数，关闭 channel 后释放所有 segment
+template <typename T>
+UnboundedChannel<T>::~UnboundedChannel(){
+    this->close();
+
+    Segment* move = this->m_head;
+    while (move){
+        Segment* next = move->next;
+        delete move;
+        move = next;
+    }
+
+    move = this->m_free;
+    while (move){
+        Segment* next = move->next;
+        delete move;
+        move = next;
+    }
+}
+
+template <typename T>
+void UnboundedChannel<T>::close(){
+    if (this->m_closed.load()){
+        return;
+    }
+
+    Lock::lockGuard guard(this->m_lock);
+    this->closeLocked();
+}
+
+template <typename T>
+void UnboundedChannel<T>::drainAndClose(const std::chrono::milliseconds idleTimeout){
+    if (this->m_closed.load()){
+        return;
+    }
+
+    Lock::lockGuard guard(this->m_lock);
+    if (this->m_closed.load()){
+        return;
+    }
+
+    // 拒绝新的写入，并唤醒阻塞中的 reader 重新检查状态
+    this->m_draining.store(true);
+    this->m_readCond.broadcast();
+
+    // 等待 reader 将残留数据消费完毕. 期间若有其他调用方执行了 close，或者 reader 在 idleTimeout 内没有任何进展，则退出等待
+    while (this->m_size > 0 && !this->m_closed.load()){
+        int before = this->m_size;
+        if (!this->m_drainCond.waitUntil(this->m_lock, std::chrono::system_clock::now() + idleTimeout) && this->m_size == before){
+            break;
+        }
+    }
+
+    this->closeLocked();
+}
+
+/**
+ * @brief: 关闭 channel [调用此方法时一定处于持有 m_lock 状态]
+ * 1）将 closed 标识置为 true，保证不再生成新的 writer 和 reader
+ * 2）唤醒所有阻塞中的 reader
+ * 3）基于条件变量等待，直到最后一个 reader 退出时被其唤醒
+ */
+template <typename T>
+void UnboundedChannel<T>::closeLocked(){
+    if (this->m_closed.load()){
+        return;
+    }
+    this->m_closed.store(true);
+    this->m_readCond.broadcast();
+    this->m_drainCond.broadcast();
+
+    while (this->m_subscribers > 0){
+        this->m_closeCond.wait(this->m_lock);
+    }
+}
+
+template <typename T>
+bool UnboundedChannel<T>::write(const T data){
+    std::vector<T> datas;
+    datas.push_back(data);
+    return this->writeN(datas);
+}
+
+/**
+ * @brief: 批量写入数据
+ * 1）依次追加到尾部 segment，写满时从 free list 获取新的 segment 挂载到链表尾部
+ * 2）更新高水位
+ * 3）唤醒 reader
+ */
+template <typename T>
+bool UnboundedChannel<T>::writeN(std::vector<T> datas){
+    if (this->m_closed.load()){
+        return false;
+    }
+
+    Lock::lockGuard guard(this->m_lock);
+    if (this->m_closed.load() || this->m_draining.load()){
+        return false;
+    }
+
+    for (size_t i = 0; i < datas.size(); i++){
+        // 尾部 segment 已写满，挂载新的 segment
+        if (this->m_tail->back == this->m_segmentSize){
+            Segment* segment = this->allocSegmentLocked();
+            this->m_tail->next = segment;
+            this->m_tail = segment;
+        }
+        this->m_tail->array[this->m_tail->back++] = std::move(datas[i]);
+    }
+    this->m_size += datas.size();
+
+    // 更新高水位. 写操作均在持有 m_lock 时执行，因此无需 cas
+    if (this->m_size > this->m_highWatermark.load(std::memory_order_relaxed)){
+        this->m_highWatermark.store(this->m_size, std::memory_order_relaxed);
+    }
+
+    // 一次写入多条数据时，可能同时满足多个 reader
+    if (datas.size() > 1){
+        this->m_readCond.broadcast();
+    }else{
+        this->m_readCond.signal();
+    }
+    return true;
+}
+
+template <typename T>
+bool UnboundedChannel<T>::read(T& receiver, bool nonblock){
+    std::vector<T> receivers(1);
+    if (!this->readN(receivers,nonblock)){
+        return false;
+    }
+    receiver = std::move(receivers[0]);
+    return true;
+}
+
+template <typename T>
+bool UnboundedChannel<T>::readN(std::vector<T>& receivers, bool nonblock){
+    size_t count;
+    return this->readBatch(receivers,receivers.size(),nonblock,count);
+}
+
+template <typename T>
+size_t UnboundedChannel<T>::readSome(std::vector<T>& receivers, bool nonblock){
+    size_t count;
+    if (receivers.empty() || !this->readBatch(receivers,1,nonblock,count)){
+        return 0;
+    }
+    return count;
+}
+
+/**
+ * @brief: 读取数据的公共流程
+ * 1）数据不足 least 条时，根据阻塞模式判定是陷入等待还是直接返回. 优雅关闭流程中不会再有新数据写入，直接返回
+ * 2）从头部 segment 依次读取至多 receivers.size() 条数据，头部 segment 读空后回收到 free list
+ */
+template <typename T>
+bool UnboundedChannel<T>::readBatch(std::vector<T>& receivers, const size_t least, bool nonblock, size_t& count){
+    if (this->m_closed.load()){
+        return false;
+    }
+
+    Lock::lockGuard guard(this->m_lock);
+    if (this->m_closed.load()){
+        return false;
+    }
+
+    if ((size_t)this->m_size < least && !this->m_draining.load()){
+        // 非阻塞模式，直接退出
+        if (nonblock){
+            return false;
+        }
+
+        // 登记为阻塞中的 reader. 退出时若 channel 已关闭且自身为最后一个 reader，则唤醒 close 流程
+        this->m_subscribers++;
+        base::Defer subscribeDefer([this](){
+            if (--this->m_subscribers == 0 && this->m_closed.load()){
+                this->m_closeCond.signal();
+            }
+        });
+
+        while ((size_t)this->m_size < least && !this->m_draining.load()){
+            this->m_readCond.wait(this->m_lock);
+            if (this->m_closed.load()){
+                return false;
+            }
+        }
+    }
+
+    // 处于优雅关闭流程中，残留数据不足时直接退出
+    if ((size_t)this->m_size < least){
+        return false;
+    }
+
+    count = std::min((size_t)this->m_size, receivers.size());
+    for (size_t i = 0; i < count; i++){
+        // 头部 segment 已读空，将其回收并移动到后继 segment
+        if (this->m_head->front == this->m_segmentSize){
+            Segment* segment = this->m_head;
+            this->m_head = segment->next;
+            this->freeSegmentLocked(segment);
+        }
+        receivers[i] = std::move(this->m_head->array[this->m_head->front++]);
+    }
+    this->m_size -= count;
+
+    // 数据已全部读空，就地复用唯一的 segment，避免下一次写入时切换 segment
+    if (this->m_size == 0 && this->m_head == this->m_tail){
+        this->m_head->reset();
+    }
+
+    // 残留数据已消费完毕，唤醒 drainAndClose 流程
+    if (this->m_size == 0 && this->m_draining.load()){
+        this->m_drainCond.signal();
+    }
+    return true;
+}
+
+template <typename T>
+const bool UnboundedChannel<T>::empty(){
+    Lock::lockGuard guard(this->m_lock);
+    return this->m_size == 0;
+}
+
+template <typename T>
+const int UnboundedChannel<T>::size(){
+    Lock::lockGuard guard(this->m_lock);
+    return this->m_size;
+}
+
+template <typename T>
+const int UnboundedChannel<T>::highWatermark() const{
+    return this->m_highWatermark.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+void UnboundedChannel<T>::resetHighWatermark(){
+    Lock::lockGuard guard(this->m_lock);
+    this->m_highWatermark.store(this->m_size, std::memory_order_relaxed);
+}
+
+// 获取一个空闲 segment，优先从 free list 中复用
+template <typename T>
+typename UnboundedChannel<T>::Segment* UnboundedChannel<T>::allocSegmentLocked(){
+    if (!this->m_free){
+        return new Segment(this->m_segmentSize);
+    }
+
+    Segment* segment = this->m_free;
+    this->m_free = segment->next;
+    this->m_freeCnt--;
+    segment->reset();
+    return segment;
+}
+
+// 回收已读空的 segment. free list 已满时直接释放
+template <typename T>
+void UnboundedChannel<T>::freeSegmentLocked(Segment* segment){
+    if (this->m_freeCnt >= this->m_maxFreeSegments){
+        delete segment;
+        return;
+    }
+
+    segment->next = this->m_free;
+    this->m_free = segment;
+    this->m_freeCnt++;
+}
+
+template <typename T>
+UnboundedChannel<T>::Segment::Segment(const int cap):array(cap),front(0),back(0),next(nullptr){}
+
+template <typename T>
+void UnboundedChannel<T>::Segment::reset(){
+    this->front = 0;
+    this->back = 0;
+    this->next = nullptr;
+}
+
+}}